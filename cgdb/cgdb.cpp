@@ -96,6 +96,7 @@
 /* --------- */
 
 #define GDB_MAXBUF 4096 /* GDB input buffer size */
+#define HIGHLIGHT_STEP_MSECS 10 /* Time to spend highlighting when idle */
 
 const char *readline_history_filename = "readline_history.txt";
 
@@ -983,10 +984,13 @@ static int user_input_loop()
     return 0;
 }
 
-/* This updates all the breakpoints */
+/* This updates all the breakpoints, or the ones that changed */
 static void update_breakpoints(struct tgdb_response_breakpoints *response)
 {
-    source_clear_breakpoints(if_get_sview());
+    if (response->is_delta)
+        source_remove_breakpoints(if_get_sview(), response->removed);
+    else
+        source_clear_breakpoints(if_get_sview());
     source_set_breakpoints(if_get_sview(), response->breakpoints);
 
     if_show_file(NULL, 0, 0);
@@ -1165,8 +1169,7 @@ static void update_disassemble(struct tgdb_request *request,
                 node = source_add(sview, path);
 
                 node->language = TOKENIZER_LANGUAGE_ASM;
-                node->addr_start = addr_start;
-                node->addr_end = addr_end;
+                source_set_asmnode_range(sview, node, addr_start, addr_end);
 
                 if (tfp)
                 {
@@ -1358,9 +1361,14 @@ static int readline_input()
      * The strlen check is here so that if_print does not get called
      * when displaying the filedlg. If it does get called, then the 
      * gdb window gets displayed when the filedlg is up
+     *
+     * This is readline echoing what the user typed, so draw it right away.
      */
     if (size > 0)
+    {
         if_print(buf, GDB);
+        if_flush_output(1);
+    }
 
     return 0;
 }
@@ -1459,6 +1467,7 @@ static int main_loop(void)
     fd_set rset;
     int max;
     int masterfd, slavefd;
+    int ret;
 
     masterfd = pty_pair_get_masterfd(pty_pair);
     if (masterfd == -1)
@@ -1482,6 +1491,11 @@ static int main_loop(void)
 
     for (;;)
     {
+        int output_delay;
+
+        /* Draw output that's been held back, if it's due */
+        if_flush_output(0);
+
         /**
          * tty_fd can vary during the program. Some GDB variants, or perhaps
          * OS's allow the inferior to close the terminal descriptor.
@@ -1493,6 +1507,8 @@ static int main_loop(void)
          * each time in the loop.
          */
         int tty_fd = tgdb_get_inferior_fd(tgdb);
+        int watch_fd = source_get_watch_fd(if_get_sview());
+        int mi_fd = tgdb_get_mi_fd(tgdb);
 
         max = (gdb_fd > STDIN_FILENO) ? gdb_fd : STDIN_FILENO;
         max = (max > tty_fd) ? max : tty_fd;
@@ -1500,6 +1516,8 @@ static int main_loop(void)
         max = (max > signal_pipe[0]) ? max : signal_pipe[0];
         max = (max > slavefd) ? max : slavefd;
         max = (max > masterfd) ? max : masterfd;
+        max = (max > watch_fd) ? max : watch_fd;
+        max = (max > mi_fd) ? max : mi_fd;
 
         /* Reset the fd_set, and watch for input from GDB or stdin */
         FD_ZERO(&rset);
@@ -1509,6 +1527,14 @@ static int main_loop(void)
         FD_SET(resize_pipe[0], &rset);
         FD_SET(signal_pipe[0], &rset);
 
+        /* Changes to loaded source files */
+        if (watch_fd != -1)
+            FD_SET(watch_fd, &rset);
+
+        /* Answers to tgdb's own commands */
+        if (mi_fd != -1)
+            FD_SET(mi_fd, &rset);
+
         /* No readline activity allowed while displaying tab completion */
         if (!is_tab_completing)
         {
@@ -1516,8 +1542,26 @@ static int main_loop(void)
             FD_SET(masterfd, &rset);
         }
 
-        /* Wait for input */
-        if (select(max + 1, &rset, NULL, NULL, NULL) == -1)
+        /* Wait for input, or until held back output is due to be drawn.
+         * If the source file still needs syntax highlighting, just poll
+         * so we can do it while we're idle. */
+        output_delay = if_output_delay();
+
+        if (source_highlight_pending(if_get_sview()))
+            output_delay = 0;
+
+        if (output_delay >= 0)
+        {
+            struct timeval timeout = { output_delay / 1000, (output_delay % 1000) * 1000 };
+
+            ret = select(max + 1, &rset, NULL, NULL, &timeout);
+        }
+        else
+        {
+            ret = select(max + 1, &rset, NULL, NULL, NULL);
+        }
+
+        if (ret == -1)
         {
             if (errno == EINTR)
                 continue;
@@ -1528,11 +1572,25 @@ static int main_loop(void)
             }
         }
 
+        /* Nothing to read, draw held back output or highlight some more
+         * of the source file */
+        if (ret == 0)
+        {
+            if (source_highlight_pending(if_get_sview()) &&
+                source_highlight_step(if_get_sview(), HIGHLIGHT_STEP_MSECS))
+                if_draw();
+            continue;
+        }
+
         /* A signal occurred (besides SIGWINCH) */
         if (FD_ISSET(signal_pipe[0], &rset))
             if (cgdb_handle_signal_in_main_loop(signal_pipe[0]) == -1)
                 return -1;
 
+        /* A source file changed, it's reloaded at the next stop */
+        if (watch_fd != -1 && FD_ISSET(watch_fd, &rset))
+            source_read_watch_events(if_get_sview());
+
         /* A resize signal occurred */
         if (FD_ISSET(resize_pipe[0], &rset))
             if (cgdb_resize_term(resize_pipe[0]) == -1)
@@ -1564,6 +1622,9 @@ static int main_loop(void)
                 continue;
             else if (val == -1)
                 return -1;
+
+            /* Show the effect of a key right away */
+            if_flush_output(1);
         }
 
         /**
@@ -1600,6 +1661,18 @@ static int main_loop(void)
             }
         }
 
+        /* Answers to tgdb's own commands. If the channel is lost tgdb
+         * goes back to using the console. */
+        if (mi_fd != -1 && FD_ISSET(mi_fd, &rset))
+        {
+            tgdb_process_mi(tgdb);
+            process_commands(tgdb);
+
+            /* The file dialog may have been waiting for the source files */
+            if (kui_manager_cangetkey(kui_ctx))
+                user_input_loop();
+        }
+
         /* gdb's output -> stdout */
         if (FD_ISSET(gdb_fd, &rset))
         {
@@ -1769,6 +1842,15 @@ int update_kui(cgdbrc_config_option_ptr option)
     return 0;
 }
 
+static int update_source_cache(cgdbrc_config_option_ptr option)
+{
+    /* The source viewer doesn't exist yet when reading cgdbrc */
+    if (if_get_sview())
+        source_cache_trim(if_get_sview());
+
+    return 0;
+}
+
 static int destroyReadlineKeySeq(void *data)
 {
     char *keyseq = (char *)data;
@@ -1839,6 +1921,9 @@ int init_kui(void)
     cgdbrc_attach(CGDBRC_TTIMEOUT, &update_kui, NULL);
     cgdbrc_attach(CGDBRC_TTIMEOUT_LEN, &update_kui, NULL);
 
+    /* Release source files if the source cache shrinks */
+    cgdbrc_attach(CGDBRC_SOURCECACHE, &update_source_cache, NULL);
+
     /* It's important that CGDB uses readline's view of 
      * Home and End keys. A few distros I've run into (redhat e3
      * and ubuntu) provide incorrect terminfo entries for xterm.
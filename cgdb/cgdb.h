@@ -33,6 +33,9 @@ enum win_refresh
     WIN_REFRESH
 };
 
+/* Path to cgdb's config directory in the user's home directory */
+extern char cgdb_home_dir[MAXLINE];
+
 /* Clean cgdb up (when exiting) */
 void cgdb_cleanup_and_exit(int val);
 
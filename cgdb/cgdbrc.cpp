@@ -62,6 +62,11 @@ static int command_set_ttimeoutlen(int value);
 static int command_set_winminheight(int value);
 static int command_set_syntax_type(const char *value);
 static int command_set_stc(int value);
+static int command_set_sourcecache(int value);
+static int command_set_highlightcache(int value);
+static int command_set_outputdelay(int value);
+static int command_set_scrollbacklines(int value);
+static int command_set_scrollbacksize(int value);
 static int cgdbrc_set_val(struct cgdbrc_config_option config_option);
 
 /**
@@ -76,9 +81,16 @@ static struct cgdbrc_config_option cgdbrc_config_options[CGDBRC_Max] = {
     { CGDBRC_CGDB_MODE_KEY, { CGDB_KEY_ESC } },
     { CGDBRC_COLOR, { 1 } },
     { CGDBRC_DISASM, { 0 } },
+    { CGDBRC_HIGHLIGHTCACHE, { 64 } },
     { CGDBRC_IGNORECASE, { 0 } },
+    { CGDBRC_OUTPUTDELAY, { 16 } },
+    { CGDBRC_SCROLLBACKDISK, { 0 } },
+    { CGDBRC_SCROLLBACKLINES, { 0 } },
+    { CGDBRC_SCROLLBACKSIZE, { 0 } },
     { CGDBRC_SHOWMARKS, { 1 } },
     { CGDBRC_SHOWTGDBCOMMANDS, { 0 } },
+    { CGDBRC_SOURCECACHE, { 0 } },
+    { CGDBRC_SYNMAXCOL, { 3000 } },
     { CGDBRC_SYNTAX, { TOKENIZER_LANGUAGE_UNKNOWN } },
     { CGDBRC_TABSTOP, { 8 } },
     { CGDBRC_TIMEOUT, { 1 } },
@@ -135,10 +147,26 @@ static struct ConfigVariable
     {
         "disasm", "dis", CONFIG_TYPE_BOOL,
         (void *)&cgdbrc_config_options[CGDBRC_DISASM].variant.int_val },
+    /* highlightcache */
+    {
+        "highlightcache", "hlc", CONFIG_TYPE_FUNC_INT, (void *)&command_set_highlightcache },
     /* ignorecase */
     {
         "ignorecase", "ic", CONFIG_TYPE_BOOL,
         (void *)&cgdbrc_config_options[CGDBRC_IGNORECASE].variant.int_val },
+    /* outputdelay */
+    {
+        "outputdelay", "od", CONFIG_TYPE_FUNC_INT, (void *)&command_set_outputdelay },
+    /* scrollbackdisk */
+    {
+        "scrollbackdisk", "sbd", CONFIG_TYPE_BOOL,
+        (void *)&cgdbrc_config_options[CGDBRC_SCROLLBACKDISK].variant.int_val },
+    /* scrollbacklines */
+    {
+        "scrollbacklines", "sbl", CONFIG_TYPE_FUNC_INT, (void *)&command_set_scrollbacklines },
+    /* scrollbacksize */
+    {
+        "scrollbacksize", "sbs", CONFIG_TYPE_FUNC_INT, (void *)&command_set_scrollbacksize },
     /* showmarks */
     {
         "showmarks", "marks", CONFIG_TYPE_INT,
@@ -146,6 +174,13 @@ static struct ConfigVariable
     /* showtgdbcommands */
     {
         "showtgdbcommands", "stc", CONFIG_TYPE_FUNC_BOOL, (void *)&command_set_stc },
+    /* sourcecache */
+    {
+        "sourcecache", "sc", CONFIG_TYPE_FUNC_INT, (void *)&command_set_sourcecache },
+    /* synmaxcol */
+    {
+        "synmaxcol", "smc", CONFIG_TYPE_INT,
+        (void *)&cgdbrc_config_options[CGDBRC_SYNMAXCOL].variant.int_val },
     /* syntax */
     {
         "syntax", "syn", CONFIG_TYPE_FUNC_STRING, (void *)command_set_syntax_type },
@@ -409,6 +444,71 @@ int command_set_splitorientation(const char *value)
     return 0;
 }
 
+static int command_set_sourcecache(int value)
+{
+    struct cgdbrc_config_option option;
+
+    /* Size in megabytes, 0 for no limit */
+    if (value < 0)
+        return 1;
+
+    option.option_kind = CGDBRC_SOURCECACHE;
+    option.variant.int_val = value;
+    return cgdbrc_set_val(option);
+}
+
+static int command_set_highlightcache(int value)
+{
+    struct cgdbrc_config_option option;
+
+    /* Size in megabytes, 0 to disable the cache */
+    if (value < 0)
+        return 1;
+
+    option.option_kind = CGDBRC_HIGHLIGHTCACHE;
+    option.variant.int_val = value;
+    return cgdbrc_set_val(option);
+}
+
+static int command_set_outputdelay(int value)
+{
+    struct cgdbrc_config_option option;
+
+    /* Milliseconds between draws of new output, 0 to draw it right away */
+    if (value < 0)
+        return 1;
+
+    option.option_kind = CGDBRC_OUTPUTDELAY;
+    option.variant.int_val = value;
+    return cgdbrc_set_val(option);
+}
+
+static int command_set_scrollbacklines(int value)
+{
+    struct cgdbrc_config_option option;
+
+    /* Lines kept by each scroller, 0 for no limit */
+    if (value < 0)
+        return 1;
+
+    option.option_kind = CGDBRC_SCROLLBACKLINES;
+    option.variant.int_val = value;
+    return cgdbrc_set_val(option);
+}
+
+static int command_set_scrollbacksize(int value)
+{
+    struct cgdbrc_config_option option;
+
+    /* Size in megabytes of each scroller, 0 for no limit */
+    if (value < 0)
+        return 1;
+
+    option.option_kind = CGDBRC_SCROLLBACKSIZE;
+    option.variant.int_val = value;
+    return cgdbrc_set_val(option);
+}
+
 static int command_set_winminheight(int value)
 {
     struct cgdbrc_config_option option;
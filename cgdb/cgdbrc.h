@@ -120,9 +120,16 @@ enum cgdbrc_option_kind
     CGDBRC_CGDB_MODE_KEY,
     CGDBRC_COLOR,
     CGDBRC_DISASM,
+    CGDBRC_HIGHLIGHTCACHE,
     CGDBRC_IGNORECASE,
+    CGDBRC_OUTPUTDELAY,
+    CGDBRC_SCROLLBACKDISK,
+    CGDBRC_SCROLLBACKLINES,
+    CGDBRC_SCROLLBACKSIZE,
     CGDBRC_SHOWMARKS,
     CGDBRC_SHOWTGDBCOMMANDS,
+    CGDBRC_SOURCECACHE,
+    CGDBRC_SYNMAXCOL,
     CGDBRC_SYNTAX,
     CGDBRC_TABSTOP,
     CGDBRC_TIMEOUT,
@@ -148,6 +155,7 @@ struct cgdbrc_config_option
         /* option_kind == CGDBRC_IGNORECASE */
         /* option_kind == CGDBRC_SHOWMARKS */
         /* option_kind == CGDBRC_SHOWTGDBCOMMANDS */
+        /* option_kind == CGDBRC_SYNMAXCOL */
         /* option_kind == CGDBRC_TABSTOP */
         /* option_kind == CGDBRC_TIMEOUT */
         /* option_kind == CGDBRC_TIMEOUTLEN */
@@ -156,6 +164,11 @@ struct cgdbrc_config_option
         /* option_kind == CGDBRC_WINMINHEIGHT */
         /* option_kind == CGDBRC_WRAPSCAN */
         /* option_kind == CGDBRC_DISASM */
+        /* option_kind == CGDBRC_HIGHLIGHTCACHE */
+        /* option_kind == CGDBRC_SOURCECACHE */
+        /* option_kind == CGDBRC_SCROLLBACKDISK */
+        /* option_kind == CGDBRC_SCROLLBACKLINES */
+        /* option_kind == CGDBRC_SCROLLBACKSIZE */
         int int_val;
         /* option_kind == CGDBRC_ARROWSTYLE */
         enum ArrowStyle arrow_style;
@@ -402,8 +402,8 @@ int filedlg_display(struct filedlg *fd)
             continue;
         }
 
-        int x, y;
         char *filename = fd->buf->files[file];
+        struct hl_line_attr *attrs = NULL;
 
         /* Mark the current file with an arrow */
         if (file == fd->buf->sel_line)
@@ -429,25 +429,12 @@ int filedlg_display(struct filedlg *fd)
             swin_waddch(fd->win, ' ');
         }
 
-        y = swin_getcury(fd->win);
-        x = swin_getcurx(fd->win);
-
-        hl_printline(fd->win, filename, strlen(filename),
-            NULL, -1, -1, fd->buf->sel_col, width - lwidth - 2);
-
         if (regex_line[0])
-        {
-            struct hl_line_attr *attrs;
-
             attrs = hl_regex_highlight(&fd->hlregex, filename);
 
-            if (sbcount(attrs))
-            {
-                hl_printline_highlight(fd->win, filename, strlen(filename),
-                    attrs, x, y, fd->buf->sel_col, width - lwidth - 2);
-                sbfree(attrs);
-            }
-        }
+        hl_printline_overlay(fd->win, filename, strlen(filename),
+            NULL, attrs, -1, -1, fd->buf->sel_col, width - lwidth - 2);
+        sbfree(attrs);
     }
 
     /* Add the 2 lines back in so the status bar can be drawn */
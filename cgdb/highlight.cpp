@@ -28,6 +28,7 @@
 #include "tokenizer.h"
 #include "sources.h"
 #include "highlight_groups.h"
+#include "regex_dfa.h"
 
 /* ----------- */
 /* Definitions */
@@ -39,6 +40,9 @@
 /* Local Variables */
 /* --------------- */
 
+/* Last generation handed out by hl_regex_compile */
+static int hl_regex_generation_count;
+
 
 /* --------- */
 /* Functions */
@@ -48,6 +52,8 @@ struct hl_regex_info {
     regex_t t;
     int icase;
     char *regex;
+    int generation;
+    struct regex_dfa *dfa; /* Faster matcher, NULL if only regexec works */
 };
 
 const char *hl_regex_get(struct hl_regex_info *info)
@@ -62,6 +68,7 @@ void hl_regex_free(struct hl_regex_info **info)
 {
     if (info && *info && (*info)->regex) {
         regfree(&(*info)->t);
+        regex_dfa_free((*info)->dfa);
 
         free((*info)->regex);
         (*info)->regex = NULL;
@@ -71,15 +78,10 @@ void hl_regex_free(struct hl_regex_info **info)
     }
 }
 
-int hl_regex_search(struct hl_regex_info **info, char *line, const char *regex, int icase, int *start, int *end)
+int hl_regex_compile(struct hl_regex_info **info, const char *regex, int icase)
 {
-    int result;
-    regmatch_t pmatch;
     int recompile = 0;
 
-    *start = -1;
-    *end = -1;
-
     if (!regex || !regex[0])
         return -1;
     
@@ -99,6 +101,8 @@ int hl_regex_search(struct hl_regex_info **info, char *line, const char *regex,
     if (recompile) {
         if (*info && (*info)->regex) {
             regfree(&(*info)->t);
+            regex_dfa_free((*info)->dfa);
+            (*info)->dfa = NULL;
 
             free((*info)->regex);
             (*info)->regex = NULL;
@@ -112,16 +116,68 @@ int hl_regex_search(struct hl_regex_info **info, char *line, const char *regex,
 
         (*info)->regex = strdup(regex);
         (*info)->icase = icase;
+        (*info)->dfa = regex_dfa_compile(regex, icase != 0);
+        (*info)->generation = ++hl_regex_generation_count;
     }
 
-    char *lf = strchr(line, '\n');
-    if (lf)
-        *lf = '\0';
+    return 0;
+}
+
+int hl_regex_generation(struct hl_regex_info *info)
+{
+    return (info && info->regex) ? info->generation : 0;
+}
 
-    result = regexec(&(*info)->t, line, 1, &pmatch, 0);
+/* Returns the length of line, which ends at a line feed or nil */
+static int hl_line_length(const char *line)
+{
+    const char *lf = strchr(line, '\n');
 
-    if (lf)
-        *lf = '\n';
+    return lf ? lf - line : strlen(line);
+}
+
+/**
+ * Search the first len bytes of line for the compiled regex in info.
+ * The line isn't copied or written to, so it can point into read-only
+ * mapped file data.
+ *
+ * \return
+ * 1 if there's a match, 0 if not.
+ */
+static int hl_regex_exec(struct hl_regex_info *info, const char *line,
+    int len, int *start, int *end)
+{
+    int result;
+    regmatch_t pmatch;
+
+    *start = -1;
+    *end = -1;
+
+    if (info->dfa)
+    {
+        result = regex_dfa_search(info->dfa, line, len, start, end);
+        if (result >= 0)
+            return result;
+    }
+
+    if (!line[len])
+    {
+        result = regexec(&info->t, line, 1, &pmatch, 0);
+    }
+    else
+    {
+#ifdef REG_STARTEND
+        pmatch.rm_so = 0;
+        pmatch.rm_eo = len;
+        result = regexec(&info->t, line, 1, &pmatch, REG_STARTEND);
+#else
+        char *str = NULL;
+
+        sbpushstr(&str, line, len);
+        result = regexec(&info->t, str, 1, &pmatch, 0);
+        sbfree(str);
+#endif
+    }
 
     if ((result == 0) && (pmatch.rm_eo > pmatch.rm_so)) {
         *start = pmatch.rm_so;
@@ -132,42 +188,78 @@ int hl_regex_search(struct hl_regex_info **info, char *line, const char *regex,
     return 0;
 }
 
-struct hl_line_attr *hl_regex_highlight(struct hl_regex_info **info, char *line)
+int hl_regex_search(struct hl_regex_info **info, const char *line, const char *regex, int icase, int *start, int *end)
 {
-    hl_line_attr *attrs = NULL;
+    return hl_regex_search_len(info, line, hl_line_length(line), regex, icase, start, end);
+}
+
+int hl_regex_search_len(struct hl_regex_info **info, const char *line, int len, const char *regex, int icase, int *start, int *end)
+{
+    *start = -1;
+    *end = -1;
+
+    if (hl_regex_compile(info, regex, icase) == -1)
+        return -1;
+
+    return hl_regex_exec(*info, line, len, start, end);
+}
+
+int hl_regex_find_all(struct hl_regex_info **info, const char *line, int len, int **cols)
+{
+    int count = 0;
 
     if (*info && (*info)->regex && (*info)->regex[0]) {
         int pos = 0;
-        int search_attr;
-        struct hl_line_attr line_attr;
 
-        hl_groups_get_attr(hl_groups_instance, HLG_SEARCH, &search_attr);
-
-        for (;;) {
-            int ret;
-            int len;
+        /* Each search starts where the last match ended, so a long line
+         * with many matches is only scanned once */
+        while (pos < len) {
             int start, end;
 
-            ret = hl_regex_search(info, line + pos, (*info)->regex, (*info)->icase, &start, &end);
-            if (ret <= 0)
+            if (hl_regex_exec(*info, line + pos, len - pos, &start, &end) <= 0)
                 break;
 
-            len = end - start;
-            pos += start;
+            sbpush(*cols, pos + start);
+            sbpush(*cols, pos + end);
+            count++;
+
+            pos += end;
+        }
+    }
+
+    return count;
+}
+
+struct hl_line_attr *hl_regex_highlight(struct hl_regex_info **info, const char *line)
+{
+    return hl_regex_highlight_len(info, line, hl_line_length(line));
+}
 
+struct hl_line_attr *hl_regex_highlight_len(struct hl_regex_info **info, const char *line, int len)
+{
+    int i;
+    int *cols = NULL;
+    hl_line_attr *attrs = NULL;
+
+    if (hl_regex_find_all(info, line, len, &cols) > 0) {
+        int search_attr;
+        struct hl_line_attr line_attr;
+
+        hl_groups_get_attr(hl_groups_instance, HLG_SEARCH, &search_attr);
+
+        for (i = 0; i < sbcount(cols); i += 2) {
             /* Push search attribute */
             line_attr.attr = search_attr;
-            line_attr.col = pos;
+            line_attr.col = cols[i];
             sbpush(attrs, line_attr);
 
             /* And the back to regular text attribute */
             line_attr.attr = 0;
-            line_attr.col = pos + len;
+            line_attr.col = cols[i + 1];
             sbpush(attrs, line_attr);
-
-            pos += len;
         }
     }
 
+    sbfree(cols);
     return attrs;
 }
@@ -10,10 +10,28 @@
 
 struct hl_regex_info;
 
-int hl_regex_search(struct hl_regex_info **info, char *line, const char *regex, int icase, int *start, int *end);
+int hl_regex_search(struct hl_regex_info **info, const char *line, const char *regex, int icase, int *start, int *end);
+
+/* Like hl_regex_search, but searches the first len bytes of line */
+int hl_regex_search_len(struct hl_regex_info **info, const char *line, int len, const char *regex, int icase, int *start, int *end);
 void hl_regex_free(struct hl_regex_info **info);
 
-struct hl_line_attr *hl_regex_highlight(struct hl_regex_info **info, char *line);
+/* Compile regex into info, unless it's what info already has. Returns 0 on
+ * success, -1 if the regex doesn't compile. */
+int hl_regex_compile(struct hl_regex_info **info, const char *regex, int icase);
+
+/* Return a number which changes each time a regex is compiled, or 0 if
+ * info has no regex. Results saved for one regex can be keyed by it. */
+int hl_regex_generation(struct hl_regex_info *info);
+
+/* Append the start and end column of each match in the first len bytes of
+ * line to the stretchy buffer cols. Returns the number of matches. */
+int hl_regex_find_all(struct hl_regex_info **info, const char *line, int len, int **cols);
+
+struct hl_line_attr *hl_regex_highlight(struct hl_regex_info **info, const char *line);
+
+/* Like hl_regex_highlight, but highlights the first len bytes of line */
+struct hl_line_attr *hl_regex_highlight_len(struct hl_regex_info **info, const char *line, int len);
 
 /* Return the regex string (or NULL) */
 const char *hl_regex_get(struct hl_regex_info *info);
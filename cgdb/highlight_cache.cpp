@@ -0,0 +1,486 @@
+/* highlight_cache.c:
+ * ------------------
+ *
+ * Persistent cache of source file line indexes and highlight runs.
+ *
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+/* System Includes */
+#if HAVE_STDIO_H
+#include <stdio.h>
+#endif /* HAVE_STDIO_H */
+
+#if HAVE_STDLIB_H
+#include <stdlib.h>
+#endif /* HAVE_STDLIB_H */
+
+#if HAVE_STRING_H
+#include <string.h>
+#endif /* HAVE_STRING_H */
+
+#if HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif /* HAVE_SYS_TYPES_H */
+
+#if HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+
+#if HAVE_TIME_H
+#include <time.h>
+#endif /* HAVE_TIME_H */
+
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif /* HAVE_UNISTD_H */
+
+#if HAVE_FCNTL_H
+#include <fcntl.h>
+#endif /* HAVE_FCNTL_H */
+
+#if HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif /* HAVE_SYS_MMAN_H */
+
+#if HAVE_DIRENT_H
+#include <dirent.h>
+#endif /* HAVE_DIRENT_H */
+
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+/* Local Includes */
+#include "sys_util.h"
+#include "sys_win.h"
+#include "highlight_groups.h"
+#include "fs_util.h"
+#include "highlight_cache.h"
+
+/* ----------- */
+/* Definitions */
+/* ----------- */
+
+#define HL_CACHE_MAGIC "CGDBHLC"
+
+/* Bump when the layout of cache files changes */
+#define HL_CACHE_FORMAT 3
+
+#define HL_CACHE_SUFFIX ".hlc"
+
+/* Suffix of the temporary files entries are written to */
+#define HL_CACHE_TMP_SUFFIX ".tmp"
+
+/* Seconds after which a temporary file was left by a cgdb that died
+ * while writing it */
+#define HL_CACHE_TMP_AGE 600
+
+/* Cache file header. It's followed by the source path padded to a multiple
+ * of 8 bytes, line_count + 1 line offsets, line_count + 1 run offsets,
+ * run_count runs and state_count line and state pairs. */
+struct hl_cache_header
+{
+    char magic[8];     /* HL_CACHE_MAGIC */
+    char version[16];  /* cgdb VERSION, the lexers may change between versions */
+    int32_t format;    /* HL_CACHE_FORMAT */
+    int32_t long_size; /* sizeof(long) of the line offsets */
+    int32_t hlg_count; /* HLG_LAST, runs store hl_group_kind values */
+    int32_t tabstop;
+    int32_t synmaxcol;
+    int32_t language;
+    int32_t max_width;
+    int32_t line_count;
+    int32_t run_count;
+    int32_t path_len;
+    int32_t state_count;
+    int64_t file_size;
+    int64_t file_mtime;
+};
+
+/* --------------- */
+/* Local Functions */
+/* --------------- */
+
+static size_t hl_cache_path_size(int path_len)
+{
+    return (path_len + 7) & ~7;
+}
+
+static size_t hl_cache_data_size(const struct hl_cache_header *header)
+{
+    return sizeof(*header) + hl_cache_path_size(header->path_len) +
+        (size_t)(header->line_count + 1) * sizeof(long) +
+        (size_t)(header->line_count + 1) * sizeof(int) +
+        (size_t)header->run_count * sizeof(uint32_t) +
+        (size_t)header->state_count * 2 * sizeof(int);
+}
+
+/**
+ * Check the arrays of an entry point inside the data they index, so a
+ * damaged entry of the right size isn't used.
+ *
+ * \param header
+ * The entry's header
+ *
+ * \param data
+ * The line offsets, the arrays after them follow
+ *
+ * \return
+ * 1 if the arrays are good, otherwise 0.
+ */
+static int hl_cache_check_arrays(const struct hl_cache_header *header,
+    const char *data)
+{
+    int i;
+    const long *line_offsets = (const long *)data;
+    const int *hl_offsets = (const int *)(line_offsets + header->line_count + 1);
+    const int *line_states = (const int *)((const uint32_t *)
+        (hl_offsets + header->line_count + 1) + header->run_count);
+
+    if (line_offsets[0] < 0 || hl_offsets[0] < 0)
+        return 0;
+
+    for (i = 0; i < header->line_count; i++)
+    {
+        if (line_offsets[i + 1] < line_offsets[i] ||
+            hl_offsets[i + 1] < hl_offsets[i])
+            return 0;
+    }
+
+    if (line_offsets[header->line_count] > header->file_size ||
+        hl_offsets[header->line_count] > header->run_count)
+        return 0;
+
+    /* Line and state pairs, sorted by line */
+    for (i = 0; i < header->state_count; i++)
+    {
+        int line = line_states[2 * i];
+
+        if (line < 0 || line >= header->line_count ||
+            (i > 0 && line <= line_states[2 * (i - 1)]))
+            return 0;
+    }
+
+    return 1;
+}
+
+static void hl_cache_init_header(struct hl_cache_header *header)
+{
+    memset(header, 0, sizeof(*header));
+    strncpy(header->magic, HL_CACHE_MAGIC, sizeof(header->magic));
+    strncpy(header->version, VERSION, sizeof(header->version) - 1);
+    header->format = HL_CACHE_FORMAT;
+    header->long_size = sizeof(long);
+    header->hlg_count = HLG_LAST;
+}
+
+/**
+ * Get the cache file name for a source file. The name is a hash of the
+ * path, the full path is stored in the header to catch collisions.
+ *
+ * \param dir
+ * Cache directory
+ *
+ * \param path
+ * Full path to source file
+ *
+ * \param filename
+ * Where to store the cache file name
+ *
+ * \param size
+ * Size of filename
+ */
+static void hl_cache_filename(const char *dir, const char *path,
+    char *filename, size_t size)
+{
+    /* 64 bit FNV-1a */
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (; *path; path++)
+    {
+        hash ^= (unsigned char)*path;
+        hash *= 1099511628211ULL;
+    }
+
+    snprintf(filename, size, "%s/%08x%08x" HL_CACHE_SUFFIX, dir,
+        (unsigned int)(hash >> 32), (unsigned int)hash);
+}
+
+static void hl_cache_free_data(void *data, size_t size, int mapped)
+{
+#if HAVE_SYS_MMAN_H
+    if (mapped)
+        munmap(data, size);
+    else
+#endif
+        free(data);
+}
+
+/* ----------------- */
+/* Exposed Functions */
+/* ----------------- */
+
+/* Descriptive comments found in header file: highlight_cache.h */
+
+int hl_cache_load(const char *dir, const struct hl_cache_key *key,
+    struct hl_cache_entry *entry)
+{
+    char filename[FSUTIL_PATH_MAX];
+    struct hl_cache_header header;
+    struct hl_cache_header *cached;
+    struct stat st;
+    const char *data;
+    void *map = NULL;
+    int mapped = 0;
+    int path_len = strlen(key->path);
+    int fd;
+
+    memset(entry, 0, sizeof(*entry));
+
+    hl_cache_filename(dir, key->path, filename, sizeof(filename));
+
+    fd = open(filename, O_RDONLY);
+    if (fd == -1)
+        return -1;
+
+    if (fstat(fd, &st) || (st.st_size < (off_t)sizeof(header)))
+    {
+        close(fd);
+        return -1;
+    }
+
+#if HAVE_SYS_MMAN_H
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+        map = NULL;
+    else
+        mapped = 1;
+#endif
+
+    if (!map)
+    {
+        map = malloc(st.st_size);
+        if (map && read(fd, map, st.st_size) != st.st_size)
+        {
+            free(map);
+            map = NULL;
+        }
+    }
+
+    close(fd);
+
+    if (!map)
+        return -1;
+
+    /* Check the entry was written by this version of cgdb for this file */
+    cached = (struct hl_cache_header *)map;
+    hl_cache_init_header(&header);
+
+    if (memcmp(cached->magic, header.magic, sizeof(header.magic)) ||
+        memcmp(cached->version, header.version, sizeof(header.version)) ||
+        cached->format != header.format ||
+        cached->long_size != header.long_size ||
+        cached->hlg_count != header.hlg_count ||
+        cached->line_count < 0 || cached->run_count < 0 ||
+        cached->state_count < 0 ||
+        cached->path_len != path_len ||
+        hl_cache_data_size(cached) != (size_t)st.st_size ||
+        memcmp((const char *)map + sizeof(header), key->path, path_len) ||
+        cached->file_size != key->file_size ||
+        cached->file_mtime != key->file_mtime ||
+        !hl_cache_check_arrays(cached, (const char *)map + sizeof(header) +
+            hl_cache_path_size(path_len)))
+    {
+        hl_cache_free_data(map, st.st_size, mapped);
+        return -1;
+    }
+
+    data = (const char *)map + sizeof(header) + hl_cache_path_size(path_len);
+
+    entry->max_width = cached->max_width;
+    entry->line_count = cached->line_count;
+    entry->line_offsets = (const long *)data;
+    data += (entry->line_count + 1) * sizeof(long);
+
+    /* Runs are only good for the settings and language they were made with */
+    if (cached->tabstop == key->tabstop && cached->synmaxcol == key->synmaxcol &&
+        cached->language == key->language)
+    {
+        entry->hl_offsets = (const int *)data;
+        data += (entry->line_count + 1) * sizeof(int);
+        entry->hl_runs = (const uint32_t *)data;
+        entry->run_count = cached->run_count;
+        data += entry->run_count * sizeof(uint32_t);
+        entry->line_states = (const int *)data;
+        entry->state_count = cached->state_count;
+    }
+
+    entry->data = map;
+    entry->data_size = st.st_size;
+    entry->data_mapped = mapped;
+
+    /* Mark the entry as recently used for hl_cache_trim */
+    utimes(filename, NULL);
+
+    return 0;
+}
+
+void hl_cache_release(struct hl_cache_entry *entry)
+{
+    if (entry->data)
+        hl_cache_free_data(entry->data, entry->data_size, entry->data_mapped);
+
+    memset(entry, 0, sizeof(*entry));
+}
+
+int hl_cache_save(const char *dir, const struct hl_cache_key *key,
+    const struct hl_cache_entry *entry)
+{
+    static const char padding[8] = { 0 };
+    char filename[FSUTIL_PATH_MAX];
+    char tmpname[FSUTIL_PATH_MAX + 32]; /* Room for the pid and suffix */
+    struct hl_cache_header header;
+    FILE *file;
+    int ok;
+
+    hl_cache_init_header(&header);
+    header.tabstop = key->tabstop;
+    header.synmaxcol = key->synmaxcol;
+    header.language = key->language;
+    header.max_width = entry->max_width;
+    header.line_count = entry->line_count;
+    header.run_count = entry->run_count;
+    header.state_count = entry->state_count;
+    header.path_len = strlen(key->path);
+    header.file_size = key->file_size;
+    header.file_mtime = key->file_mtime;
+
+    hl_cache_filename(dir, key->path, filename, sizeof(filename));
+    snprintf(tmpname, sizeof(tmpname), "%s.%ld" HL_CACHE_TMP_SUFFIX,
+        filename, (long)getpid());
+
+    file = fopen(tmpname, "wb");
+    if (!file)
+        return -1;
+
+    ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+        fwrite(key->path, 1, header.path_len, file) == (size_t)header.path_len &&
+        fwrite(padding, 1, hl_cache_path_size(header.path_len) - header.path_len, file) ==
+            hl_cache_path_size(header.path_len) - header.path_len &&
+        fwrite(entry->line_offsets, sizeof(long), entry->line_count + 1, file) ==
+            (size_t)entry->line_count + 1 &&
+        fwrite(entry->hl_offsets, sizeof(int), entry->line_count + 1, file) ==
+            (size_t)entry->line_count + 1 &&
+        (!entry->run_count ||
+            fwrite(entry->hl_runs, sizeof(uint32_t), entry->run_count, file) ==
+                (size_t)entry->run_count) &&
+        (!entry->state_count ||
+            fwrite(entry->line_states, 2 * sizeof(int), entry->state_count, file) ==
+                (size_t)entry->state_count);
+
+    if (fclose(file))
+        ok = 0;
+
+    if (!ok || rename(tmpname, filename))
+    {
+        unlink(tmpname);
+        return -1;
+    }
+
+    return 0;
+}
+
+struct hl_cache_file
+{
+    char *name;
+    time_t mtime;
+    long size;
+};
+
+static int hl_cache_file_compare(const void *a, const void *b)
+{
+    const struct hl_cache_file *fa = (const struct hl_cache_file *)a;
+    const struct hl_cache_file *fb = (const struct hl_cache_file *)b;
+
+    if (fa->mtime != fb->mtime)
+        return (fa->mtime < fb->mtime) ? -1 : 1;
+
+    return strcmp(fa->name, fb->name);
+}
+
+void hl_cache_trim(const char *dir, long max_size)
+{
+#if HAVE_DIRENT_H
+    int i;
+    long total = 0;
+    struct hl_cache_file *files = NULL;
+    struct dirent *ent;
+    DIR *d = opendir(dir);
+
+    if (!d)
+        return;
+
+    while ((ent = readdir(d)))
+    {
+        struct stat st;
+        char filename[FSUTIL_PATH_MAX];
+        size_t len = strlen(ent->d_name);
+        size_t suffix_len = strlen(HL_CACHE_SUFFIX);
+        size_t tmp_suffix_len = strlen(HL_CACHE_TMP_SUFFIX);
+
+        /* Temporary files are <entry>.<pid>.tmp */
+        if (len > tmp_suffix_len &&
+            !strcmp(ent->d_name + len - tmp_suffix_len, HL_CACHE_TMP_SUFFIX) &&
+            strstr(ent->d_name, HL_CACHE_SUFFIX "."))
+        {
+            snprintf(filename, sizeof(filename), "%s/%s", dir, ent->d_name);
+
+            /* Leave the ones still being written alone */
+            if (!stat(filename, &st) && st.st_mtime < time(NULL) - HL_CACHE_TMP_AGE)
+                unlink(filename);
+            continue;
+        }
+
+        if (len <= suffix_len ||
+            strcmp(ent->d_name + len - suffix_len, HL_CACHE_SUFFIX))
+            continue;
+
+        snprintf(filename, sizeof(filename), "%s/%s", dir, ent->d_name);
+        if (!stat(filename, &st))
+        {
+            struct hl_cache_file file;
+
+            file.name = strdup(filename);
+            file.mtime = st.st_mtime;
+            file.size = st.st_size;
+            sbpush(files, file);
+
+            total += st.st_size;
+        }
+    }
+
+    closedir(d);
+
+    /* Delete the least recently used entries first */
+    if (total > max_size)
+        qsort(files, sbcount(files), sizeof(files[0]), hl_cache_file_compare);
+
+    for (i = 0; i < sbcount(files); i++)
+    {
+        if (total > max_size && !unlink(files[i].name))
+            total -= files[i].size;
+
+        free(files[i].name);
+    }
+
+    sbfree(files);
+#endif /* HAVE_DIRENT_H */
+}
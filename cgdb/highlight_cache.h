@@ -0,0 +1,94 @@
+#ifndef _HIGHLIGHT_CACHE_H_
+#define _HIGHLIGHT_CACHE_H_
+
+/* highlight_cache.h:
+ * ------------------
+ *
+ * Persistent cache of source file line indexes and highlight runs. Each
+ * source file gets one binary file in the cache directory, laid out so it
+ * can be mapped into memory and used after checking its header. An entry
+ * is only used if the source file still has the size and modification time
+ * it had when the entry was written. The highlight runs in an entry are
+ * only used if the tabstop and language also match.
+ *
+ */
+
+/* --------------- */
+/* Data Structures */
+/* --------------- */
+
+/* What a cache entry is looked up and validated by */
+struct hl_cache_key
+{
+    const char *path;  /* Full path to source file */
+    long file_size;    /* Size of source file */
+    time_t file_mtime; /* Modification time of source file */
+    int tabstop;       /* Tabstop the runs were calculated with */
+    int synmaxcol;     /* synmaxcol the runs were calculated with */
+    int language;      /* enum tokenizer_language_support */
+};
+
+/* A cache entry, pointing into the cache file data */
+struct hl_cache_entry
+{
+    int max_width;            /* Width of longest line in file */
+    int line_count;           /* Number of lines in file */
+    const long *line_offsets; /* line_count + 1 line offsets */
+    const int *hl_offsets;    /* line_count + 1 run offsets, NULL if the
+                                 tabstop or language didn't match */
+    const uint32_t *hl_runs;  /* Packed highlight runs */
+    int run_count;            /* Number of runs in hl_runs */
+    const int *line_states;   /* Line and lexer start state pairs */
+    int state_count;          /* Number of pairs in line_states */
+
+    void *data;       /* Cache file contents */
+    size_t data_size; /* Size of data */
+    int data_mapped;  /* 1 if data was mapped with mmap */
+};
+
+/* --------- */
+/* Functions */
+/* --------- */
+
+/* hl_cache_load:  Look up and validate the cache entry for a source file.
+ * --------------
+ *
+ *   dir:    Cache directory
+ *   key:    Source file the entry is for
+ *   entry:  Filled in on success, release with hl_cache_release
+ *
+ * Return Value:  Zero on success, -1 if there is no valid entry.
+ */
+int hl_cache_load(const char *dir, const struct hl_cache_key *key,
+    struct hl_cache_entry *entry);
+
+/* hl_cache_release:  Release an entry returned by hl_cache_load.
+ * -----------------
+ *
+ *   entry:  The cache entry
+ */
+void hl_cache_release(struct hl_cache_entry *entry);
+
+/* hl_cache_save:  Write the cache entry for a source file. The entry is
+ * --------------  written to a temporary file and renamed into place, so
+ *                 readers never see a partial entry.
+ *
+ *   dir:    Cache directory
+ *   key:    Source file the entry is for
+ *   entry:  Line index and highlight runs to save, the data fields
+ *           are ignored
+ *
+ * Return Value:  Zero on success, -1 on error.
+ */
+int hl_cache_save(const char *dir, const struct hl_cache_key *key,
+    const struct hl_cache_entry *entry);
+
+/* hl_cache_trim:  Delete the least recently used entries until the cache
+ * --------------  directory is no larger than max_size.
+ *
+ *   dir:       Cache directory
+ *   max_size:  Maximum size of the cache in bytes
+ */
+void hl_cache_trim(const char *dir, long max_size);
+
+#endif /* _HIGHLIGHT_CACHE_H_ */
@@ -49,6 +49,42 @@ struct hl_group_info
     int color_pair;
 };
 
+/** Color pairs fit in 8 bits of an attribute */
+#define HL_ANSI_PAIRS_MAX 256
+#define HL_ANSI_PAIR_BUCKETS 256
+
+/** A color pair handed out for ansi colors, see hl_ansi_pair_lookup. */
+struct hl_ansi_pair
+{
+    short fg;
+    short bg;
+    /** Next pair in the hash bucket, 0 at the end */
+    short next;
+    /** Neighbours in the list of pairs, most recently used first */
+    short lru_prev;
+    short lru_next;
+};
+
+/**
+ * Color pairs for ansi colors other than the 8 standard ones. Pairs are
+ * found by their colors with a hash table, and when they have all been
+ * handed out the least recently used one is reused. Pair 0 is never
+ * handed out, so it marks the end of the lists.
+ */
+struct hl_ansi_pair_cache
+{
+    /** Pairs [first, limit) can be handed out */
+    int first;
+    int limit;
+    /** Number of pairs handed out so far */
+    int count;
+    short buckets[HL_ANSI_PAIR_BUCKETS];
+    short lru_head;
+    short lru_tail;
+    /** Indexed by color pair */
+    struct hl_ansi_pair pairs[HL_ANSI_PAIRS_MAX];
+};
+
 /** The main context used to represent all of the highlighting groups. */
 struct hl_groups
 {
@@ -60,6 +96,8 @@ struct hl_groups
     int ansi_color;
     /** This is the data for each highlighting group. */
     struct hl_group_info groups[HLG_LAST];
+    /** Color pairs for 256 color and 24-bit ansi colors. */
+    struct hl_ansi_pair_cache ansi_pairs;
 };
 
 static struct hl_group_info *lookup_group_info_by_key(struct hl_groups *groups,
@@ -360,6 +398,121 @@ static int hl_get_ansicolor_pair(hl_groups_ptr hl_groups, int bgcolor, int fgcol
     return color_pair_table[bgcolor][fgcolor];
 }
 
+/* Number of color pairs hl_get_ansicolor_pair uses, they start at 1 */
+#define HL_ANSI_STANDARD_PAIRS (8 * 8 + 8 + 8)
+
+static void hl_ansi_pairs_reset(struct hl_ansi_pair_cache *cache, int first, int limit)
+{
+    cache->first = first;
+    cache->limit = MAX(first, MIN(limit, HL_ANSI_PAIRS_MAX));
+    cache->count = 0;
+    cache->lru_head = 0;
+    cache->lru_tail = 0;
+    memset(cache->buckets, 0, sizeof(cache->buckets));
+}
+
+static int hl_ansi_pair_hash(int fg, int bg)
+{
+    return ((fg + 1) * 97 + (bg + 1) * 13) & (HL_ANSI_PAIR_BUCKETS - 1);
+}
+
+static void hl_ansi_pair_lru_unlink(struct hl_ansi_pair_cache *cache, int pair)
+{
+    struct hl_ansi_pair *p = &cache->pairs[pair];
+
+    if (p->lru_prev)
+        cache->pairs[p->lru_prev].lru_next = p->lru_next;
+    else
+        cache->lru_head = p->lru_next;
+
+    if (p->lru_next)
+        cache->pairs[p->lru_next].lru_prev = p->lru_prev;
+    else
+        cache->lru_tail = p->lru_prev;
+}
+
+static void hl_ansi_pair_lru_push(struct hl_ansi_pair_cache *cache, int pair)
+{
+    struct hl_ansi_pair *p = &cache->pairs[pair];
+
+    p->lru_prev = 0;
+    p->lru_next = cache->lru_head;
+
+    if (cache->lru_head)
+        cache->pairs[cache->lru_head].lru_prev = pair;
+    else
+        cache->lru_tail = pair;
+
+    cache->lru_head = pair;
+}
+
+/* Take the least recently used pair out of the cache */
+static void hl_ansi_pair_evict(struct hl_ansi_pair_cache *cache)
+{
+    int pair = cache->lru_tail;
+    struct hl_ansi_pair *p = &cache->pairs[pair];
+    short *link = &cache->buckets[hl_ansi_pair_hash(p->fg, p->bg)];
+
+    while (*link != pair)
+        link = &cache->pairs[*link].next;
+    *link = p->next;
+
+    hl_ansi_pair_lru_unlink(cache, pair);
+}
+
+/**
+ * Get the color pair for an xterm foreground and background color, setting
+ * one up if needed. When every pair is in use, the least recently used one
+ * is set to the new colors, and text already drawn with it changes color
+ * the next time it's drawn.
+ *
+ * \return
+ * The color pair, or -1 if the terminal has no pairs to spare.
+ */
+static int hl_ansi_pair_lookup(struct hl_ansi_pair_cache *cache, int fg, int bg)
+{
+    int hash = hl_ansi_pair_hash(fg, bg);
+    int pair;
+
+    for (pair = cache->buckets[hash]; pair; pair = cache->pairs[pair].next)
+    {
+        if (cache->pairs[pair].fg == fg && cache->pairs[pair].bg == bg)
+        {
+            if (cache->lru_head != pair)
+            {
+                hl_ansi_pair_lru_unlink(cache, pair);
+                hl_ansi_pair_lru_push(cache, pair);
+            }
+            return pair;
+        }
+    }
+
+    /* Use a pair that hasn't been handed out yet, or else the least
+     * recently used one */
+    if (cache->first + cache->count < cache->limit)
+        pair = cache->first + cache->count;
+    else if (cache->lru_tail)
+        pair = cache->lru_tail;
+    else
+        return -1;
+
+    if (swin_init_pair(pair, fg, bg) != 0)
+        return -1;
+
+    if (pair == cache->first + cache->count)
+        cache->count++;
+    else
+        hl_ansi_pair_evict(cache);
+
+    cache->pairs[pair].fg = fg;
+    cache->pairs[pair].bg = bg;
+    cache->pairs[pair].next = cache->buckets[hash];
+    cache->buckets[hash] = pair;
+    hl_ansi_pair_lru_push(cache, pair);
+
+    return pair;
+}
+
 /**
  * Set up a highlighting group to be displayed as the user wishes.
  *
@@ -469,6 +622,7 @@ hl_groups_ptr hl_groups_initialize(void)
     hl_groups->in_color = 0;
     hl_groups->ansi_esc_parsing = 0;
     hl_groups->ansi_color = 0;
+    hl_ansi_pairs_reset(&hl_groups->ansi_pairs, 1 + HL_ANSI_STANDARD_PAIRS, 0);
 
     for (i = 0; i < HLG_LAST; ++i)
     {
@@ -521,6 +675,10 @@ int hl_groups_setup(hl_groups_ptr hl_groups)
         hl_groups->in_color &&
         (swin_colors() >= 8) && (swin_color_pairs() >= 64);
 
+    /* Pairs after the standard ansi ones are handed out as they're needed */
+    hl_ansi_pairs_reset(&hl_groups->ansi_pairs, 1 + HL_ANSI_STANDARD_PAIRS,
+        hl_groups->ansi_color ? swin_color_pairs() : 0);
+
     /* Set up the default groups. */
     for (i = 0; ginfo[i].kind != HLG_LAST; ++i)
     {
@@ -900,54 +1058,173 @@ static int ansi_get_closest_color_value(int r, int g, int b)
 
    0x00-0x07: standard colors (as in ESC [ 30;37 m)
    0x08-0x0F: high intensity colors (as in ESC [ 90;97 m)
-   0x10-0xE7: 6 * 6 * 6 = 216 colors: 16 + 36 * r + 6 * g + b (0 ? r, g, b ? 5)
+   0x10-0xE7: 6 * 6 * 6 = 216 colors: 16 + 36 * r + 6 * g + b (0 <= r, g, b <= 5)
    0xE8-0xFF: grayscale from black to white in 24 steps
 
    Set the foreground color to index N: \033[38;5;${N}m
    Set the background color to index M: \033[48;5;${M}m
+   Set 24-bit colors: \033[38;2;${R};${G};${B}m and \033[48;2;${R};${G};${B}m
 */
-static int ansi_get_color_code_index(const char *buf, int *index)
+static const int ansi_cube_levels[6] = { 0, 95, 135, 175, 215, 255 };
+
+/* Given a 256-color index from 16 to 255, get its rgb value */
+static void ansi_get_color_rgb(int color, int *r, int *g, int *b)
+{
+    if (color >= 232)
+    {
+        *r = *g = *b = 8 + (color - 232) * 10;
+    }
+    else
+    {
+        color -= 16;
+        *r = ansi_cube_levels[color / 36];
+        *g = ansi_cube_levels[(color / 6) % 6];
+        *b = ansi_cube_levels[color % 6];
+    }
+}
+
+/* Index of the cube level closest to a 0 - 255 value */
+static int ansi_get_cube_index(int v)
+{
+    return (v < 48) ? 0 : (v < 115) ? 1 : (v - 35) / 40;
+}
+
+/* Given 24-bit rgb value, calculate closest color in the 256-color table */
+static int ansi_get_rgb_color(int r, int g, int b)
+{
+    int ri = ansi_get_cube_index(r);
+    int gi = ansi_get_cube_index(g);
+    int bi = ansi_get_cube_index(b);
+    int cube = 16 + 36 * ri + 6 * gi + bi;
+    int average = (r + g + b) / 3;
+    int gray = 232 + MIN(MAX(average - 3, 0) / 10, 23);
+    int cr, cg, cb, gr, gg, gb;
+
+    ansi_get_color_rgb(cube, &cr, &cg, &cb);
+    ansi_get_color_rgb(gray, &gr, &gg, &gb);
+
+    if ((gr - r) * (gr - r) + (gg - g) * (gg - g) + (gb - b) * (gb - b) <
+        (cr - r) * (cr - r) + (cg - g) * (cg - g) + (cb - b) * (cb - b))
+        return gray;
+
+    return cube;
+}
+
+/* Given a 256-color index, get the closest color a terminal with the given
+ * number of colors has. Bright colors are drawn bold on 8 color terminals. */
+static int ansi_fit_color(int color, int colors, int *attr)
 {
-    int i = 0;
+    if (color < 0)
+        return color;
 
-    if (buf[i] == ';' && buf[i + 1] == '5' && buf[i + 2] == ';')
+    if (color >= 16 && colors < 256)
     {
-        int num = 0;
+        int r, g, b;
 
-        i += 3;
-        while (isdigit(buf[i]))
-        {
-            num = num * 10 + buf[i] - '0';
-            i++;
-        }
+        ansi_get_color_rgb(color, &r, &g, &b);
+        color = ansi_get_closest_color_value(r, g, b);
+    }
 
-        if (num >= 232)
-        {
-            /* Convert grayscale 232 - 255 value to 0 - 255 rgb value */
-            int gray = 255 * (MIN(num, 255) - 232) / (255 - 232);
-            num = ansi_get_closest_color_value(gray, gray, gray);
-        }
-        else if (num >= 16)
-        {
-            /* Convert 0-6 component values to 0 - 255 rgb values */
-            int red = ((num - 16) / 36);
-            int green = (((num - 16) - red * 36) / 6);
-            int blue = ((num - 16) % 6);
-            num = ansi_get_closest_color_value(red * 255 / 6, green * 255 / 6, blue * 255 / 6);
-        }
+    if (color >= 8 && colors < 16)
+    {
+        *attr |= SWIN_A_BOLD;
+        color &= 7;
+    }
+
+    return color;
+}
 
-        *index = num;
-        return i;
+/* Given a 256-color foreground and background (-1 for the default), get the
+ * attribute to draw them with */
+static int hl_get_ansi_color_attr(hl_groups_ptr hl_groups, int fg, int bg)
+{
+    int attr = 0;
+    int colors = hl_groups->ansi_color ? swin_colors() : 8;
+    int pair;
+
+    fg = ansi_fit_color(fg, colors, &attr);
+    bg = ansi_fit_color(bg, colors, &attr);
+
+    /* The standard colors always have a pair */
+    if (fg < 8 && bg < 8)
+        return attr | swin_color_pair(hl_get_ansicolor_pair(hl_groups, bg, fg));
+
+    pair = hl_ansi_pair_lookup(&hl_groups->ansi_pairs, fg, bg);
+    if (pair >= 0)
+        return attr | swin_color_pair(pair);
+
+    /* Out of pairs, use the closest standard colors */
+    fg = ansi_fit_color(fg, 8, &attr);
+    bg = ansi_fit_color(bg, 8, &attr);
+    return attr | swin_color_pair(hl_get_ansicolor_pair(hl_groups, bg, fg));
+}
+
+/* What an SGR parameter does */
+enum hl_sgr_action
+{
+    SGR_RESET,       /* Reset attributes and colors */
+    SGR_ATTR_ON,     /* Turn the attribute on */
+    SGR_ATTR_OFF,    /* Turn the attribute off */
+    SGR_FG,          /* Set the foreground to the color plus the code's offset */
+    SGR_BG,          /* Set the background to the color plus the code's offset */
+    SGR_FG_EXTENDED, /* 38;5;n or 38;2;r;g;b */
+    SGR_BG_EXTENDED, /* 48;5;n or 48;2;r;g;b */
+    SGR_FG_DEFAULT,
+    SGR_BG_DEFAULT,
+};
+
+struct hl_sgr_code
+{
+    int first, last;
+    enum hl_sgr_action action;
+    int value; /* Attribute, or color of the first code */
+};
+
+/* Find what an SGR parameter does, NULL if it's ignored
+ * https://conemu.github.io/en/AnsiEscapeCodes.html#SGR_Select_Graphic_Rendition_parameters */
+static const struct hl_sgr_code *hl_sgr_find_code(int num)
+{
+    static const struct hl_sgr_code codes[] = {
+        { 0, 0, SGR_RESET, 0 },
+        { 1, 1, SGR_ATTR_ON, SWIN_A_BOLD },        /* BrightOrBold */
+        { 2, 2, SGR_ATTR_OFF, SWIN_A_BOLD },
+        { 3, 3, SGR_ATTR_ON, SWIN_A_REVERSE },     /* ItalicOrInverse */
+        { 4, 5, SGR_ATTR_ON, SWIN_A_UNDERLINE },   /* BackOrUnderline */
+        { 7, 7, SGR_ATTR_ON, SWIN_A_REVERSE },     /* Inverse colors */
+        { 22, 22, SGR_ATTR_OFF, SWIN_A_BOLD },
+        { 23, 23, SGR_ATTR_OFF, SWIN_A_REVERSE },
+        { 24, 24, SGR_ATTR_OFF, SWIN_A_UNDERLINE },
+        { 27, 27, SGR_ATTR_OFF, SWIN_A_REVERSE },  /* Normal colors */
+        { 30, 37, SGR_FG, 0 },
+        { 38, 38, SGR_FG_EXTENDED, 0 },
+        { 39, 39, SGR_FG_DEFAULT, 0 },
+        { 40, 47, SGR_BG, 0 },
+        { 48, 48, SGR_BG_EXTENDED, 0 },
+        { 49, 49, SGR_BG_DEFAULT, 0 },
+        { 90, 97, SGR_FG, 8 },                     /* Bright text color */
+        { 100, 107, SGR_BG, 8 },                   /* Bright background color */
+    };
+    int i;
+
+    for (i = 0; i < sizeof(codes) / sizeof(codes[0]); i++)
+    {
+        if (num >= codes[i].first && num <= codes[i].last)
+            return &codes[i];
     }
 
-    *index = -1;
-    return 0;
+    return NULL;
 }
 
+/* Most parameters an SGR sequence is parsed for, the rest are ignored */
+#define HL_SGR_PARAMS_MAX 32
+
 /* Parse ansi color escape sequence in buf, return ncurses attribute and esc length */
 int hl_ansi_get_color_attrs(hl_groups_ptr hl_groups, const char *buf, int *attr, int force_esc_parsing)
 {
-    int i = 0;
+    int params[HL_SGR_PARAMS_MAX];
+    int count = 0;
+    int i = 2;
+    int p;
     int fg = -1;
     int bg = -1;
     int a = SWIN_A_NORMAL;
@@ -959,156 +1236,96 @@ int hl_ansi_get_color_attrs(hl_groups_ptr hl_groups, const char *buf, int *attr,
     if (!hl_groups->ansi_esc_parsing && !force_esc_parsing)
         return 0;
 
-    if ((buf[i++] == '\033') && (buf[i++] == '['))
+    if (buf[0] != '\033' || buf[1] != '[')
+        return 0;
+
+    /* Read the number;number;...m parameters, a missing number is 0 */
+    for (;;)
     {
+        int num = 0;
+
+        while (isdigit(buf[i]))
+        {
+            num = MIN(num * 10 + buf[i] - '0', 65535);
+            i++;
+        }
+
+        if (count < HL_SGR_PARAMS_MAX)
+            params[count++] = num;
 
-        /* Check for reset attributes. Ie: \033[m or \033[0m */
         if (buf[i] == 'm')
-            return 3;
-        else if (buf[i] == '0' && buf[i + 1] == 'm')
-            return 4;
+            break;
 
-        /* Parse number;number;number;m sequences */
-        for (;;)
-        {
-            int num = 0;
+        if (buf[i] != ';')
+            return 0;
+        i++;
+    }
+
+    for (p = 0; p < count; p++)
+    {
+        const struct hl_sgr_code *code = hl_sgr_find_code(params[p]);
+        int color = -1;
 
-            /* Should have a number here */
-            if (!isdigit(buf[i]))
-                return 0;
+        if (!code)
+            continue;
 
-            while (isdigit(buf[i]))
+        switch (code->action)
+        {
+        case SGR_RESET:
+            a = SWIN_A_NORMAL;
+            fg = -1;
+            bg = -1;
+            break;
+        case SGR_ATTR_ON:
+            a |= code->value;
+            break;
+        case SGR_ATTR_OFF:
+            a &= ~code->value;
+            break;
+        case SGR_FG:
+            fg = code->value + params[p] - code->first;
+            break;
+        case SGR_BG:
+            bg = code->value + params[p] - code->first;
+            break;
+        case SGR_FG_EXTENDED:
+        case SGR_BG_EXTENDED:
+            if (p + 2 < count && params[p + 1] == 5)
             {
-                num = num * 10 + buf[i] - '0';
-                i++;
+                color = MIN(params[p + 2], 255);
+                p += 2;
             }
-
-            /* https://conemu.github.io/en/AnsiEscapeCodes.html#SGR_Select_Graphic_Rendition_parameters */
-            switch (num)
+            else if (p + 4 < count && params[p + 1] == 2)
             {
-            case 0: /* Reset current attributes */
-                a = SWIN_A_NORMAL;
-                fg = -1;
-                bg = -1;
-                break;
-            case 1: /* Set BrightOrBold */
-                a |= SWIN_A_BOLD;
-                break;
-            case 2:  /* Unset BrightOrBold */
-            case 22: /* Unset BrightOrBold */
-                a &= ~SWIN_A_BOLD;
-                break;
-            case 4: /* SetBackOrUnderline */
-            case 5: /* SetBackOrUnderline */
-                a |= SWIN_A_UNDERLINE;
-                break;
-            case 3: /* SetItalicOrInverse */
-            case 7: /* Use inverse colors */
-                a |= SWIN_A_REVERSE;
-                break;
-            case 23: /*Unset ItalicOrInverse */
-                a &= ~SWIN_A_REVERSE;
-                break;
-            case 24: /* UnsetBackOrUnderline */
-                a &= ~SWIN_A_UNDERLINE;
-                break;
-            case 27: /* Use normal colors */
-            case 39: /* Reset text color to defaults */
-                fg = -1;
-                bg = -1;
-                break;
-            case 49: /* Reset background color to defaults */
-                bg = -1;
-                break;
-            case 38:
-                /* Foreground xterm color code index */
-                i += ansi_get_color_code_index(buf + i, &num);
-                if (num >= 0 && num < 16)
-                {
-                    fg = num & 7;
-                    a |= ((num & 0x8) ? SWIN_A_BOLD : 0);
-                }
-                else
-                {
-                    a |= SWIN_A_REVERSE | SWIN_A_BOLD;
-                }
-                break;
-            case 48:
-                /* Background xterm color code index */
-                i += ansi_get_color_code_index(buf + i, &num);
-                if (num >= 0 && num < 16)
-                {
-                    bg = num & 7;
-                    a |= ((num & 0x8) ? SWIN_A_BOLD : 0);
-                }
-                else
-                {
-                    a |= SWIN_A_REVERSE | SWIN_A_BOLD;
-                }
-                break;
-            /* Set ANSI text color */
-            case 30:
-            case 31:
-            case 32:
-            case 33:
-            case 34:
-            case 35:
-            case 36:
-            case 37:
-                fg = num - 30;
-                break;
-            /* Set ANSI background color */
-            case 40:
-            case 41:
-            case 42:
-            case 43:
-            case 44:
-            case 45:
-            case 46:
-            case 47:
-                bg = num - 40;
-                break;
-            /* Set bright ANSI text color */
-            case 90:
-            case 91:
-            case 92:
-            case 93:
-            case 94:
-            case 95:
-            case 96:
-            case 97:
-                fg = num - 90;
-                a |= SWIN_A_BOLD;
-                break;
-            /* Set bright ANSI background color */
-            case 100:
-            case 101:
-            case 102:
-            case 103:
-            case 104:
-            case 105:
-            case 106:
-            case 107:
-                bg = num - 100;
-                a |= SWIN_A_BOLD;
-                break;
+                color = ansi_get_rgb_color(MIN(params[p + 2], 255),
+                    MIN(params[p + 3], 255), MIN(params[p + 4], 255));
+                p += 4;
             }
-
-            if (buf[i] == 'm')
+            else
             {
-                int color_pair = hl_get_ansicolor_pair(hl_groups, bg, fg);
-
-                *attr = a | swin_color_pair(color_pair);
-                return i + 1;
+                /* Can't tell where the color ends, ignore the rest */
+                p = count;
             }
 
-            if (buf[i] != ';')
-                return 0;
-            i++;
+            if (code->action == SGR_FG_EXTENDED)
+                fg = color;
+            else
+                bg = color;
+            break;
+        case SGR_FG_DEFAULT:
+            fg = -1;
+            break;
+        case SGR_BG_DEFAULT:
+            bg = -1;
+            break;
         }
     }
 
-    return 0;
+    if (a == SWIN_A_NORMAL && fg == -1 && bg == -1)
+        return i + 1;
+
+    *attr = a | hl_get_ansi_color_attr(hl_groups, fg, bg);
+    return i + 1;
 }
 
 static void hl_printspan(SWINDOW *win, const char *line, int line_len, int attr)
@@ -1118,80 +1335,40 @@ static void hl_printspan(SWINDOW *win, const char *line, int line_len, int attr)
     swin_wattroff(win, attr);
 }
 
-void hl_printline(SWINDOW *win, const char *line, int line_len,
-    const hl_line_attr *attrs, int x, int y, int col, int width)
+/* Index of the last attribute starting at or before col, -1 if none.
+ * Attributes are sorted by column. */
+static int hl_find_attr(const hl_line_attr *attrs, int col)
 {
-    int count;
-    int attr = 0;
-    int use_current_pos = (x == -1) && (y == -1);
+    int lo = 0;
+    int hi = sbcount(attrs);
 
-    if (!use_current_pos)
+    while (lo < hi)
     {
-        if (y < 0)
-            return;
-        else if (x < 0)
-        {
-            col -= x;
-            x = 0;
-        }
-
-        swin_wmove(win, y, x);
-    }
-
-    count = MIN(line_len - col, width);
-    if (count <= 0)
-    {
-        swin_wclrtoeol(win);
-        return;
-    }
-
-    if (attrs)
-    {
-        int i;
-
-        for (i = 0; i < sbcount(attrs); i++)
-        {
-            if (attrs[i].col <= col)
-            {
-                attr = attrs[i].attr;
-            }
-            else if (attrs[i].col < col + count)
-            {
-                int len = attrs[i].col - col;
+        int mid = (lo + hi) / 2;
 
-                hl_printspan(win, line + col, len, attr);
-
-                col += len;
-                count -= len;
-                width -= len;
-
-                attr = attrs[i].attr;
-            }
-            else
-            {
-                hl_printspan(win, line + col, count, attr);
-
-                width -= count;
-                count = 0;
-            }
-        }
-    }
-
-    if (count)
-    {
-        hl_printspan(win, line + col, count, attr);
-        width -= count;
+        if (attrs[mid].col <= col)
+            lo = mid + 1;
+        else
+            hi = mid;
     }
 
-    if (width)
-        swin_wclrtoeol(win);
+    return lo - 1;
 }
 
-void hl_printline_highlight(SWINDOW *win, const char *line, int line_len,
+void hl_printline(SWINDOW *win, const char *line, int line_len,
     const hl_line_attr *attrs, int x, int y, int col, int width)
 {
-    int count;
-    int attr = 0;
+    hl_printline_overlay(win, line, line_len, attrs, NULL, x, y, col, width);
+}
+
+void hl_printline_overlay(SWINDOW *win, const char *line, int line_len,
+    const hl_line_attr *attrs, const hl_line_attr *overlay,
+    int x, int y, int col, int width)
+{
+    int i, j, end;
+    int attr_count = sbcount(attrs);
+    int overlay_count = sbcount(overlay);
+    int attr, overlay_attr;
     int use_current_pos = (x == -1) && (y == -1);
 
     if (!use_current_pos)
@@ -1207,50 +1384,53 @@ void hl_printline_highlight(SWINDOW *win, const char *line, int line_len,
         swin_wmove(win, y, x);
     }
 
-    count = MIN(line_len - col, width);
-    if (count <= 0)
+    end = col + MIN(line_len - col, width);
+    if (end <= col)
+    {
+        swin_wclrtoeol(win);
         return;
+    }
 
-    if (attrs)
+    /* Find the attributes in effect at the first column shown */
+    i = hl_find_attr(attrs, col);
+    j = hl_find_attr(overlay, col);
+    attr = (i >= 0) ? attrs[i].attr : 0;
+    overlay_attr = (j >= 0) ? overlay[j].attr : 0;
+    i++;
+    j++;
+
+    /* Print runs of text drawn with the same attribute, the overlay's
+     * attribute is used where it's set */
+    while (col < end)
     {
-        int i;
+        int run_attr = overlay_attr ? overlay_attr : attr;
+        int next;
 
-        for (i = 0; i < sbcount(attrs); i++)
+        do
         {
-            if (attrs[i].col <= col)
-            {
-                attr = attrs[i].attr;
-            }
-            else if (attrs[i].col < col + count)
-            {
-                int len = attrs[i].col - col;
-
-                if (attr)
-                    hl_printspan(win, line + col, len, attr);
-                else
-                    swin_wmove(win, y, swin_getcurx(win) + len);
-
-                col += len;
-                count -= len;
-                width -= len;
-
-                attr = attrs[i].attr;
-            }
-            else
-            {
-                if (attr)
-                    hl_printspan(win, line + col, count, attr);
-                else
-                    swin_wmove(win, y, swin_getcurx(win) + count);
-
-                width -= count;
-                count = 0;
-            }
+            next = end;
+            if (i < attr_count)
+                next = MIN(next, attrs[i].col);
+            if (j < overlay_count)
+                next = MIN(next, overlay[j].col);
+            next = MAX(next, col);
+
+            while (i < attr_count && attrs[i].col <= next)
+                attr = attrs[i++].attr;
+            while (j < overlay_count && overlay[j].col <= next)
+                overlay_attr = overlay[j++].attr;
+        } while (next < end && (overlay_attr ? overlay_attr : attr) == run_attr);
+
+        if (next > col)
+        {
+            hl_printspan(win, line + col, next - col, run_attr);
+            width -= next - col;
+            col = next;
         }
     }
 
-    if (count && attr)
-        hl_printspan(win, line + col, count, attr);
+    if (width)
+        swin_wclrtoeol(win);
 }
 /*@}*/
 /* }}}*/
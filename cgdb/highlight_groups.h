@@ -201,6 +201,7 @@ enum hl_group_kind hl_get_color_group(hl_groups_ptr hl_groups, const char *color
 
 /**
  * Given a set of attributes and the column they start at, print the line.
+ * Attributes are stretchy buffers sorted by column.
  */
 struct hl_line_attr
 {
@@ -209,8 +210,15 @@ struct hl_line_attr
 };
 void hl_printline(SWINDOW *win, const char *line, int line_len,
     const hl_line_attr *attrs, int x, int y, int col, int width);
-void hl_printline_highlight(SWINDOW *win, const char *line, int line_len,
-    const hl_line_attr *attrs, int x, int y, int col, int width);
+
+/**
+ * Print a line like hl_printline, with a second set of attributes, such as
+ * search matches, drawn in place of the line's attributes where they're
+ * non-zero. Each run of text with the same attribute is printed once.
+ */
+void hl_printline_overlay(SWINDOW *win, const char *line, int line_len,
+    const hl_line_attr *attrs, const hl_line_attr *overlay,
+    int x, int y, int col, int width);
 
 /*@}*/
 /* }}}*/
@@ -50,6 +50,10 @@
 #include <ctype.h>
 #endif
 
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+
 #include <assert.h>
 
 /* Local Includes */
@@ -119,6 +123,11 @@ static SWINDOW *tty_scroller_win = NULL;
 static struct scroller *tty_scroller = NULL; /* The tty input/output window */
 static int tty_win_on = 0;                   /* Flag: tty window being shown */
 
+/* Output added to the scrollers but not drawn yet, see outputdelay */
+static int gdb_output_pending = 0;
+static int tty_output_pending = 0;
+static struct timeval output_drawn; /* When scroller output was last drawn */
+
 static SWINDOW *src_viewer_win = NULL;
 static struct sviewer *src_viewer = NULL;  /* The source viewer window */
 
@@ -584,6 +593,10 @@ void if_draw(void)
     if (get_gdb_height() > 0)
         scr_refresh(gdb_scroller, gdb_scroller_win, focus == GDB, WIN_NO_REFRESH);
 
+    gdb_output_pending = 0;
+    tty_output_pending = 0;
+    gettimeofday(&output_drawn, NULL);
+
     /* This check is here so that the cursor goes to the 
      * cgdb window. The cursor would stay in the gdb window 
      * on cygwin */
@@ -1121,6 +1134,15 @@ static int gdb_input(int key, int *last_key)
         case CGDB_KEY_END:
             scr_end(gdb_scroller);
             break;
+        case '%':
+            /* Hitting N% goes N percent of the way through the buffer. */
+            if (G_line_number >= 0)
+                scr_goto_percent(gdb_scroller, G_line_number);
+            break;
+        case '0': case '1': case '2': case '3': case '4':
+        case '5': case '6': case '7': case '8': case '9':
+            /* Digits are a count for the next command */
+            break;
 
         /* k, up, or ctrl+p moves up one line. */
         case 'k':
@@ -1166,6 +1188,12 @@ static int gdb_input(int key, int *last_key)
             key_handled = 0;
             break;
         }
+
+        /* Store digits into G_line_number for the '%' command. */
+        if ((key >= '0' && key <= '9') && (G_line_number < INT_MAX / 10 - 9))
+            G_line_number = MAX(0, G_line_number) * 10 + key - '0';
+        else
+            G_line_number = -1;
     }
 
     if (key_handled)
@@ -1793,13 +1821,8 @@ void if_tty_print(const char *buf)
     /* Only need to redraw if tty_scroller is being displayed */
     if (tty_win_on && get_gdb_height() > 0)
     {
-        scr_refresh(tty_scroller, tty_scroller_win, focus == TTY, WIN_NO_REFRESH);
-
-        /* Make sure cursor reappears in source window if focus is there */
-        if (focus == CGDB)
-            swin_wnoutrefresh(src_viewer_win);
-
-        swin_doupdate();
+        tty_output_pending = 1;
+        if_flush_output(0);
     }
 }
 
@@ -1816,14 +1839,60 @@ void if_print(const char *buf, int source)
 
     if (get_gdb_height() > 0)
     {
+        gdb_output_pending = 1;
+        if_flush_output(0);
+    }
+}
+
+/* Milliseconds since scroller output was last drawn */
+static long output_drawn_msecs(void)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+
+    return (now.tv_sec - output_drawn.tv_sec) * 1000 +
+        (now.tv_usec - output_drawn.tv_usec) / 1000;
+}
+
+int if_output_delay(void)
+{
+    long elapsed;
+
+    if (!gdb_output_pending && !tty_output_pending)
+        return -1;
+
+    /* Draw right away if the clock went backwards */
+    elapsed = output_drawn_msecs();
+    if (elapsed < 0)
+        return 0;
+
+    return MAX(cgdbrc_get_int(CGDBRC_OUTPUTDELAY) - elapsed, 0);
+}
+
+void if_flush_output(int force)
+{
+    if (!force && if_output_delay() != 0)
+        return;
+
+    if (!gdb_output_pending && !tty_output_pending)
+        return;
+
+    if (tty_output_pending && tty_win_on && get_gdb_height() > 0)
+        scr_refresh(tty_scroller, tty_scroller_win, focus == TTY, WIN_NO_REFRESH);
+
+    if (gdb_output_pending && get_gdb_height() > 0)
         scr_refresh(gdb_scroller, gdb_scroller_win, focus == GDB, WIN_NO_REFRESH);
 
-        /* Make sure cursor reappears in source window if focus is there */
-        if (focus == CGDB)
-            swin_wnoutrefresh(src_viewer_win);
+    /* Make sure cursor reappears in source window if focus is there */
+    if (focus == CGDB)
+        swin_wnoutrefresh(src_viewer_win);
 
-        swin_doupdate();
-    }
+    swin_doupdate();
+
+    gdb_output_pending = 0;
+    tty_output_pending = 0;
+    gettimeofday(&output_drawn, NULL);
 }
 
 void if_print_message(const char *fmt, ...)
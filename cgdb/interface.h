@@ -69,6 +69,21 @@ void if_print_message(const char *fmt, ...) ATTRIBUTE_PRINTF(1, 2);
  */
 void if_tty_print(const char *buf);
 
+/* if_output_delay: How long until output added to the GDB and tty windows
+ * ---------------- should be drawn. Output is drawn at most once every
+ *                  outputdelay milliseconds.
+ *
+ * Return Value: Milliseconds to wait, 0 if it's due, -1 if there's none.
+ */
+int if_output_delay(void);
+
+/* if_flush_output: Draw output added to the GDB and tty windows.
+ * ----------------
+ *
+ *   force:  Draw it even if it isn't due yet
+ */
+void if_flush_output(int force);
+
 /* if_show_file: Displays the requested file in the source display window.
  * -------------
  *
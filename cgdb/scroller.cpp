@@ -24,6 +24,18 @@
 #include <string.h>
 #endif /* HAVE_STRING_H */
 
+#if HAVE_STDIO_H
+#include <stdio.h>
+#endif /* HAVE_STDIO_H */
+
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif /* HAVE_UNISTD_H */
+
+#if HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif /* HAVE_SYS_MMAN_H */
+
 /* Local Includes */
 #include "sys_util.h"
 #include "sys_win.h"
@@ -32,6 +44,14 @@
 #include "highlight_groups.h"
 #include "scroller.h"
 #include "highlight.h"
+#include "fs_util.h"
+
+/* ----------- */
+/* Definitions */
+/* ----------- */
+
+/* Size of the chunks completed lines are stored in */
+#define SCROLLER_CHUNK_SIZE (64 * 1024)
 
 /* --------------- */
 /* Local Functions */
@@ -58,30 +78,300 @@ static int count(const char *s, int slen, char c)
     return rv;
 }
 
+/* Get a line that's in memory, 0 is the oldest one */
+static struct scroller_line *scroller_ring_line(struct scroller *scr, int index)
+{
+    return &scr->lines[(scr->lines_first + index) & (scr->lines_alloc - 1)];
+}
+
+/* Unmap a window onto the spill file */
+static void scroller_unmap_window(struct scroller_window *window)
+{
+    if (window->map)
+    {
+#if HAVE_SYS_MMAN_H
+        munmap(window->map, window->map_size);
+#else
+        free(window->map);
+#endif
+    }
+
+    window->map = NULL;
+}
+
+/**
+ * Map a spilled chunk into one of the windows, replacing the least
+ * recently used window.
+ *
+ * \return
+ * The window, or NULL on error.
+ */
+static struct scroller_window *scroller_map_chunk(struct scroller *scr,
+    const struct scroller_cold_chunk *cold)
+{
+    int i;
+    long start, end;
+    long page = sysconf(_SC_PAGESIZE);
+    struct scroller_window *window = &scr->windows[0];
+
+    for (i = 0; i < SCROLLER_WINDOW_COUNT; i++)
+    {
+        if (scr->windows[i].map && scr->windows[i].file_offset == cold->file_offset)
+        {
+            window = &scr->windows[i];
+            window->used = ++scr->window_clock;
+            return window;
+        }
+
+        if (scr->windows[i].used < window->used)
+            window = &scr->windows[i];
+    }
+
+    scroller_unmap_window(window);
+
+    /* Mappings have to start on a page */
+    start = cold->file_offset & ~(page - 1);
+    end = cold->file_offset + cold->size +
+        cold->lines * sizeof(struct scroller_cold_line);
+
+#if HAVE_SYS_MMAN_H
+    window->map = mmap(NULL, end - start, PROT_READ, MAP_SHARED, scr->spill_fd, start);
+    if (window->map == MAP_FAILED)
+        window->map = NULL;
+#else
+    window->map = malloc(end - start);
+    if (window->map && pread(scr->spill_fd, window->map, end - start, start) != end - start)
+    {
+        free(window->map);
+        window->map = NULL;
+    }
+#endif
+
+    if (!window->map)
+        return NULL;
+
+    window->map_size = end - start;
+    window->file_offset = cold->file_offset;
+    window->data = (const char *)window->map + (cold->file_offset - start);
+    window->index = (const struct scroller_cold_line *)(window->data + cold->size);
+    window->used = ++scr->window_clock;
+
+    return window;
+}
+
+/* Get a line that was spilled to disk. The line is good until the next
+ * spilled line is looked up. */
+static struct scroller_line *scroller_get_cold_line(struct scroller *scr, int row)
+{
+    long line = scr->first_line + row;
+    int low = scr->cold_first;
+    int high = sbcount(scr->cold) - 1;
+    struct scroller_line *sl = &scr->cold_line;
+    struct scroller_cold_chunk *cold;
+    struct scroller_window *window;
+
+    /* Find the last chunk starting at or before the line */
+    while (low < high)
+    {
+        int mid = (low + high + 1) / 2;
+
+        if (scr->cold[mid].first_line <= line)
+            low = mid;
+        else
+            high = mid - 1;
+    }
+
+    cold = &scr->cold[low];
+    window = scroller_map_chunk(scr, cold);
+
+    if (window)
+    {
+        const struct scroller_cold_line *cl = &window->index[line - cold->first_line];
+
+        sl->line = window->data + cl->offset;
+        sl->line_len = cl->line_len;
+        sl->tty = cl->tty;
+        sl->attr_count = cl->attr_count;
+        sl->attrs = cl->attr_count ? (const struct hl_line_attr *)(window->data +
+            cl->offset + ((cl->line_len + 1 + 7) & ~7)) : NULL;
+    }
+    else
+    {
+        /* Show the line as empty if the file can't be read */
+        sl->line = "";
+        sl->line_len = 0;
+        sl->tty = 0;
+        sl->attr_count = 0;
+        sl->attrs = NULL;
+    }
+
+    sl->chunk = -1;
+    return sl;
+}
+
+/* scroller_get_line: Get a line of the scroller.
+ * ------------------
+ *
+ *   row:  Row, 0 is the oldest line kept
+ */
+static struct scroller_line *scroller_get_line(struct scroller *scr, int row)
+{
+    if (row < scr->cold_count)
+        return scroller_get_cold_line(scr, row);
+
+    return scroller_ring_line(scr, row - scr->cold_count);
+}
+
+/* Display rows a line wraps to */
+static int scroller_line_rows(int line_len, int width)
+{
+    return line_len ? (line_len - 1) / width + 1 : 1;
+}
+
+/* Sum of the first k entries of the row tree */
+static long scroller_rows_sum(struct scroller *scr, long k)
+{
+    long sum = 0;
+
+    for (; k > 0; k &= k - 1)
+        sum += scr->rows[k];
+
+    return sum;
+}
+
+/* Add delta to entry k of the row tree */
+static void scroller_rows_add(struct scroller *scr, long k, long delta)
+{
+    long n = sbcount(scr->rows) - 1;
+
+    for (; k <= n; k += k & -k)
+        scr->rows[k] += delta;
+}
+
+/* Add an entry to the end of the row tree */
+static void scroller_rows_push(struct scroller *scr, int rows)
+{
+    long k = sbcount(scr->rows);
+
+    /* Entry k covers the k & -k entries ending at k */
+    sbpush(scr->rows, rows + scroller_rows_sum(scr, k - 1) -
+        scroller_rows_sum(scr, k - (k & -k)));
+}
+
+/* scroller_rows_build: Count the display rows of every line at the
+ * -------------------- current width.
+ */
+static void scroller_rows_build(struct scroller *scr)
+{
+    long k, n = scr->line_count;
+
+    sbsetcount(scr->rows, n + 1);
+    scr->rows[0] = 0;
+
+    for (k = 1; k <= n; k++)
+        scr->rows[k] = scroller_line_rows(scroller_get_line(scr, k - 1)->line_len, scr->width);
+
+    for (k = 1; k <= n; k++)
+    {
+        long parent = k + (k & -k);
+
+        if (parent <= n)
+            scr->rows[parent] += scr->rows[k];
+    }
+
+    scr->rows_base = scr->first_line;
+    scr->rows_width = scr->width;
+}
+
+/* Make sure the row tree matches the window width. Dropped lines stay in
+ * the tree until there are more of them than lines kept. */
+static void scroller_rows_check(struct scroller *scr)
+{
+    if (scr->rows_width != scr->width ||
+        scr->first_line - scr->rows_base > scr->line_count)
+        scroller_rows_build(scr);
+}
+
+/* Display rows above a line, the row tree must be checked */
+static long scroller_rows_before(struct scroller *scr, int row)
+{
+    long dropped = scr->first_line - scr->rows_base;
+
+    return scroller_rows_sum(scr, dropped + row) - scroller_rows_sum(scr, dropped);
+}
+
+/* Total display rows, the row tree must be checked */
+static long scroller_rows_total(struct scroller *scr)
+{
+    return scroller_rows_before(scr, scr->line_count);
+}
+
+/* scroller_rows_find: Find the line a display row is in.
+ * -------------------
+ *
+ *   drow:  Display row, 0 is the first row of the oldest line kept
+ *   r:     Set to the line
+ *   c:     Set to the column the display row starts at
+ *
+ * The row tree must be checked.
+ */
+static void scroller_rows_find(struct scroller *scr, long drow, int *r, int *c)
+{
+    long dropped = scr->first_line - scr->rows_base;
+    long n = sbcount(scr->rows) - 1;
+    long target = drow + scroller_rows_sum(scr, dropped);
+    long mask, k = 0;
+
+    for (mask = 1; mask * 2 <= n; mask *= 2)
+        ;
+
+    /* Find the most lines whose rows all come before the target */
+    for (; mask; mask /= 2)
+    {
+        if (k + mask <= n && scr->rows[k + mask] <= target)
+        {
+            k += mask;
+            target -= scr->rows[k];
+        }
+    }
+
+    *r = k - dropped;
+    *c = target * scr->width;
+}
+
 /* parse: Translates special characters in a string.  (i.e. backspace, tab...)
  * ------
  *
  *   buf:  The string to parse
  *
- * Return Value:  A newly allocated copy of buf, with modifications made.
+ * The string is applied to the last line at the cursor position.
  */
-static char *parse(struct scroller *scr, struct hl_line_attr **attrs,
-    const char *orig, const char *buf, int buflen)
+static void parse(struct scroller *scr, const char *buf, int buflen)
 {
     // Read in tabstop settings, but don't change them on the fly as we'd have to
     //  store each previous line and recalculate every one of them.
     static const int tab_size = cgdbrc_get_int(CGDBRC_TABSTOP);
+    struct hl_line_attr **attrs = &scr->last_attrs;
     int tabcount = count(buf, buflen, '\t');
-    int orig_len = strlen(orig);
+    int orig_len = sbcount(scr->last_line) - 1;
     int length = MAX(orig_len, scr->current.pos) + buflen + (tab_size - 1) * tabcount;
-    char *rv = (char *)cgdb_calloc(length + 1, 1);
-    int i, j;
+    char *rv;
+    int i, j, end;
 
-    /* Copy over original buffer */
-    strcpy(rv, orig);
+    /* Make room, anything past the original line reads as nil */
+    if (length + 1 > sbcount(scr->last_line))
+    {
+        sbsetcount(scr->last_line, length + 1);
+        memset(scr->last_line + orig_len, 0, length + 1 - orig_len);
+    }
 
+    rv = scr->last_line;
     i = scr->current.pos;
 
+    /* Track the end of the line as we go, the line can be megabytes long
+     * and arrive a few bytes at a time, so it mustn't be rescanned */
+    end = orig_len;
+
     /* Expand special characters */
     for (j = 0; j < buflen; j++)
     {
@@ -117,6 +407,7 @@ static char *parse(struct scroller *scr, struct hl_line_attr **attrs,
             {
                 rv[i++] = ' ';
             } while (i % tab_size != 0);
+            end = MAX(end, i);
             break;
         /* Carriage return -> Move back to the beginning of the line */
         case '\r':
@@ -133,6 +424,7 @@ static char *parse(struct scroller *scr, struct hl_line_attr **attrs,
             {
                 rv[i] = buf[j];
                 i++;
+                end = MAX(end, i);
             }
             break;
         }
@@ -140,48 +432,419 @@ static char *parse(struct scroller *scr, struct hl_line_attr **attrs,
 
     scr->current.pos = i;
 
-    if (*attrs)
+    /* Remove trailing space from the line if we don't have color */
+    if (!sbcount(*attrs))
     {
-        j = strlen(rv);
+        while (end > i + 1 && isspace(rv[end - 1]))
+            end--;
     }
-    else
+
+    rv[end] = 0;
+    sbsetcount(scr->last_line, end + 1);
+}
+
+/* Point the last line at the buffers it's being built in */
+static void scroller_sync_last(struct scroller *scr)
+{
+    struct scroller_line *sl = scroller_get_line(scr, scr->line_count - 1);
+
+    sl->line = scr->last_line;
+    sl->line_len = sbcount(scr->last_line) - 1;
+    sl->attrs = scr->last_attrs;
+    sl->attr_count = sbcount(scr->last_attrs);
+    sl->chunk = -1;
+
+    if (scr->rows_width)
     {
-        /* Remove trailing space from the line if we don't have color */
-        for (j = strlen(rv) - 1; j > i && isspace(rv[j]); j--)
-            ;
-        rv[j + 1] = 0;
-    }
+        long k = scr->first_line - scr->rows_base + scr->line_count;
+        int rows = scroller_line_rows(sl->line_len, scr->rows_width);
 
-    /* Only realloc if it's going to save us more than ~128 bytes */
-    return (length - j > 128) ? (char *)cgdb_realloc(rv, j + 2) : rv;
+        long old_rows = scroller_rows_sum(scr, k) - scroller_rows_sum(scr, k - 1);
+
+        scroller_rows_add(scr, k, rows - old_rows);
+    }
 }
 
 static void scroller_set_last_tty_attr(struct scroller *scr)
 {
-    int index = sbcount(scr->lines) - 1;
-    struct scroller_line *sl = index >= 0 ? &scr->lines[index] : 0;
+    struct scroller_line *sl = scroller_get_line(scr, scr->line_count - 1);
 
     /* If this is a tty line and we've got color attributes */
-    if (sl && sl->tty && sbcount(sl->attrs))
+    if (sl->tty && sbcount(scr->last_attrs))
     {
         /* Grab last attribute */
-        int attr = sl->attrs[sbcount(sl->attrs) - 1].attr;
+        int attr = sblast(scr->last_attrs).attr;
 
         /* Store last attribute for following tty lines */
         scr->last_tty_attr = attr ? attr : -1;
     }
 }
 
-static void scroller_addline(struct scroller *scr, char *line,
-    struct hl_line_attr *attrs, int tty)
+/* Bytes a completed line takes up in a chunk */
+static int scroller_line_size(const struct scroller_line *sl)
+{
+    return ((sl->line_len + 1 + 7) & ~7) +
+        sl->attr_count * sizeof(struct hl_line_attr);
+}
+
+/* Release a chunk, keeping one around so steady output doesn't allocate */
+static void scroller_release_chunk(struct scroller *scr, struct scroller_chunk *chunk)
+{
+    if (!scr->spare.data && chunk->alloc == SCROLLER_CHUNK_SIZE)
+        scr->spare = *chunk;
+    else
+        free(chunk->data);
+}
+
+/* Copy a completed line into the newest chunk */
+static void scroller_store_line(struct scroller *scr, struct scroller_line *sl)
+{
+    int size = scroller_line_size(sl);
+    int count = sbcount(scr->chunks);
+    struct scroller_chunk *chunk = (count > scr->chunks_first) ? &scr->chunks[count - 1] : NULL;
+    char *data;
+
+    if (!chunk || chunk->size + size > chunk->alloc)
+    {
+        struct scroller_chunk new_chunk;
+
+        if (scr->spare.data && size <= SCROLLER_CHUNK_SIZE)
+        {
+            new_chunk = scr->spare;
+            scr->spare.data = NULL;
+        }
+        else
+        {
+            new_chunk.alloc = MAX(SCROLLER_CHUNK_SIZE, size);
+            new_chunk.data = (char *)cgdb_malloc(new_chunk.alloc);
+        }
+
+        new_chunk.size = 0;
+        new_chunk.lines = 0;
+        sbpush(scr->chunks, new_chunk);
+        chunk = &sblast(scr->chunks);
+    }
+
+    data = chunk->data + chunk->size;
+    memcpy(data, sl->line, sl->line_len + 1);
+    sl->line = data;
+
+    if (sl->attr_count)
+    {
+        data += (sl->line_len + 1 + 7) & ~7;
+        memcpy(data, sl->attrs, sl->attr_count * sizeof(struct hl_line_attr));
+        sl->attrs = (const struct hl_line_attr *)data;
+    }
+    else
+        sl->attrs = NULL;
+
+    sl->chunk = scr->chunks_base + sbcount(scr->chunks) - 1;
+
+    chunk->size += size;
+    chunk->lines++;
+    scr->line_bytes += size + sizeof(struct scroller_line);
+}
+
+/* Release the oldest chunk */
+static void scroller_pop_chunk(struct scroller *scr)
+{
+    int count = sbcount(scr->chunks);
+
+    scroller_release_chunk(scr, &scr->chunks[scr->chunks_first]);
+    scr->chunks_first++;
+
+    /* Move the remaining chunks down once half of them are unused */
+    if (scr->chunks_first >= 32 && scr->chunks_first * 2 >= count)
+    {
+        memmove(scr->chunks, scr->chunks + scr->chunks_first,
+            (count - scr->chunks_first) * sizeof(struct scroller_chunk));
+        sbsetcount(scr->chunks, count - scr->chunks_first);
+        scr->chunks_base += scr->chunks_first;
+        scr->chunks_first = 0;
+    }
+}
+
+/* Drop the oldest spilled line. Once no spilled lines are left, the spill
+ * file is emptied. */
+static void scroller_drop_cold_line(struct scroller *scr)
+{
+    struct scroller_cold_chunk *cold = &scr->cold[scr->cold_first];
+    int i;
+
+    scr->first_line++;
+    scr->cold_count--;
+    scr->line_count--;
+
+    if (scr->first_line < cold->first_line + cold->lines)
+        return;
+
+    scr->cold_first++;
+
+    if (!scr->cold_count)
+    {
+        for (i = 0; i < SCROLLER_WINDOW_COUNT; i++)
+            scroller_unmap_window(&scr->windows[i]);
+
+        sbsetcount(scr->cold, 0);
+        scr->cold_first = 0;
+
+        if (ftruncate(scr->spill_fd, 0) == 0)
+            scr->spill_size = 0;
+    }
+}
+
+/* Drop the oldest line, freeing its chunk if it was the chunk's last line */
+static void scroller_drop_line(struct scroller *scr)
+{
+    struct scroller_line *sl;
+    struct scroller_chunk *chunk;
+
+    if (scr->cold_count)
+    {
+        scroller_drop_cold_line(scr);
+        return;
+    }
+
+    sl = scroller_ring_line(scr, 0);
+    chunk = &scr->chunks[sl->chunk - scr->chunks_base];
+
+    scr->line_bytes -= scroller_line_size(sl) + sizeof(struct scroller_line);
+
+    /* Lines are dropped in order, so this is the oldest chunk. The newest
+     * chunk is kept for the lines still to come. */
+    if (--chunk->lines == 0 && scr->chunks_first < sbcount(scr->chunks) - 1)
+        scroller_pop_chunk(scr);
+
+    scr->lines_first = (scr->lines_first + 1) & (scr->lines_alloc - 1);
+    scr->line_count--;
+    scr->first_line++;
+}
+
+/* Write all of a buffer at an offset in the spill file */
+static int scroller_spill_write(struct scroller *scr, const void *data, size_t size, long offset)
+{
+    const char *p = (const char *)data;
+
+    while (size > 0)
+    {
+        ssize_t written = pwrite(scr->spill_fd, p, size, offset);
+
+        if (written <= 0)
+            return -1;
+
+        p += written;
+        size -= written;
+        offset += written;
+    }
+
+    return 0;
+}
+
+/**
+ * Move the oldest chunk in memory to the end of the spill file, followed
+ * by an index of the lines in it. The lines keep their rows.
+ *
+ * \return
+ * 0 on success, -1 if there was nothing to spill or it couldn't be written.
+ */
+static int scroller_spill_chunk(struct scroller *scr)
+{
+    struct scroller_chunk *chunk = &scr->chunks[scr->chunks_first];
+    struct scroller_cold_line *index = NULL;
+    struct scroller_cold_chunk cold;
+    int i;
+
+    /* The newest chunk is still being filled */
+    if (scr->chunks_first >= sbcount(scr->chunks) - 1)
+        return -1;
+
+    if (scr->spill_fd == -1)
+    {
+        char path[FSUTIL_PATH_MAX];
+        const char *dir = getenv("TMPDIR");
+
+        snprintf(path, sizeof(path), "%s/cgdb-scrollback-XXXXXX",
+            (dir && dir[0]) ? dir : "/tmp");
+
+        /* The file is deleted as soon as it's created */
+        scr->spill_fd = mkstemp(path);
+        if (scr->spill_fd == -1)
+            return -1;
+
+        unlink(path);
+    }
+
+    for (i = 0; i < chunk->lines; i++)
+    {
+        struct scroller_line *sl = scroller_ring_line(scr, i);
+        struct scroller_cold_line cl;
+
+        cl.offset = sl->line - chunk->data;
+        cl.line_len = sl->line_len;
+        cl.tty = sl->tty;
+        cl.attr_count = sl->attr_count;
+        sbpush(index, cl);
+
+        scr->line_bytes -= scroller_line_size(sl) + sizeof(struct scroller_line);
+    }
+
+    /* Chunk sizes are a multiple of 8, so the index is aligned */
+    if (scroller_spill_write(scr, chunk->data, chunk->size, scr->spill_size) ||
+        scroller_spill_write(scr, index, chunk->lines * sizeof(struct scroller_cold_line),
+            scr->spill_size + chunk->size))
+    {
+        for (i = 0; i < chunk->lines; i++)
+        {
+            struct scroller_line *sl = scroller_ring_line(scr, i);
+
+            scr->line_bytes += scroller_line_size(sl) + sizeof(struct scroller_line);
+        }
+
+        sbfree(index);
+        return -1;
+    }
+
+    cold.file_offset = scr->spill_size;
+    cold.size = chunk->size;
+    cold.lines = chunk->lines;
+    cold.first_line = scr->first_line + scr->cold_count;
+    sbpush(scr->cold, cold);
+
+    scr->spill_size += chunk->size + chunk->lines * sizeof(struct scroller_cold_line);
+    scr->cold_count += chunk->lines;
+    scr->lines_first = (scr->lines_first + chunk->lines) & (scr->lines_alloc - 1);
+
+    scroller_pop_chunk(scr);
+    sbfree(index);
+
+    return 0;
+}
+
+/* Move a row back after rows were dropped, -1 if it was dropped */
+static void scroller_shift_mark(struct scroller_mark *mark, int dropped)
+{
+    if (mark->r < dropped)
+    {
+        mark->r = -1;
+        mark->c = -1;
+    }
+    else
+        mark->r -= dropped;
+}
+
+/* scroller_trim: Drop the oldest lines until the scroller is within the
+ * -------------- scrollbacklines and scrollbacksize options. Rows that
+ *                point at lines are moved to where their lines are now.
+ */
+static void scroller_trim(struct scroller *scr)
+{
+    int i;
+    int dropped = 0;
+    int max_lines = cgdbrc_get_int(CGDBRC_SCROLLBACKLINES);
+    long max_bytes = (long)cgdbrc_get_int(CGDBRC_SCROLLBACKSIZE) * 1024 * 1024;
+
+    /* Move lines to disk instead of dropping them for scrollbacksize */
+    if (cgdbrc_get_int(CGDBRC_SCROLLBACKDISK))
+    {
+        while (max_bytes && scr->line_bytes > max_bytes && !scroller_spill_chunk(scr))
+            ;
+    }
+
+    /* The last line is still being written, it's never dropped. Spilled
+     * lines don't count toward scrollbacksize, so only scrollbacklines
+     * drops them. Lines go oldest first, so the lines in memory stay over
+     * scrollbacksize until the spilled ones are gone. */
+    while (scr->line_count > 1 &&
+           ((max_lines && scr->line_count > max_lines) ||
+            (max_bytes && scr->line_bytes > max_bytes && !scr->cold_count)))
+    {
+        scroller_drop_line(scr);
+        dropped++;
+    }
+
+    if (!dropped)
+        return;
+
+    if (scr->current.r < dropped)
+    {
+        scr->current.r = 0;
+        scr->current.c = 0;
+    }
+    else
+        scr->current.r -= dropped;
+
+    scr->search_r = MAX(scr->search_r - dropped, 0);
+    scr->clear_row = MAX(scr->clear_row - dropped, -1);
+
+    for (i = 0; i < MARK_COUNT; i++)
+    {
+        scroller_shift_mark(&scr->local_marks[i], dropped);
+        scroller_shift_mark(&scr->global_marks[i], dropped);
+    }
+
+    scroller_shift_mark(&scr->jump_back_mark, dropped);
+}
+
+/* Add a line to the end of the ring, growing it if it's full */
+static struct scroller_line *scroller_push_line(struct scroller *scr)
 {
-    struct scroller_line sl;
+    int count = scr->line_count - scr->cold_count;
+
+    if (count == scr->lines_alloc)
+    {
+        int i;
+        int alloc = scr->lines_alloc ? scr->lines_alloc * 2 : 1024;
+        struct scroller_line *lines =
+            (struct scroller_line *)cgdb_malloc(alloc * sizeof(struct scroller_line));
+
+        for (i = 0; i < count; i++)
+            lines[i] = *scroller_ring_line(scr, i);
+
+        free(scr->lines);
+        scr->lines = lines;
+        scr->lines_alloc = alloc;
+        scr->lines_first = 0;
+    }
+
+    scr->line_count++;
+
+    if (scr->rows_width)
+        scroller_rows_push(scr, 1);
+
+    return scroller_ring_line(scr, count);
+}
+
+/* scroller_addline: Store the last line away and start a new one.
+ * -----------------
+ *
+ *   buf:  Text of the new line, parsed like scr_add text
+ *   tty:  If the text came from the tty
+ */
+static void scroller_addline(struct scroller *scr, const char *buf, int buflen, int tty)
+{
+    struct scroller_line *sl;
+
+    if (scr->line_count)
+        scroller_store_line(scr, scroller_get_line(scr, scr->line_count - 1));
+
+    sl = scroller_push_line(scr);
+    sl->tty = tty;
+
+    sbsetcount(scr->last_line, 1);
+    scr->last_line[0] = 0;
+    if (scr->last_attrs)
+        sbsetcount(scr->last_attrs, 0);
+
+    scr->current.pos = 0;
+    parse(scr, buf, buflen);
 
     /* Add attribute from last tty line to start of this one */
     if (tty && (scr->last_tty_attr != -1))
     {
+        struct hl_line_attr *attrs = scr->last_attrs;
+
         /* If there isn't already a color attribute for the first column */
-        if (!attrs || (attrs[0].col != 0))
+        if (!sbcount(attrs) || (attrs[0].col != 0))
         {
             int count = sbcount(attrs);
 
@@ -191,18 +854,28 @@ static void scroller_addline(struct scroller *scr, char *line,
 
             attrs[0].col = 0;
             attrs[0].attr = scr->last_tty_attr;
+            scr->last_attrs = attrs;
         }
 
         scr->last_tty_attr = -1;
     }
 
-    sl.line = line;
-    sl.line_len = strlen(line);
-    sl.tty = tty;
-    sl.attrs = attrs;
-    sbpush(scr->lines, sl);
-
+    scroller_sync_last(scr);
     scroller_set_last_tty_attr(scr);
+    scroller_trim(scr);
+}
+
+/* Get a line's attributes in a stretchy buffer for hl_printline */
+static const struct hl_line_attr *scroller_draw_attrs(struct scroller *scr,
+    const struct scroller_line *sl)
+{
+    if (!sl->attr_count)
+        return NULL;
+
+    sbsetcount(scr->draw_attrs, sl->attr_count);
+    memcpy(scr->draw_attrs, sl->attrs, sl->attr_count * sizeof(struct hl_line_attr));
+
+    return scr->draw_attrs;
 }
 
 /* ----------------- */
@@ -231,15 +904,42 @@ struct scroller *scr_new()
     rv->regex_is_searching = 0;
     rv->search_r = 0;
 
-    /* Start with a single (blank) line */
-    rv->lines = NULL;
-    scroller_addline(rv, strdup(""), NULL, 0);
-
     rv->jump_back_mark.r = -1;
     rv->jump_back_mark.c = -1;
     memset(rv->local_marks, 0xff, sizeof(rv->local_marks));
     memset(rv->global_marks, 0xff, sizeof(rv->global_marks));
 
+    rv->lines = NULL;
+    rv->lines_alloc = 0;
+    rv->lines_first = 0;
+    rv->line_count = 0;
+    rv->line_bytes = 0;
+
+    rv->chunks = NULL;
+    rv->chunks_first = 0;
+    rv->chunks_base = 0;
+    rv->spare.data = NULL;
+
+    rv->last_line = NULL;
+    rv->last_attrs = NULL;
+    rv->draw_attrs = NULL;
+
+    rv->first_line = 0;
+    rv->cold = NULL;
+    rv->cold_first = 0;
+    rv->cold_count = 0;
+    rv->spill_fd = -1;
+    rv->spill_size = 0;
+    memset(rv->windows, 0, sizeof(rv->windows));
+    rv->window_clock = 0;
+
+    rv->rows = NULL;
+    rv->rows_base = 0;
+    rv->rows_width = 0;
+
+    /* Start with a single (blank) line */
+    scroller_addline(rv, "", 0, 0);
+
     return rv;
 }
 
@@ -248,14 +948,26 @@ void scr_free(struct scroller *scr)
     int i;
 
     /* Release the buffer */
-    for (i = 0; i < sbcount(scr->lines); i++)
-    {
-        free(scr->lines[i].line);
-        sbfree(scr->lines[i].attrs);
-    }
-    sbfree(scr->lines);
+    for (i = scr->chunks_first; i < sbcount(scr->chunks); i++)
+        free(scr->chunks[i].data);
+    sbfree(scr->chunks);
+    scr->chunks = NULL;
+    free(scr->spare.data);
+
+    free(scr->lines);
     scr->lines = NULL;
 
+    sbfree(scr->last_line);
+    sbfree(scr->last_attrs);
+    sbfree(scr->draw_attrs);
+    sbfree(scr->rows);
+
+    for (i = 0; i < SCROLLER_WINDOW_COUNT; i++)
+        scroller_unmap_window(&scr->windows[i]);
+    sbfree(scr->cold);
+    if (scr->spill_fd != -1)
+        close(scr->spill_fd);
+
     hl_regex_free(&scr->hlregex);
     scr->hlregex = NULL;
     scr->regex_is_searching = 0;
@@ -269,43 +981,20 @@ void scr_free(struct scroller *scr)
 
 static int get_last_col(struct scroller *scr, int row)
 {
-    return (MAX(scr->lines[row].line_len - 1, 0) / scr->width) * scr->width;
+    return (MAX(scroller_get_line(scr, row)->line_len - 1, 0) / scr->width) * scr->width;
 }
 
 static void scr_scroll_lines(struct scroller *scr, int *r, int *c, int nlines)
 {
-    int i;
-    int row = *r;
-    int col = (*c / scr->width) * scr->width;
-    int amt = (nlines < 0) ? -scr->width : scr->width;
+    long drow;
 
-    if (nlines < 0)
-        nlines = -nlines;
-
-    for (i = 0; i < nlines; i++)
-    {
-        col += amt;
-
-        if (col < 0)
-        {
-            if (row <= 0)
-                break;
-
-            row--;
-            col = get_last_col(scr, row);
-        }
-        else if (col >= scr->lines[row].line_len)
-        {
-            if (row >= sbcount(scr->lines) - 1)
-                break;
+    scroller_rows_check(scr);
 
-            row++;
-            col = 0;
-        }
+    /* Move by display rows, stopping at the first and last ones */
+    drow = scroller_rows_before(scr, *r) + *c / scr->width + nlines;
+    drow = MAX(MIN(drow, scroller_rows_total(scr) - 1), 0);
 
-        *r = row;
-        *c = col;
-    }
+    scroller_rows_find(scr, drow, r, c);
 }
 
 void scr_up(struct scroller *scr, int nlines)
@@ -317,7 +1006,7 @@ void scr_up(struct scroller *scr, int nlines)
 
 void scr_down(struct scroller *scr, int nlines)
 {
-    int at_bottom = (scr->current.r == (sbcount(scr->lines) - 1));
+    int at_bottom = (scr->current.r == (scr->line_count - 1));
 
     if (at_bottom)
         scr->in_scroll_mode = 0;
@@ -335,7 +1024,7 @@ void scr_home(struct scroller *scr)
 
 void scr_end(struct scroller *scr)
 {
-    scr->current.r = sbcount(scr->lines) - 1;
+    scr->current.r = scr->line_count - 1;
     scr->current.c = get_last_col(scr, scr->current.r);
 }
 
@@ -354,11 +1043,10 @@ static void scr_add_buf(struct scroller *scr, const char *buf, int tty)
         int is_crlf = (distance == 1) && (buf[0] == '\r');
         if (!is_crlf)
         {
-            int index = sbcount(scr->lines) - 1;
-            char *orig = scr->lines[index].line;
-            int orig_len = scr->lines[index].line_len;
+            struct scroller_line *sl = scroller_get_line(scr, scr->line_count - 1);
+            int orig_len = sl->line_len;
 
-            if ((scr->last_tty_attr != -1) && (tty != scr->lines[index].tty))
+            if ((scr->last_tty_attr != -1) && (tty != sl->tty))
             {
                 struct hl_line_attr attr;
 
@@ -374,25 +1062,20 @@ static void scr_add_buf(struct scroller *scr, const char *buf, int tty)
                     attr.attr = 0;
                 }
 
-                sbpush(scr->lines[index].attrs, attr);
+                sbpush(scr->last_attrs, attr);
             }
 
-            scr->lines[index].tty = tty;
-            scr->lines[index].line = parse(scr, &scr->lines[index].attrs, orig, buf, distance);
-            scr->lines[index].line_len = strlen(scr->lines[index].line);
+            sl->tty = tty;
+            parse(scr, buf, distance);
+            scroller_sync_last(scr);
 
             scroller_set_last_tty_attr(scr);
-
-            free(orig);
         }
     }
 
     /* Create additional lines if buf contains newlines */
     while (x != NULL)
     {
-        char *line;
-        struct hl_line_attr *attrs = NULL;
-
         buf = x + 1;
         x = strchr((char *)buf, '\n');
         distance = x ? x - buf : strlen(buf);
@@ -403,17 +1086,12 @@ static void scr_add_buf(struct scroller *scr, const char *buf, int tty)
             /* Store away and parse when the rest of the line shows up */
             scr->last_tty_line = strdup(buf);
             /* Add line since we did have a lf */
-            scr->current.pos = 0;
-            scroller_addline(scr, strdup(""), NULL, tty);
+            scroller_addline(scr, "", 0, tty);
             break;
         }
 
-        /* Expand the buffer */
-        scr->current.pos = 0;
-
         /* Add the new line */
-        line = parse(scr, &attrs, "", buf, distance);
-        scroller_addline(scr, line, attrs, tty);
+        scroller_addline(scr, buf, distance, tty);
     }
 
     /* Move to end of buffer and exit scroll mode */
@@ -464,7 +1142,7 @@ void scr_search_regex_init(struct scroller *scr)
 
 static int wrap_line(struct scroller *scr, int line)
 {
-    int count = sbcount(scr->lines);
+    int count = scr->line_count;
 
     if (line < 0)
         line = count - 1;
@@ -501,14 +1179,14 @@ int scr_search_regex(struct scroller *scr, const char *regex, int opt,
         {
             // No wrapping. Stop at line 0 if searching down and last line
             // if searching up.
-            line_end = direction ? 0 : sbcount(scr->lines) - 1;
+            line_end = direction ? 0 : scr->line_count - 1;
         }
 
         for (;;)
         {
             int ret;
             int start, end;
-            char *line_str = scr->lines[line].line;
+            const char *line_str = scroller_get_line(scr, line)->line;
 
             ret = hl_regex_search(&scr->hlregex, line_str, regex, icase, &start, &end);
             if (ret > 0)
@@ -579,7 +1257,7 @@ int scr_goto_mark(struct scroller *scr, int key)
     else if (key == '.')
     {
         /* Jump to last line */
-        mark_temp.r = sbcount(scr->lines) - 1;
+        mark_temp.r = scr->line_count - 1;
         mark_temp.c = get_last_col(scr, scr->current.r);
         mark = &mark_temp;
     }
@@ -597,6 +1275,20 @@ int scr_goto_mark(struct scroller *scr, int key)
     return 0;
 }
 
+void scr_goto_percent(struct scroller *scr, int percent)
+{
+    long drow;
+
+    scroller_rows_check(scr);
+
+    scr->jump_back_mark.r = scr->current.r;
+    scr->jump_back_mark.c = scr->current.c;
+
+    /* Like vim's N%, rounding up to the next row */
+    drow = (MIN(percent, 100) * scroller_rows_total(scr) + 99) / 100 - 1;
+    scroller_rows_find(scr, MAX(drow, 0), &scr->current.r, &scr->current.c);
+}
+
 void scr_refresh(struct scroller *scr, SWINDOW *win, int focus, enum win_refresh dorefresh)
 {
     int length;        /* Length of current line */
@@ -627,25 +1319,17 @@ void scr_refresh(struct scroller *scr, SWINDOW *win, int focus, enum win_refresh
         /* Print the current line [segment] */
         if (row >= 0)
         {
-            struct scroller_line *sline = &scr->lines[row];
-
-            hl_printline(win, sline->line, sline->line_len, sline->attrs,
-                0, height - nlines, col, width);
+            struct scroller_line *sline = scroller_get_line(scr, row);
+            struct hl_line_attr *search_attrs = NULL;
 
             /* If we're searching right now or we finished search and have focus... */
             if ((scr->regex_is_searching == 1) || (scr->regex_is_searching == 2 && focus))
-            {
-                struct hl_line_attr *attrs;
-
-                attrs = hl_regex_highlight(&scr->hlregex, sline->line);
+                search_attrs = hl_regex_highlight(&scr->hlregex, sline->line);
 
-                if (sbcount(attrs))
-                {
-                    hl_printline_highlight(win, sline->line, sline->line_len,
-                        attrs, 0, height - nlines, col, width);
-                    sbfree(attrs);
-                }
-            }
+            hl_printline_overlay(win, sline->line, sline->line_len,
+                scroller_draw_attrs(scr, sline), search_attrs,
+                0, height - nlines, col, width);
+            sbfree(search_attrs);
 
             /* Update our position */
             if (col >= width)
@@ -657,7 +1341,7 @@ void scr_refresh(struct scroller *scr, SWINDOW *win, int focus, enum win_refresh
                 row--;
                 if (row >= 0)
                 {
-                    length = scr->lines[row].line_len;
+                    length = scroller_get_line(scr, row)->line_len;
                     if (length > width)
                         col = ((length - 1) / width) * width;
                 }
@@ -675,7 +1359,11 @@ void scr_refresh(struct scroller *scr, SWINDOW *win, int focus, enum win_refresh
             char status[64];
             size_t status_len;
 
-            snprintf(status, sizeof(status), "[%d/%d]", scr->current.r + 1, sbcount(scr->lines));
+            /* Display row of the bottom of the window, out of all rows */
+            scroller_rows_check(scr);
+            snprintf(status, sizeof(status), "[%ld/%ld]",
+                scroller_rows_before(scr, scr->current.r) + scr->current.c / width + 1,
+                scroller_rows_total(scr));
 
             status_len = strlen(status);
             if (status_len < width)
@@ -687,8 +1375,8 @@ void scr_refresh(struct scroller *scr, SWINDOW *win, int focus, enum win_refresh
         }
     }
 
-    length = scr->lines[scr->current.r].line_len - scr->current.c;
-    if (focus && scr->current.r == sbcount(scr->lines) - 1 && length <= width)
+    length = scroller_get_line(scr, scr->current.r)->line_len - scr->current.c;
+    if (focus && scr->current.r == scr->line_count - 1 && length <= width)
     {
         /* We're on the last line, draw the cursor */
         swin_curs_set(1);
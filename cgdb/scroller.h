@@ -12,16 +12,62 @@
 /* Count of marks */
 #define MARK_COUNT 26
 
+/* Count of spilled chunks that can be mapped at once */
+#define SCROLLER_WINDOW_COUNT 4
+
 /* --------------- */
 /* Data Structures */
 /* --------------- */
 
 struct scroller_line
 {
-    char *line;
+    const char *line;                 /* Nil terminated text */
+    int line_len;
+    int tty;
+    const struct hl_line_attr *attrs; /* attr_count color attributes */
+    int attr_count;
+    int chunk;                        /* Chunk line is stored in, -1 for last line */
+};
+
+/* Completed lines are copied into large chunks, so adding a line doesn't
+ * allocate memory and the oldest chunk can be freed when the lines in it
+ * have all been dropped. */
+struct scroller_chunk
+{
+    char *data;
+    int size;  /* Bytes used */
+    int alloc; /* Bytes allocated */
+    int lines; /* Lines stored in data that haven't been dropped */
+};
+
+/* With the scrollbackdisk option, the oldest chunks are written to a
+ * temporary file instead of being dropped. Each is followed by an index of
+ * the lines in it, and read back through a mapped window when its lines
+ * are shown or searched. */
+struct scroller_cold_line
+{
+    int offset; /* Offset of the line in its chunk, attributes follow it */
     int line_len;
     int tty;
-    struct hl_line_attr *attrs;
+    int attr_count;
+};
+
+struct scroller_cold_chunk
+{
+    long file_offset; /* Offset of the chunk in the spill file */
+    int size;         /* Bytes of lines, the index follows them */
+    int lines;
+    long first_line;  /* Line number of the chunk's first line */
+};
+
+struct scroller_window
+{
+    void *map;
+    long map_size;
+    long file_offset; /* Chunk that's mapped */
+    const char *data;
+    const struct scroller_cold_line *index;
+    unsigned long used; /* When the window was last used */
 };
 
 struct scroller_mark
@@ -32,7 +78,36 @@ struct scroller_mark
 
 struct scroller
 {
+    /* Ring of lines, oldest first. Row r is lines[(first + r) & (alloc - 1)]. */
     struct scroller_line *lines;
+    int lines_alloc; /* Power of 2 */
+    int lines_first;
+    int line_count;
+    long line_bytes; /* Memory used by the completed lines */
+
+    /* Stretchy buffer of chunks, oldest first, starting at chunks_first.
+     * Chunk number n is chunks[n - chunks_base]. */
+    struct scroller_chunk *chunks;
+    int chunks_first;
+    int chunks_base;
+    struct scroller_chunk spare; /* Freed chunk kept for reuse */
+
+    char *last_line;                 /* Stretchy buffer of last line, with nil */
+    struct hl_line_attr *last_attrs; /* Stretchy buffer of last line attributes */
+    struct hl_line_attr *draw_attrs; /* Used to pass attributes to hl_printline */
+
+    /* Lines are numbered from the first line added. Rows are relative to
+     * the oldest line kept, first_line. Rows before cold_count are in the
+     * spill file, the rest are in the ring. */
+    long first_line;
+    struct scroller_cold_chunk *cold; /* Stretchy buffer of spilled chunks */
+    int cold_first;                   /* First spilled chunk with lines kept */
+    int cold_count;                   /* Number of spilled lines */
+    int spill_fd;                     /* Spill file, -1 until needed */
+    long spill_size;
+    struct scroller_window windows[SCROLLER_WINDOW_COUNT];
+    unsigned long window_clock;
+    struct scroller_line cold_line;   /* Last spilled line looked up */
 
     char *last_tty_line; /* Partial tty line - without \n */
     int last_tty_attr;   /* ansi attribute we got for last tty line */
@@ -52,6 +127,13 @@ struct scroller
     int regex_is_searching;
     int search_r;
 
+    /* Fenwick tree of the display rows each line wraps to at rows_width.
+     * Entry k is for line number rows_base + k - 1, rows[0] is unused.
+     * Built the first time it's needed and again when the width changes. */
+    long *rows;
+    long rows_base;
+    int rows_width; /* 0 until the tree is built */
+
     scroller_mark local_marks[MARK_COUNT]; /* Global A-Z marks */
     scroller_mark global_marks[MARK_COUNT]; /* Global A-Z marks */
     scroller_mark jump_back_mark;           /* Location where last jump occurred from */
@@ -105,6 +187,14 @@ void scr_home(struct scroller *scr);
  */
 void scr_end(struct scroller *scr);
 
+/* scr_goto_percent: Jump to a display row part way through the buffer
+ * -----------------
+ *
+ *   scr:      Pointer to the scroller object
+ *   percent:  How far through the buffer, 100 is the last row
+ */
+void scr_goto_percent(struct scroller *scr, int percent);
+
 /* scr_add:  Append a string to the buffer.
  * --------
  *
@@ -0,0 +1,208 @@
+/* scroller_driver:
+ * ----------------
+ *
+ * Checks how the scroller trims its lines for the scrollbacklines,
+ * scrollbacksize and scrollbackdisk options.
+ *
+ * Usage: scroller_driver
+ */
+
+/* The scroller's lines and chunks are private to scroller.cpp, so it's
+ * built into this driver instead of being linked with the rest of cgdb */
+#include "scroller.cpp"
+
+/* Options the scroller reads, everything else is 0 */
+static int scrollback_lines;
+static int scrollback_size;
+static int scrollback_disk;
+
+/* The scroller only uses these to color and draw lines, which the driver
+ * doesn't do */
+hl_groups_ptr hl_groups_instance = NULL;
+
+int cgdbrc_get_int(enum cgdbrc_option_kind option)
+{
+    switch (option)
+    {
+    case CGDBRC_SCROLLBACKLINES:
+        return scrollback_lines;
+    case CGDBRC_SCROLLBACKSIZE:
+        return scrollback_size;
+    case CGDBRC_SCROLLBACKDISK:
+        return scrollback_disk;
+    default:
+        return 0;
+    }
+}
+
+int hl_groups_get_attr(hl_groups_ptr hl_groups, enum hl_group_kind kind,
+    int *attr)
+{
+    *attr = 0;
+    return 0;
+}
+
+int hl_ansi_get_color_attrs(hl_groups_ptr hl_groups, const char *buf,
+    int *attr, int force_esc_parsing)
+{
+    return 0;
+}
+
+void hl_printline_overlay(SWINDOW *win, const char *line, int line_len,
+    const hl_line_attr *attrs, const hl_line_attr *overlay,
+    int x, int y, int col, int width)
+{
+}
+
+int hl_regex_search(struct hl_regex_info **info, const char *line,
+    const char *regex, int icase, int *start, int *end)
+{
+    return 0;
+}
+
+void hl_regex_free(struct hl_regex_info **info)
+{
+}
+
+struct hl_line_attr *hl_regex_highlight(struct hl_regex_info **info,
+    const char *line)
+{
+    return NULL;
+}
+
+static struct scroller *new_scroller(int lines, int size, int disk)
+{
+    struct scroller *scr = scr_new();
+
+    scrollback_lines = lines;
+    scrollback_size = size;
+    scrollback_disk = disk;
+    scr->width = 80;
+
+    return scr;
+}
+
+/* Add lines "line 0\n" to "line <count - 1>\n" */
+static void add_numbered_lines(struct scroller *scr, int count)
+{
+    char buf[64];
+    int i;
+
+    for (i = 0; i < count; i++)
+    {
+        snprintf(buf, sizeof(buf), "line %d\n", i);
+        scr_add(scr, buf, 0);
+    }
+}
+
+/* Check the text of the line at a row */
+static int check_line(struct scroller *scr, const char *name, int row,
+    const char *expected)
+{
+    struct scroller_line *sl = scroller_get_line(scr, row);
+
+    if (sl->line_len != (int)strlen(expected) ||
+        strncmp(sl->line, expected, sl->line_len))
+    {
+        printf("FAIL: %s: row %d is \"%.*s\", expected \"%s\"\n",
+            name, row, sl->line_len, sl->line, expected);
+        return 1;
+    }
+
+    return 0;
+}
+
+/* A line bigger than scrollbacksize after lines were spilled to disk.
+ * Dropping spilled lines doesn't free any memory, so they're kept. */
+static int check_huge_line_after_spill()
+{
+    const char *name = "huge line after spill";
+    struct scroller *scr = new_scroller(0, 1, 1);
+    int size = 3 * 1024 * 1024;
+    char *huge = (char *)cgdb_malloc(size + 2);
+    int cold_count;
+    int failed = 0;
+
+    add_numbered_lines(scr, 100000);
+
+    cold_count = scr->cold_count;
+    if (!cold_count)
+    {
+        printf("FAIL: %s: nothing was spilled\n", name);
+        failed = 1;
+    }
+
+    memset(huge, 'x', size);
+    huge[size] = '\n';
+    huge[size + 1] = 0;
+    scr_add(scr, huge, 0);
+
+    if (scr->cold_count < cold_count)
+    {
+        printf("FAIL: %s: %d of %d spilled lines dropped\n",
+            name, cold_count - scr->cold_count, cold_count);
+        failed = 1;
+    }
+
+    failed |= check_line(scr, name, 0, "line 0");
+
+    free(huge);
+    scr_free(scr);
+    return failed;
+}
+
+/* scrollbacklines drops spilled lines like any other */
+static int check_lines_limit_with_spill()
+{
+    const char *name = "scrollbacklines with spill";
+    struct scroller *scr = new_scroller(50000, 1, 1);
+    int failed = 0;
+
+    add_numbered_lines(scr, 100000);
+
+    /* The empty line being written is counted */
+    if (scr->line_count != 50000)
+    {
+        printf("FAIL: %s: %d lines kept, expected 50000\n",
+            name, scr->line_count);
+        failed = 1;
+    }
+
+    failed |= check_line(scr, name, 0, "line 50001");
+
+    scr_free(scr);
+    return failed;
+}
+
+/* Without scrollbackdisk, the oldest lines are dropped for scrollbacksize */
+static int check_size_limit()
+{
+    const char *name = "scrollbacksize";
+    struct scroller *scr = new_scroller(0, 1, 0);
+    int failed = 0;
+
+    add_numbered_lines(scr, 100000);
+
+    if (scr->line_bytes > 1024 * 1024 || scr->line_count >= 100000)
+    {
+        printf("FAIL: %s: %ld bytes in %d lines kept\n",
+            name, scr->line_bytes, scr->line_count);
+        failed = 1;
+    }
+
+    scr_free(scr);
+    return failed;
+}
+
+int main(int argc, char **argv)
+{
+    int failed = 0;
+
+    failed |= check_huge_line_after_spill();
+    failed |= check_lines_limit_with_spill();
+    failed |= check_size_limit();
+
+    printf("%s\n", failed ? "FAILED" : "PASSED");
+
+    return failed;
+}
@@ -3,11 +3,10 @@
  * 
  * Source file management routines for the GUI.  Provides the ability to
  * add files to the list, load files, and display within a curses window.
- * Files are buffered in memory when they are displayed, and held in
- * memory for the duration of execution.  If memory consumption becomes a
- * problem, this can be optimized to unload files which have not been
- * displayed recently, or only load portions of large files at once. (May
- * affect syntax highlighting.)
+ * Files are mapped into memory when they are displayed, and held in
+ * memory for the duration of execution.  Only an index of line offsets is
+ * built when a file is loaded; individual lines are tab expanded and
+ * materialized the first time they are displayed or searched.
  *
  */
 
@@ -32,6 +31,10 @@
 #include <sys/time.h>
 #endif
 
+#if HAVE_TIME_H
+#include <time.h>
+#endif /* HAVE_TIME_H */
+
 #if HAVE_SYS_STAT_H
 #include <sys/stat.h>
 #endif
@@ -40,10 +43,30 @@
 #include <unistd.h>
 #endif /* HAVE_UNISTD_H */
 
+#if HAVE_FCNTL_H
+#include <fcntl.h>
+#endif /* HAVE_FCNTL_H */
+
+#if HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif /* HAVE_SYS_MMAN_H */
+
+#if HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif /* HAVE_SYS_INOTIFY_H */
+
+#if HAVE_ERRNO_H
+#include <errno.h>
+#endif /* HAVE_ERRNO_H */
+
 #if HAVE_CTYPE_H
 #include <ctype.h>
 #endif
 
+#if HAVE_SIGNAL_H
+#include <signal.h>
+#endif
+
 #ifdef HAVE_STDINT_H
 #include <stdint.h>
 #endif
@@ -61,9 +84,33 @@
 #include "highlight_groups.h"
 #include "tgdb_types.h"
 #include "interface.h"
+#include "std_hash.h"
+#include "highlight_cache.h"
+#include "text_util.h"
 
 int sources_syntax_on = 1;
 
+/* Lines highlighted around the view when it's not yet highlighted */
+#define HL_VIEW_MARGIN 100
+
+/* Lines highlighted at a time by source_highlight_step */
+#define HL_STEP_LINES 1000
+
+/* Most lines a reload highlights right away, the rest is left to
+ * source_highlight_step */
+#define HL_RELOAD_MAX_LINES 10000
+
+/* Lines searched at a time when adding to a file's match index */
+#define MATCH_STEP_LINES 4096
+
+/* Most search matches kept in a file's match index. Lines past the
+ * index are searched directly. */
+#define MATCH_INDEX_MAX 1000000
+
+/* Files smaller than this are indexed and highlighted quickly enough
+ * that they aren't put in the highlight cache */
+#define HL_CACHE_MIN_FILE_SIZE (256 * 1024)
+
 // This speeds up loading sqlite.c from 2:48 down to ~2 seconds.
 // sqlite3 is 6,596,401 bytes, 188,185 lines.
 
@@ -80,17 +127,53 @@ int sources_syntax_on = 1;
 struct list_node *source_get_node(struct sviewer *sview, const char *path)
 {
     if (sview && path && path[0])
+        return (struct list_node *)std_hash_table_lookup(sview->node_index, path);
+
+    return NULL;
+}
+
+/* Set line to the line in the disassembly node with address addr */
+static void source_get_asmnode_line(struct list_node *node, uint64_t addr, int *line)
+{
+    int lo = 0;
+    int hi = sbcount(node->file_buf.addr_lines) - 1;
+
+    /* Binary search the lines with addresses */
+    while (lo <= hi)
     {
-        struct list_node *cur;
+        int mid = lo + (hi - lo) / 2;
+        int mid_line = node->file_buf.addr_lines[mid];
+        uint64_t mid_addr = node->file_buf.addrs[mid_line];
 
-        for (cur = sview->list_head; cur != NULL; cur = cur->next)
+        if (mid_addr == addr)
         {
-            if (cur->path && (strcmp(path, cur->path) == 0))
-                return cur;
+            *line = mid_line;
+            break;
         }
+        else if (mid_addr < addr)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
     }
+}
 
-    return NULL;
+/* Returns the index of the first disassembly node with addr_start > addr */
+static int source_asm_nodes_upper_bound(struct sviewer *sview, uint64_t addr)
+{
+    int lo = 0;
+    int hi = sbcount(sview->asm_nodes);
+
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+
+        if (sview->asm_nodes[mid]->addr_start <= addr)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
 }
 
 struct list_node *source_get_asmnode(struct sviewer *sview, uint64_t addr, int *line)
@@ -98,29 +181,28 @@ struct list_node *source_get_asmnode(struct sviewer *sview, uint64_t addr, int *
     struct list_node *node = NULL;
 
     if (addr)
-    {
-        /* Search for a node which contains this address */
-        for (node = sview->list_head; node; node = node->next)
-        {
-            if (addr >= node->addr_start && addr <= node->addr_end)
-                break;
-        }
-    }
-
-    if (node && line)
     {
         int i;
 
-        for (i = 0; i < sbcount(node->file_buf.addrs); i++)
+        /* Search for a node which contains this address, starting with the
+         * node with the closest start address. Ranges can overlap, so keep
+         * walking back while any earlier node could still reach addr. */
+        for (i = source_asm_nodes_upper_bound(sview, addr) - 1; i >= 0; i--)
         {
-            if (node->file_buf.addrs[i] == addr)
+            if (sview->asm_nodes_max_end[i] < addr)
+                break;
+
+            if (addr <= sview->asm_nodes[i]->addr_end)
             {
-                *line = i;
+                node = sview->asm_nodes[i];
                 break;
             }
         }
     }
 
+    if (node && line)
+        source_get_asmnode_line(node, addr, line);
+
     return node;
 }
 
@@ -156,11 +238,138 @@ static int get_timestamp(const char *path, time_t *timestamp)
 static void init_file_buffer(struct buffer *buf)
 {
     buf->lines = NULL;
+    buf->hl_runs = NULL;
+    buf->hl_offsets = NULL;
+    buf->hl_states = NULL;
     buf->max_width = 0;
     buf->addrs = NULL;
+    buf->addr_lines = NULL;
     buf->tabstop = cgdbrc_get_int(CGDBRC_TABSTOP);
+    buf->synmaxcol = cgdbrc_get_int(CGDBRC_SYNMAXCOL);
     buf->file_data = NULL;
+    buf->file_size = 0;
+    buf->file_mtime = 0;
+    buf->file_ino = 0;
+    buf->file_mapped = 0;
+    buf->line_offsets = NULL;
+    buf->mem_size = 0;
+    buf->hl_line = 0;
+    buf->hl_state = 0;
+    buf->hl_prov_start = 0;
+    buf->hl_prov_end = 0;
+    buf->hl_cached = 0;
     buf->language = TOKENIZER_LANGUAGE_UNKNOWN;
+    buf->matches = NULL;
+    buf->match_gen = 0;
+    buf->match_line = 0;
+    buf->match_full = 0;
+}
+
+#if HAVE_SYS_MMAN_H
+/* A file mapped in by load_file_buf. If the file is truncated while it's
+ * mapped, like when it's regenerated or an editor rewrites it in place,
+ * reading a page past its new end raises SIGBUS. */
+struct mapped_file
+{
+    char *data;
+    long size;
+    int faulted; /* Set when the mapping was replaced with zeros */
+};
+
+/* Stretchy buffer of the files mapped in */
+static struct mapped_file *mapped_files;
+
+/* SIGBUS handler. A fault in a mapped file replaces its mapping with zero
+ * filled pages, so reading it again carries on. The file is loaded again
+ * before it's displayed next. */
+static void mapped_file_fault(int signo, siginfo_t *info, void *context)
+{
+    int i;
+    char *addr = (char *)info->si_addr;
+
+    for (i = 0; i < sbcount(mapped_files); i++)
+    {
+        struct mapped_file *mf = &mapped_files[i];
+
+        if (addr >= mf->data && addr < mf->data + mf->size)
+        {
+            if (mmap(mf->data, mf->size, PROT_READ,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != MAP_FAILED)
+            {
+                mf->faulted = 1;
+                return;
+            }
+            break;
+        }
+    }
+
+    /* Not one of our files, fault again with the default action */
+    signal(SIGBUS, SIG_DFL);
+}
+
+static void mapped_file_add(char *data, long size)
+{
+    static int handler_set;
+    struct mapped_file mf;
+
+    if (!handler_set)
+    {
+        struct sigaction action;
+
+        action.sa_sigaction = mapped_file_fault;
+        sigemptyset(&action.sa_mask);
+        action.sa_flags = SA_SIGINFO;
+
+        if (sigaction(SIGBUS, &action, NULL) < 0)
+            clog_error(CLOG_CGDB, "sigaction(SIGBUS) failed");
+        handler_set = 1;
+    }
+
+    mf.data = data;
+    mf.size = size;
+    mf.faulted = 0;
+    sbpush(mapped_files, mf);
+}
+
+static void mapped_file_remove(char *data)
+{
+    int i;
+
+    for (i = 0; i < sbcount(mapped_files); i++)
+    {
+        if (mapped_files[i].data == data)
+        {
+            mapped_files[i] = sbpop(mapped_files);
+            break;
+        }
+    }
+}
+#endif
+
+/* Returns 1 if buf is a mapped file that was truncated while mapped in */
+static int buffer_faulted(struct buffer *buf)
+{
+#if HAVE_SYS_MMAN_H
+    int i;
+
+    if (!buf->file_mapped)
+        return 0;
+
+    for (i = 0; i < sbcount(mapped_files); i++)
+    {
+        if (mapped_files[i].data == buf->file_data)
+            return mapped_files[i].faulted;
+    }
+#endif
+
+    return 0;
+}
+
+/* Returns 1 if line points directly into the file data of buf */
+static int buffer_line_in_file_data(struct buffer *buf, const char *line)
+{
+    return buf->file_data && (line >= buf->file_data) &&
+        (line < buf->file_data + buf->file_size);
 }
 
 static void release_file_buffer(struct buffer *buf)
@@ -171,19 +380,38 @@ static void release_file_buffer(struct buffer *buf)
 
         for (i = 0; i < sbcount(buf->lines); i++)
         {
-            sbfree(buf->lines[i].attrs);
-            buf->lines[i].attrs = NULL;
-
-            if (!buf->file_data)
-            {
+            /* Free lines which were materialized into their own buffer */
+            if (!buffer_line_in_file_data(buf, buf->lines[i].line))
                 sbfree(buf->lines[i].line);
-                buf->lines[i].line = NULL;
-            }
+            buf->lines[i].line = NULL;
         }
 
         /* Free entire file buffer */
-        sbfree(buf->file_data);
+#if HAVE_SYS_MMAN_H
+        if (buf->file_mapped)
+        {
+            mapped_file_remove(buf->file_data);
+            munmap(buf->file_data, buf->file_size);
+        }
+        else
+#endif
+            sbfree(buf->file_data);
         buf->file_data = NULL;
+        buf->file_size = 0;
+        buf->file_mtime = 0;
+        buf->file_mapped = 0;
+
+        sbfree(buf->line_offsets);
+        buf->line_offsets = NULL;
+
+        sbfree(buf->hl_runs);
+        buf->hl_runs = NULL;
+
+        sbfree(buf->hl_offsets);
+        buf->hl_offsets = NULL;
+
+        sbfree(buf->hl_states);
+        buf->hl_states = NULL;
 
         sbfree(buf->lines);
         buf->lines = NULL;
@@ -191,8 +419,23 @@ static void release_file_buffer(struct buffer *buf)
         sbfree(buf->addrs);
         buf->addrs = NULL;
 
+        sbfree(buf->addr_lines);
+        buf->addr_lines = NULL;
+
         buf->max_width = 0;
+        buf->mem_size = 0;
+        buf->hl_line = 0;
+        buf->hl_state = 0;
+        buf->hl_prov_start = 0;
+        buf->hl_prov_end = 0;
+        buf->hl_cached = 0;
         buf->language = TOKENIZER_LANGUAGE_UNKNOWN;
+
+        sbfree(buf->matches);
+        buf->matches = NULL;
+        buf->match_gen = 0;
+        buf->match_line = 0;
+        buf->match_full = 0;
     }
 }
 
@@ -240,45 +483,314 @@ static long get_file_size(FILE *file)
     return -1;
 }
 
+/* Expand the tabs in a nil terminated stretchy buffer */
 static char *detab_buffer(char *buffer, int tabstop)
 {
-    int i;
-    int dst = 0;
     char *newbuf = NULL;
     int size = sbcount(buffer);
 
-    char *tab = strchr(buffer, '\t');
-    if (!tab)
+    if (!memchr(buffer, '\t', size))
         return buffer;
 
-    for (i = 0; i < size; i++)
+    /* Size the new buffer exactly, then expand into it */
+    sbsetcount(newbuf, text_util_detab_width(buffer, size, tabstop));
+    text_util_detab(buffer, size, tabstop, newbuf);
+
+    sbfree(buffer);
+    return newbuf;
+}
+
+/**
+ * Get the column a token ends at when it starts at column col.
+ *
+ * \param text
+ * The nil terminated token text
+ *
+ * \param col
+ * The column the token starts at
+ *
+ * \param tabstop
+ * The tabstop value to expand tabs with
+ *
+ * \return
+ * The column following the token.
+ */
+static int advance_column(const char *text, int col, int tabstop)
+{
+    for (; *text; text++)
+    {
+        if (*text == '\t')
+            col += tabstop - col % tabstop;
+        else
+            col++;
+    }
+
+    return col;
+}
+
+/**
+ * Get a line from a file buffer, materializing it if it hasn't been yet.
+ *
+ * Lines without tabs point directly into the file data. Lines with tabs
+ * and a last line without a trailing line feed are copied into their own
+ * nil terminated stretchy buffer.
+ *
+ * \param buf
+ * struct buffer pointer
+ *
+ * \param line
+ * The line to get, must be a valid line index
+ *
+ * \return
+ * The source line.
+ */
+static struct source_line *buffer_get_line(struct buffer *buf, int line)
+{
+    struct source_line *sline = &buf->lines[line];
+
+    if (!sline->line && buf->file_data)
     {
-        if (buffer[i] == '\t')
+        const char *line_start = buf->file_data + buf->line_offsets[line];
+        const char *line_end = buf->file_data + buf->line_offsets[line + 1];
+        int has_line_feed = (line_end > line_start) && (line_end[-1] == '\n');
+        int line_len;
+
+        /* Trim trailing cr-lfs */
+        while (line_end > line_start && (line_end[-1] == '\n' || line_end[-1] == '\r'))
+            line_end--;
+
+        line_len = line_end - line_start;
+
+        if (!has_line_feed || memchr(line_start, '\t', line_len))
         {
-            int spaces = tabstop - dst % tabstop;
+            char *str = NULL;
 
-            while (spaces--)
-            {
-                sbpush(newbuf, ' ');
-                dst++;
-            }
+            sline->len = text_util_detab_width(line_start, line_len, buf->tabstop);
+
+            sbsetcount(str, sline->len + 1);
+            text_util_detab(line_start, line_len, buf->tabstop, str);
+            str[sline->len] = 0;
+            sline->line = str;
+
+            buf->mem_size += sbcount(str);
         }
         else
         {
-            sbpush(newbuf, buffer[i]);
-            dst++;
+            sline->line = (char *)line_start;
+            sline->len = line_len;
         }
 
-        if (buffer[i] == '\n' || buffer[i] == '\r')
-            dst = 0;
+        /* Update max length string found */
+        if (sline->len > buf->max_width)
+            buf->max_width = sline->len;
     }
 
-    sbfree(buffer);
-    return newbuf;
+    return sline;
+}
+
+/**
+ * Build the line offset index for a file buffer. Lines are not
+ * materialized until buffer_get_line is called.
+ *
+ * \param buf
+ * struct buffer pointer with file_data and file_size set
+ */
+static void index_file_buf(struct buffer *buf)
+{
+    long max_len = text_util_index_lines(buf->file_data, buf->file_size,
+        &buf->line_offsets);
+    int count = sbcount(buf->line_offsets) - 1;
+
+    /* Line i spans line_offsets[i] to line_offsets[i + 1] */
+    sbsetcount(buf->lines, count);
+    memset(buf->lines, 0, count * sizeof(buf->lines[0]));
+
+    /* Estimate max width until lines are materialized or highlighted */
+    if (max_len > buf->max_width)
+        buf->max_width = max_len;
+
+    buf->mem_size += buf->file_size +
+        sbcount(buf->lines) * sizeof(buf->lines[0]) +
+        sbcount(buf->line_offsets) * sizeof(buf->line_offsets[0]);
+}
+
+/* Returns the highlight cache directory, or NULL if the cache is off */
+static const char *highlight_cache_dir(void)
+{
+    static char dir[FSUTIL_PATH_MAX];
+
+    if (!cgdbrc_get_int(CGDBRC_HIGHLIGHTCACHE) || !cgdb_home_dir[0])
+        return NULL;
+
+    if (!dir[0] && fs_util_create_dir_in_base(cgdb_home_dir, "hlcache"))
+        fs_util_get_path(cgdb_home_dir, "hlcache", dir);
+
+    return dir[0] ? dir : NULL;
+}
+
+static void highlight_cache_key(struct buffer *buf, const char *path,
+    struct hl_cache_key *key)
+{
+    key->path = path;
+    key->file_size = buf->file_size;
+    key->file_mtime = buf->file_mtime;
+    key->tabstop = buf->tabstop;
+    key->synmaxcol = buf->synmaxcol;
+    key->language = buf->language;
+}
+
+/**
+ * Load the line offset index of a file from the highlight cache.
+ *
+ * \param buf
+ * struct buffer pointer with file_data, file_size and file_mtime set
+ *
+ * \param path
+ * Full path to the file
+ *
+ * \return
+ * 0 on success, -1 if the file isn't in the cache.
+ */
+static int highlight_cache_load_index(struct buffer *buf, const char *path)
+{
+    struct hl_cache_key key;
+    struct hl_cache_entry entry;
+    const char *dir = highlight_cache_dir();
+
+    if (!dir || buf->file_size < HL_CACHE_MIN_FILE_SIZE)
+        return -1;
+
+    highlight_cache_key(buf, path, &key);
+    if (hl_cache_load(dir, &key, &entry))
+        return -1;
+
+    if (entry.line_count <= 0 ||
+        entry.line_offsets[entry.line_count] != buf->file_size)
+    {
+        hl_cache_release(&entry);
+        return -1;
+    }
+
+    sbsetcount(buf->lines, entry.line_count);
+    memset(buf->lines, 0, entry.line_count * sizeof(buf->lines[0]));
+
+    sbsetcount(buf->line_offsets, entry.line_count + 1);
+    memcpy(buf->line_offsets, entry.line_offsets,
+        (entry.line_count + 1) * sizeof(buf->line_offsets[0]));
+
+    buf->max_width = entry.max_width;
+    buf->mem_size += buf->file_size +
+        sbcount(buf->lines) * sizeof(buf->lines[0]) +
+        sbcount(buf->line_offsets) * sizeof(buf->line_offsets[0]);
+
+    hl_cache_release(&entry);
+    return 0;
+}
+
+/**
+ * Load the highlight runs of a file from the highlight cache.
+ *
+ * \param node
+ * The list node to load the runs for, with its file loaded and language set
+ *
+ * \return
+ * 0 on success, -1 if the file isn't in the cache.
+ */
+static int highlight_cache_load_runs(struct list_node *node)
+{
+    struct hl_cache_key key;
+    struct hl_cache_entry entry;
+    struct buffer *buf = &node->file_buf;
+    const char *dir = highlight_cache_dir();
+
+    if (!dir || !buf->file_data || buf->file_size < HL_CACHE_MIN_FILE_SIZE)
+        return -1;
+
+    highlight_cache_key(buf, node->path, &key);
+    if (hl_cache_load(dir, &key, &entry))
+        return -1;
+
+    if (!entry.hl_offsets || entry.line_count != sbcount(buf->lines) ||
+        entry.hl_offsets[entry.line_count] != entry.run_count)
+    {
+        hl_cache_release(&entry);
+        return -1;
+    }
+
+    sbsetcount(buf->hl_runs, entry.run_count);
+    if (entry.run_count)
+        memcpy(buf->hl_runs, entry.hl_runs, entry.run_count * sizeof(buf->hl_runs[0]));
+
+    sbsetcount(buf->hl_offsets, entry.line_count + 1);
+    memcpy(buf->hl_offsets, entry.hl_offsets,
+        (entry.line_count + 1) * sizeof(buf->hl_offsets[0]));
+
+    if (entry.state_count)
+    {
+        sbsetcount(buf->hl_states, entry.state_count);
+        memcpy(buf->hl_states, entry.line_states,
+            entry.state_count * sizeof(buf->hl_states[0]));
+    }
+
+    buf->max_width = MAX(buf->max_width, entry.max_width);
+    buf->mem_size += sbcount(buf->hl_runs) * sizeof(buf->hl_runs[0]) +
+        sbcount(buf->hl_offsets) * sizeof(buf->hl_offsets[0]) +
+        sbcount(buf->hl_states) * sizeof(buf->hl_states[0]);
+
+    hl_cache_release(&entry);
+    return 0;
+}
+
+/**
+ * Save the line offset index and highlight runs of a file to the highlight
+ * cache, once it has been completely highlighted.
+ *
+ * \param node
+ * The list node to save
+ */
+static void highlight_cache_save(struct list_node *node)
+{
+    struct hl_cache_key key;
+    struct hl_cache_entry entry;
+    struct buffer *buf = &node->file_buf;
+    const char *dir;
+    int count = sbcount(buf->lines);
+
+    if (buf->hl_cached || !buf->file_data || buf->hl_line < count ||
+        buf->language == TOKENIZER_LANGUAGE_UNKNOWN ||
+        sbcount(buf->hl_offsets) != count + 1)
+        return;
+
+    /* Only try once per load */
+    buf->hl_cached = 1;
+
+    dir = highlight_cache_dir();
+    if (!dir || buf->file_size < HL_CACHE_MIN_FILE_SIZE)
+        return;
+
+    /* A file modified within the last couple of seconds could be modified
+     * again without its mtime changing, so don't trust it yet */
+    if (buf->file_mtime >= time(NULL) - 1)
+        return;
+
+    highlight_cache_key(buf, node->path, &key);
+
+    memset(&entry, 0, sizeof(entry));
+    entry.max_width = buf->max_width;
+    entry.line_count = count;
+    entry.line_offsets = buf->line_offsets;
+    entry.hl_offsets = buf->hl_offsets;
+    entry.hl_runs = buf->hl_runs;
+    entry.run_count = sbcount(buf->hl_runs);
+    entry.line_states = (const int *)buf->hl_states;
+    entry.state_count = sbcount(buf->hl_states);
+
+    if (!hl_cache_save(dir, &key, &entry))
+        hl_cache_trim(dir, (long)cgdbrc_get_int(CGDBRC_HIGHLIGHTCACHE) * 1024 * 1024);
 }
 
 /**
- * Load file and fill tlines line pointers.
+ * Load file and build the line offset index.
  *
  * \param buf
  * struct buffer pointer
@@ -293,12 +805,50 @@ static int load_file_buf(struct buffer *buf, const char *filename)
 {
     FILE *file;
     long file_size;
-    int ret = -1;
 
     /* Special buffer not backed by file */
     if (filename[0] == '*')
         return 0;
 
+    buf->tabstop = cgdbrc_get_int(CGDBRC_TABSTOP);
+    buf->synmaxcol = cgdbrc_get_int(CGDBRC_SYNMAXCOL);
+
+#if HAVE_SYS_MMAN_H
+    {
+        struct stat st;
+        int fd = open(filename, O_RDONLY);
+
+        if (fd == -1)
+            return -1;
+
+        /* Map regular files in. Pages are only read from disk when a line
+         * is displayed, searched or highlighted. */
+        if (!fstat(fd, &st) && S_ISREG(st.st_mode) && (st.st_size > 0))
+        {
+            void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (data != MAP_FAILED)
+            {
+                buf->file_data = (char *)data;
+                buf->file_size = st.st_size;
+                buf->file_mtime = st.st_mtime;
+                buf->file_ino = st.st_ino;
+                buf->file_mapped = 1;
+                mapped_file_add(buf->file_data, buf->file_size);
+            }
+        }
+
+        close(fd);
+
+        if (buf->file_mapped)
+        {
+            if (highlight_cache_load_index(buf, filename))
+                index_file_buf(buf);
+            return 0;
+        }
+    }
+#endif
+
     file = fopen(filename, "r");
     if (!file)
         return -1;
@@ -326,57 +876,89 @@ static int load_file_buf(struct buffer *buf, const char *filename)
 
         /* Zero terminate buffer */
         buf->file_data[bytes_read] = 0;
-
-        /* Convert tabs to spaces */
-        buf->tabstop = cgdbrc_get_int(CGDBRC_TABSTOP);
-        buf->file_data = detab_buffer(buf->file_data, buf->tabstop);
+        buf->file_size = bytes_read;
 
         {
-            char *line_start = buf->file_data;
-            char *line_feed = strchr(line_start, '\n');
+            struct stat st;
 
-            while (line_feed)
+            if (!fstat(fileno(file), &st))
             {
-                size_t line_len;
-                char *line_end = line_feed;
+                buf->file_mtime = st.st_mtime;
+                buf->file_ino = st.st_ino;
+            }
+        }
 
-                /* Trim trailing cr-lfs */
-                while (line_end >= line_start && (*line_end == '\n' || *line_end == '\r'))
-                    line_end--;
+        if (highlight_cache_load_index(buf, filename))
+            index_file_buf(buf);
+    }
 
-                /* Update max length string found */
-                line_len = line_end - line_start + 1;
-                if (line_len > buf->max_width)
-                    buf->max_width = line_len;
+    fclose(file);
+    return buf->file_data ? 0 : -1;
+}
 
-                struct source_line sline;
-                sline.line = line_start;
-                sline.len = line_len;
-                sline.attrs = NULL;
+#if HAVE_SYS_INOTIFY_H
+/* Returns 1 if a node other than node uses watch descriptor wd */
+static int source_watch_shared(struct sviewer *sview, struct list_node *node, int wd)
+{
+    struct list_node *cur;
 
-                /* Add this line to lines array */
-                sbpush(buf->lines, sline);
+    for (cur = sview->list_head; cur; cur = cur->next)
+    {
+        if (cur != node && cur->watch_wd == wd)
+            return 1;
+    }
 
-                line_start = line_feed + 1;
-                line_feed = strchr(line_start, '\n');
-            }
+    return 0;
+}
+#endif
 
-            if (*line_start)
-            {
-                struct source_line sline;
-                sline.line = line_start;
-                sline.len = strlen(line_start);
-                sline.attrs = NULL;
+/**
+ * Stop watching a node's file for changes.
+ *
+ * \param sview
+ * The source viewer object
+ *
+ * \param node
+ * The node to stop watching
+ */
+static void source_unwatch_node(struct sviewer *sview, struct list_node *node)
+{
+#if HAVE_SYS_INOTIFY_H
+    /* Paths which link to the same file share a watch */
+    if (node->watch_wd != -1 && !source_watch_shared(sview, node, node->watch_wd))
+        inotify_rm_watch(sview->watch_fd, node->watch_wd);
+#endif
 
-                sbpush(buf->lines, sline);
-            }
+    node->watch_wd = -1;
+}
 
-            ret = 0;
-        }
-    }
+/**
+ * Watch a node's file for changes. If the file was replaced since it was
+ * last watched, the watch on the old file is removed.
+ *
+ * \param sview
+ * The source viewer object
+ *
+ * \param node
+ * The node to watch
+ */
+static void source_watch_node(struct sviewer *sview, struct list_node *node)
+{
+#if HAVE_SYS_INOTIFY_H
+    int wd;
 
-    fclose(file);
-    return ret;
+    /* Buffers not backed by a file */
+    if (sview->watch_fd == -1 || node->path[0] == '*')
+        return;
+
+    wd = inotify_add_watch(sview->watch_fd, node->path,
+        IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVE_SELF | IN_DELETE_SELF);
+
+    if (wd != node->watch_wd)
+        source_unwatch_node(sview, node);
+
+    node->watch_wd = wd;
+#endif
 }
 
 /* load_file:  Loads the file in the list_node into its memory buffer.
@@ -386,7 +968,7 @@ static int load_file_buf(struct buffer *buf, const char *filename)
  *
  * Return Value:  Zero on success, non-zero on error.
  */
-static int load_file(struct list_node *node)
+static int load_file(struct sviewer *sview, struct list_node *node)
 {
     /* No node pointer? */
     if (!node)
@@ -400,6 +982,14 @@ static int load_file(struct list_node *node)
     if (get_timestamp(node->path, &(node->last_modification)) == -1)
         return -1;
 
+    /* Watch for changes before reading, so none are missed */
+    node->file_changed = 0;
+    source_watch_node(sview, node);
+
+    /* Nothing drawn from an earlier load of the file is still good */
+    if (sview->frame.node == node)
+        sview->frame.node = NULL;
+
     node->language = tokenizer_get_default_file_type(strrchr(node->path, '.'));
 
     /* Add the highlighted lines */
@@ -461,108 +1051,732 @@ static enum hl_group_kind hlg_from_tokenizer_type(enum tokenizer_type type, cons
     }
 }
 
-static int highlight_node(struct list_node *node)
+/**
+ * Replace the highlight runs for a range of lines in a buffer.
+ *
+ * The runs for all lines are kept in one packed array, so the runs after
+ * the range are moved up or down to make room for the new ones.
+ *
+ * \param buf
+ * struct buffer pointer
+ *
+ * \param start
+ * The first line to replace runs for
+ *
+ * \param end
+ * One past the last line to replace runs for
+ *
+ * \param runs
+ * Stretch buffer of packed runs for the lines
+ *
+ * \param offsets
+ * Stretch buffer of end - start + 1 offsets into runs, one per line
+ * plus a sentinel
+ */
+static void buffer_set_runs(struct buffer *buf, int start, int end,
+    const uint32_t *runs, const int *offsets)
+{
+    int i;
+    int old_start, old_end;
+    int delta;
+    int total = sbcount(buf->hl_runs);
+
+    buf->mem_size -= sbcount(buf->hl_runs) * sizeof(buf->hl_runs[0]) +
+        sbcount(buf->hl_offsets) * sizeof(buf->hl_offsets[0]);
+
+    /* Lines past the end of hl_offsets have no runs */
+    if (!buf->hl_offsets)
+        sbpush(buf->hl_offsets, 0);
+    while (sbcount(buf->hl_offsets) < end + 1)
+        sbpush(buf->hl_offsets, total);
+
+    old_start = buf->hl_offsets[start];
+    old_end = buf->hl_offsets[end];
+    delta = sbcount(runs) - (old_end - old_start);
+
+    if (delta > 0)
+        sbsetcount(buf->hl_runs, total + delta);
+    if (delta)
+    {
+        memmove(buf->hl_runs + old_end + delta, buf->hl_runs + old_end,
+            (total - old_end) * sizeof(buf->hl_runs[0]));
+    }
+    if (delta < 0)
+        sbsetcount(buf->hl_runs, total + delta);
+
+    if (sbcount(runs))
+        memcpy(buf->hl_runs + old_start, runs, sbcount(runs) * sizeof(runs[0]));
+
+    for (i = start + 1; i <= end; i++)
+        buf->hl_offsets[i] = old_start + offsets[i - start];
+    if (delta)
+    {
+        for (; i < sbcount(buf->hl_offsets); i++)
+            buf->hl_offsets[i] += delta;
+    }
+
+    buf->mem_size += sbcount(buf->hl_runs) * sizeof(buf->hl_runs[0]) +
+        sbcount(buf->hl_offsets) * sizeof(buf->hl_offsets[0]);
+}
+
+/**
+ * Get the highlight attributes for a line, ready for hl_printline.
+ *
+ * \param buf
+ * struct buffer pointer
+ *
+ * \param line
+ * The line to get attributes for
+ *
+ * \param attrs
+ * Stretch buffer the attributes are stored in. It's emptied first so it
+ * can be reused from line to line.
+ *
+ * \return
+ * attrs, or NULL if the line has no highlighting.
+ */
+static struct hl_line_attr *buffer_get_line_attrs(struct buffer *buf,
+    int line, struct hl_line_attr **attrs)
 {
     int i;
+
+    if (*attrs)
+        sbsetcount(*attrs, 0);
+
+    if (line + 1 >= sbcount(buf->hl_offsets))
+        return NULL;
+
+    for (i = buf->hl_offsets[line]; i < buf->hl_offsets[line + 1]; i++)
+    {
+        struct hl_line_attr line_attr;
+
+        line_attr.col = HL_RUN_COL(buf->hl_runs[i]);
+        hl_groups_get_attr(hl_groups_instance,
+            HL_RUN_KIND(buf->hl_runs[i]), &line_attr.attr);
+
+        sbpush(*attrs, line_attr);
+    }
+
+    return sbcount(*attrs) ? *attrs : NULL;
+}
+
+/* Returns 1 if line is longer than the buffer's synmaxcol */
+static int highlight_line_is_long(struct buffer *buf, int line)
+{
+    return buf->synmaxcol > 0 &&
+        buf->line_offsets[line + 1] - buf->line_offsets[line] > buf->synmaxcol;
+}
+
+/**
+ * Highlight a range of lines from the file data of a buffer.
+ *
+ * Tokens never span lines, so the tokenizer can be started at any line
+ * as long as it's given the lexer state that line begins in. Lines longer
+ * than synmaxcol are only tokenized that far, the rest of the line is left
+ * unhighlighted and the line after it starts in the state it started in.
+ *
+ * \param buf
+ * struct buffer pointer with file_data set
+ *
+ * \param start
+ * The first line to highlight
+ *
+ * \param end
+ * One past the last line to highlight
+ *
+ * \param state
+ * The tokenizer state line start begins in
+ *
+ * \param states
+ * If not NULL, the lines after start which don't begin in the initial
+ * state are appended to this stretchy buffer
+ *
+ * \return
+ * The tokenizer state line end begins in.
+ */
+static int highlight_lines(struct buffer *buf, int start, int end, int state,
+    struct source_line_state **states)
+{
+    int line = start;
+    struct token_data tok_data;
+    struct tokenizer *t = tokenizer_init();
+    uint32_t *runs = NULL;
+    int *offsets = NULL;
+
+    sbpush(offsets, 0);
+
+    while (line < end)
+    {
+        int length = 0;
+        int lasttype = -1;
+        int is_long = highlight_line_is_long(buf, line);
+        int seg_end = line + 1;
+        long offset = buf->line_offsets[line];
+        long len;
+
+        /* Tokenize the lines up to the next long line in one go, or
+         * the start of the long line */
+        if (is_long)
+        {
+            len = buf->synmaxcol;
+        }
+        else
+        {
+            while (seg_end < end && !highlight_line_is_long(buf, seg_end))
+                seg_end++;
+            len = buf->line_offsets[seg_end] - offset;
+        }
+
+        /* Tokenize the raw file data. Tabs are expanded when calculating
+         * the attribute columns so they line up with materialized lines. */
+        tokenizer_set_buffer_len(t, buf->file_data + offset, len, buf->language);
+        tokenizer_set_start_state(t, state);
+
+        while (line < seg_end && tokenizer_get_token(t, &tok_data) > 0)
+        {
+            if (tok_data.e == TOKENIZER_NEWLINE)
+            {
+                /* Lines are only split on line feeds, a lone carriage
+                 * return stays part of the line */
+                if (!strchr(tok_data.data, '\n'))
+                {
+                    length = advance_column(tok_data.data, length, buf->tabstop);
+                    continue;
+                }
+
+                if (length > buf->max_width)
+                    buf->max_width = length;
+
+                sbpush(offsets, sbcount(runs));
+
+                length = 0;
+                lasttype = -1;
+                line++;
+
+                if (states)
+                {
+                    struct source_line_state line_state;
+
+                    line_state.line = line;
+                    line_state.state = tokenizer_get_start_state(t);
+
+                    if (line_state.state)
+                        sbpush(*states, line_state);
+                }
+            }
+            else
+            {
+                enum hl_group_kind hlg = hlg_from_tokenizer_type(tok_data.e, tok_data.data);
+
+                if (hlg == HLG_LAST)
+                {
+                    clog_error(CLOG_CGDB, "Bad hlg_type for '%s', e==%d\n", tok_data.data, tok_data.e);
+                    hlg = HLG_TEXT;
+                }
+
+                /* Add run if highlight group has changed */
+                if (lasttype != hlg)
+                {
+                    sbpush(runs, HL_RUN(length, hlg));
+                    lasttype = hlg;
+                }
+
+                /* Add the text and bump our length */
+                length = advance_column(tok_data.data, length, buf->tabstop);
+            }
+        }
+
+        if (is_long)
+        {
+            /* Draw the rest of the long line as plain text */
+            if (lasttype != HLG_TEXT)
+                sbpush(runs, HL_RUN(length, HLG_TEXT));
+
+            line++;
+
+            if (states && state)
+            {
+                struct source_line_state line_state;
+
+                line_state.line = line;
+                line_state.state = state;
+                sbpush(*states, line_state);
+            }
+        }
+        else
+        {
+            state = tokenizer_get_start_state(t);
+        }
+
+        /* Last line may not end in a line feed */
+        while (sbcount(offsets) < seg_end - start + 1)
+            sbpush(offsets, sbcount(runs));
+        line = seg_end;
+    }
+
+    buffer_set_runs(buf, start, end, runs, offsets);
+
+    sbfree(runs);
+    sbfree(offsets);
+
+    tokenizer_destroy(t);
+    return state;
+}
+
+/* Returns 1 if buf has lines which still need to be highlighted */
+static int highlight_pending(struct buffer *buf)
+{
+    return sources_syntax_on && buf->file_data &&
+        (buf->language != TOKENIZER_LANGUAGE_UNKNOWN) &&
+        (buf->hl_line < sbcount(buf->lines));
+}
+
+/**
+ * Highlight the final lexer state forward from hl_line up to line end.
+ *
+ * \param buf
+ * struct buffer pointer
+ *
+ * \param end
+ * One past the last line to highlight
+ *
+ * \return
+ * 1 if lines with provisional highlighting were updated, 0 otherwise.
+ */
+static int highlight_advance(struct buffer *buf, int end)
+{
+    int start = buf->hl_line;
+    int updated;
+    int count;
+
+    end = MIN(end, sbcount(buf->lines));
+    if (start >= end)
+        return 0;
+
+    /* Forget any start states recorded past hl_line */
+    buf->mem_size -= sbcount(buf->hl_states) * sizeof(buf->hl_states[0]);
+    for (count = sbcount(buf->hl_states); count > 0; count--)
+    {
+        if (buf->hl_states[count - 1].line <= start)
+            break;
+    }
+    if (buf->hl_states)
+        sbsetcount(buf->hl_states, count);
+
+    buf->hl_state = highlight_lines(buf, start, end, buf->hl_state, &buf->hl_states);
+    buf->mem_size += sbcount(buf->hl_states) * sizeof(buf->hl_states[0]);
+    buf->hl_line = end;
+
+    /* Lines highlighted from a guessed state have now been redone */
+    updated = (start < buf->hl_prov_end) && (end > buf->hl_prov_start);
+    if (buf->hl_line >= buf->hl_prov_end)
+        buf->hl_prov_start = buf->hl_prov_end = 0;
+
+    return updated;
+}
+
+/**
+ * Make sure the lines in a view have highlighting attributes. If the view
+ * is close to where background highlighting has gotten to, we highlight
+ * up to it. Otherwise the view is highlighted provisionally starting in the
+ * initial lexer state, and redone when background highlighting reaches it.
+ *
+ * \param buf
+ * struct buffer pointer
+ *
+ * \param start
+ * The first line in the view
+ *
+ * \param end
+ * One past the last line in the view
+ */
+static void highlight_view(struct buffer *buf, int start, int end)
+{
+    start = MAX(start, 0);
+    end = MIN(end, sbcount(buf->lines));
+
+    if (!highlight_pending(buf) || (end <= buf->hl_line))
+        return;
+
+    /* Already highlighted provisionally */
+    if (start >= buf->hl_prov_start && end <= buf->hl_prov_end)
+        return;
+
+    if (start - HL_VIEW_MARGIN <= buf->hl_line)
+    {
+        highlight_advance(buf, end + HL_VIEW_MARGIN);
+    }
+    else
+    {
+        start = MAX(start - HL_VIEW_MARGIN, buf->hl_line);
+        end = MIN(end + HL_VIEW_MARGIN, sbcount(buf->lines));
+
+        highlight_lines(buf, start, end, 0, NULL);
+
+        /* Grow the provisional range if this view touches it */
+        if (start <= buf->hl_prov_end && end >= buf->hl_prov_start &&
+            buf->hl_prov_start != buf->hl_prov_end)
+        {
+            buf->hl_prov_start = MIN(start, buf->hl_prov_start);
+            buf->hl_prov_end = MAX(end, buf->hl_prov_end);
+        }
+        else
+        {
+            buf->hl_prov_start = start;
+            buf->hl_prov_end = end;
+        }
+    }
+}
+
+static int highlight_node(struct list_node *node)
+{
     int ret;
     int line = 0;
     int length = 0;
     int lasttype = -1;
     struct token_data tok_data;
-    struct tokenizer *t = tokenizer_init();
     struct buffer *buf = &node->file_buf;
 
-    for (i = 0; i < sbcount(buf->lines); i++)
+    buf->mem_size -= sbcount(buf->hl_runs) * sizeof(buf->hl_runs[0]) +
+        sbcount(buf->hl_offsets) * sizeof(buf->hl_offsets[0]) +
+        sbcount(buf->hl_states) * sizeof(buf->hl_states[0]);
+
+    sbfree(buf->hl_runs);
+    buf->hl_runs = NULL;
+
+    sbfree(buf->hl_offsets);
+    buf->hl_offsets = NULL;
+
+    sbfree(buf->hl_states);
+    buf->hl_states = NULL;
+
+    /* Files are highlighted as they're displayed and in the background
+     * from the main loop. See highlight_view and source_highlight_step. */
+    buf->hl_line = 0;
+    buf->hl_state = 0;
+    buf->hl_prov_start = 0;
+    buf->hl_prov_end = 0;
+    buf->hl_cached = 0;
+
+    /* Files highlighted in an earlier session may be in the cache */
+    if (!highlight_cache_load_runs(node))
     {
-        sbfree(buf->lines[i].attrs);
-        buf->lines[i].attrs = NULL;
+        buf->hl_line = sbcount(buf->lines);
+        buf->hl_cached = 1;
     }
+    else if (!buf->file_data && sbcount(buf->lines))
+    {
+        uint32_t *runs = NULL;
+        int *offsets = NULL;
+        struct tokenizer *t = tokenizer_init();
+
+        sbpush(offsets, 0);
+
+        for (line = 0; line < sbcount(buf->lines); line++)
+        {
+            struct source_line *sline = &buf->lines[line];
+
+            tokenizer_set_buffer(t, sline->line, buf->language);
+
+            length = 0;
+            lasttype = -1;
+            while ((ret = tokenizer_get_token(t, &tok_data)) > 0)
+            {
+                if (tok_data.e == TOKENIZER_NEWLINE)
+                    break;
+
+                enum hl_group_kind hlg = hlg_from_tokenizer_type(tok_data.e, tok_data.data);
+
+                /* Add run if highlight group has changed */
+                if (lasttype != hlg)
+                {
+                    sbpush(runs, HL_RUN(length, hlg));
+                    lasttype = hlg;
+                }
+
+                /* Add the text and bump our length */
+                length += strlen(tok_data.data);
+            }
+
+            sbpush(offsets, sbcount(runs));
+        }
+
+        tokenizer_destroy(t);
+
+        buffer_set_runs(buf, 0, sbcount(buf->lines), runs, offsets);
+
+        sbfree(runs);
+        sbfree(offsets);
+    }
+
+    return 0;
+}
+
+/* Mix an int into a 32 bit FNV-1a hash */
+static uint32_t hash_int(uint32_t hash, int value)
+{
+    int i;
+
+    for (i = 0; i < 4; i++)
+    {
+        hash ^= (value >> (i * 8)) & 0xff;
+        hash *= 16777619;
+    }
+
+    return hash;
+}
+
+/**
+ * Make the match index of a buffer be for the current search regex. If the
+ * regex changed, the matches found so far are thrown away.
+ *
+ * \param sview
+ * The source viewer
+ *
+ * \param buf
+ * The buffer
+ *
+ * \return
+ * The regex generation, or 0 if there is no regex.
+ */
+static int match_index_sync(struct sviewer *sview, struct buffer *buf)
+{
+    int gen = hl_regex_generation(sview->hlregex);
+
+    if (buf->match_gen != gen)
+    {
+        buf->mem_size -= sbcount(buf->matches) * sizeof(buf->matches[0]);
+        sbfree(buf->matches);
+        buf->matches = NULL;
+        buf->match_gen = gen;
+        buf->match_line = 0;
+        buf->match_full = 0;
+    }
+
+    return gen;
+}
+
+/**
+ * Search lines from match_line up to end and add their matches to the
+ * match index.
+ *
+ * \param sview
+ * The source viewer, with the regex the index is for
+ *
+ * \param buf
+ * The buffer
+ *
+ * \param end
+ * One past the last line to search
+ */
+static void match_index_advance(struct sviewer *sview, struct buffer *buf, int end)
+{
+    int *cols = NULL;
+
+    end = MIN(end, sbcount(buf->lines));
+
+    buf->mem_size -= sbcount(buf->matches) * sizeof(buf->matches[0]);
+
+    while (buf->match_line < end && !buf->match_full)
+    {
+        int i;
+        struct source_line *sline = buffer_get_line(buf, buf->match_line);
+
+        if (cols)
+            sbsetcount(cols, 0);
+
+        hl_regex_find_all(&sview->hlregex, sline->line, sline->len, &cols);
+
+        if (sbcount(buf->matches) + sbcount(cols) / 2 > MATCH_INDEX_MAX)
+        {
+            buf->match_full = 1;
+            break;
+        }
+
+        for (i = 0; i < sbcount(cols); i += 2)
+        {
+            struct source_match match;
+
+            match.line = buf->match_line;
+            match.start = cols[i];
+            match.end = cols[i + 1];
+            sbpush(buf->matches, match);
+        }
+
+        buf->match_line++;
+    }
+
+    buf->mem_size += sbcount(buf->matches) * sizeof(buf->matches[0]);
+
+    sbfree(cols);
+}
+
+/* Returns the index of the first match on or after line */
+static int match_index_lower_bound(struct buffer *buf, int line)
+{
+    int lo = 0;
+    int hi = sbcount(buf->matches);
+
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+
+        if (buf->matches[mid].line < line)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/**
+ * Find the first or last line with a match in a range of lines. Lines
+ * close to what the match index covers are added to it, lines far past
+ * it are searched directly.
+ *
+ * \param sview
+ * The source viewer, with the regex to search for
+ *
+ * \param buf
+ * The buffer, its match index synced with match_index_sync
+ *
+ * \param lo
+ * The first line to look at
+ *
+ * \param hi
+ * One past the last line to look at
+ *
+ * \param direction
+ * 1 to find the first line with a match, 0 to find the last
+ *
+ * \return
+ * The line, or -1 if no line in the range has a match.
+ */
+static int match_index_find(struct sviewer *sview, struct buffer *buf,
+    int lo, int hi, int direction)
+{
+    int i;
+    int start, end;
+    const char *regex = hl_regex_get(sview->hlregex);
 
-    if (!buf->file_data)
+    if (direction)
     {
-        for (line = 0; line < sbcount(buf->lines); line++)
+        for (;;)
         {
-            struct source_line *sline = &buf->lines[line];
+            i = match_index_lower_bound(buf, lo);
+            if (i < sbcount(buf->matches) && buf->matches[i].line < hi)
+                return buf->matches[i].line;
 
-            tokenizer_set_buffer(t, sline->line, buf->language);
+            if (buf->match_line >= hi)
+                return -1;
 
-            length = 0;
-            lasttype = -1;
-            while ((ret = tokenizer_get_token(t, &tok_data)) > 0)
-            {
-                if (tok_data.e == TOKENIZER_NEWLINE)
-                    break;
+            if (buf->match_full || lo > buf->match_line + MATCH_STEP_LINES)
+                break;
 
-                enum hl_group_kind hlg = hlg_from_tokenizer_type(tok_data.e, tok_data.data);
+            match_index_advance(sview, buf, buf->match_line + MATCH_STEP_LINES);
+        }
 
-                /* Add attribute if highlight group has changed */
-                if (lasttype != hlg)
-                {
-                    struct hl_line_attr line_attr;
+        for (i = MAX(lo, buf->match_line); i < hi; i++)
+        {
+            struct source_line *sline = buffer_get_line(buf, i);
 
-                    line_attr.col = length;
-                    hl_groups_get_attr(hl_groups_instance, hlg, &line_attr.attr);
+            /* Search what the index would, without a car return */
+            if (hl_regex_search_len(&sview->hlregex, sline->line, sline->len,
+                    regex, -1, &start, &end) > 0)
+                return i;
+        }
 
-                    sbpush(buf->lines[line].attrs, line_attr);
+        return -1;
+    }
 
-                    lasttype = hlg;
-                }
+    if (!buf->match_full && hi <= buf->match_line + MATCH_STEP_LINES)
+        match_index_advance(sview, buf, hi);
 
-                /* Add the text and bump our length */
-                length += strlen(tok_data.data);
-            }
-        }
-    }
-    else
+    for (i = hi - 1; i >= MAX(lo, buf->match_line); i--)
     {
-        if (tokenizer_set_buffer(t, buf->file_data, buf->language) == -1)
-        {
-            if_print_message("%s:%d tokenizer_set_buffer error", __FILE__, __LINE__);
-            return -1;
-        }
+        struct source_line *sline = buffer_get_line(buf, i);
 
-        while ((ret = tokenizer_get_token(t, &tok_data)) > 0)
-        {
-            if (tok_data.e == TOKENIZER_NEWLINE)
-            {
-                if (length > buf->max_width)
-                    buf->max_width = length;
+        if (hl_regex_search_len(&sview->hlregex, sline->line, sline->len,
+                regex, -1, &start, &end) > 0)
+            return i;
+    }
 
-                length = 0;
-                lasttype = -1;
-                line++;
-            }
-            else
-            {
-                enum hl_group_kind hlg = hlg_from_tokenizer_type(tok_data.e, tok_data.data);
+    i = match_index_lower_bound(buf, MIN(hi, buf->match_line)) - 1;
+    if (i >= 0 && buf->matches[i].line >= lo)
+        return buf->matches[i].line;
 
-                if (hlg == HLG_LAST)
-                {
-                    clog_error(CLOG_CGDB, "Bad hlg_type for '%s', e==%d\n", tok_data.data, tok_data.e);
-                    hlg = HLG_TEXT;
-                }
+    return -1;
+}
 
-                /* Add attribute if highlight group has changed */
-                if (lasttype != hlg)
-                {
-                    struct hl_line_attr line_attr;
+/**
+ * Get the search highlighting of a line from the match index.
+ *
+ * \param buf
+ * The buffer
+ *
+ * \param line
+ * The line, before match_line
+ *
+ * \param search_attr
+ * The attribute to draw matches with
+ *
+ * \param attrs
+ * Stretchy buffer the attributes are put in
+ *
+ * \return
+ * A hash of the matches on the line.
+ */
+static uint32_t match_index_line_attrs(struct buffer *buf, int line,
+    int search_attr, struct hl_line_attr **attrs)
+{
+    int i;
+    uint32_t hash = 2166136261u;
 
-                    line_attr.col = length;
-                    hl_groups_get_attr(hl_groups_instance, hlg, &line_attr.attr);
+    if (*attrs)
+        sbsetcount(*attrs, 0);
 
-                    sbpush(buf->lines[line].attrs, line_attr);
+    for (i = match_index_lower_bound(buf, line);
+         i < sbcount(buf->matches) && buf->matches[i].line == line; i++)
+    {
+        struct hl_line_attr line_attr;
 
-                    lasttype = hlg;
-                }
+        line_attr.attr = search_attr;
+        line_attr.col = buf->matches[i].start;
+        sbpush(*attrs, line_attr);
 
-                /* Add the text and bump our length */
-                length += strlen(tok_data.data);
-            }
-        }
+        line_attr.attr = 0;
+        line_attr.col = buf->matches[i].end;
+        sbpush(*attrs, line_attr);
+
+        hash = hash_int(hash_int(hash, line_attr.col), buf->matches[i].start);
     }
 
-    tokenizer_destroy(t);
-    return 0;
+    return hash;
+}
+
+/* Returns 1 if the match index of the current file is still being built */
+static int match_index_pending(struct sviewer *sview)
+{
+    struct buffer *buf = &sview->cur->file_buf;
+    int gen = hl_regex_generation(sview->hlregex);
+
+    return sview->regex_is_searching && gen && (buf->match_gen == gen) &&
+        !buf->match_full && (buf->match_line < sbcount(buf->lines));
+}
+
+/* Size the line flags of a node to the lines in its buffer. The file may
+ * have changed since they were made, so breakpoints are applied again when
+ * the node is displayed. */
+static void resize_line_flags(struct list_node *node)
+{
+    int count = sbcount(node->file_buf.lines);
+    int old_count = sbcount(node->lflags);
+
+    sbsetcount(node->lflags, count);
+    if (count > old_count)
+        memset(node->lflags + old_count, 0, (count - old_count) * sizeof(node->lflags[0]));
+    node->bp_gen = -1;
 }
 
 int source_highlight(struct list_node *node)
@@ -570,9 +1784,10 @@ int source_highlight(struct list_node *node)
     int do_color = sources_syntax_on &&
         (node->language != TOKENIZER_LANGUAGE_UNKNOWN) &&
         swin_has_colors();
+    int load = !sbcount(node->file_buf.lines);
 
     /* Load the entire file */
-    if (!sbcount(node->file_buf.lines))
+    if (load)
         load_file_buf(&node->file_buf, node->path);
 
     /* If we're doing color and we haven't already loaded this file
@@ -584,13 +1799,14 @@ int source_highlight(struct list_node *node)
         highlight_node(node);
     }
 
-    /* Allocate the breakpoints array */
-    if (!node->lflags)
+    /* Allocate the breakpoints array. Files released by the source cache
+     * keep their line flags, but may have a different number of lines now. */
+    if (load || !node->lflags)
     {
-        int count = sbcount(node->file_buf.lines);
-        sbsetcount(node->lflags, count);
+        resize_line_flags(node);
 
-        memset(node->lflags, 0, sbcount(node->lflags));
+        if (node->file_buf.lines)
+            node->sel_line = MIN(node->sel_line, sbcount(node->file_buf.lines) - 1);
     }
 
     if (node->file_buf.lines)
@@ -599,6 +1815,56 @@ int source_highlight(struct list_node *node)
     return -1;
 }
 
+int source_highlight_pending(struct sviewer *sview)
+{
+    return sview && sview->cur &&
+        (highlight_pending(&sview->cur->file_buf) || match_index_pending(sview));
+}
+
+int source_highlight_step(struct sviewer *sview, int msecs)
+{
+    int updated = 0;
+    struct timeval start, now;
+    struct buffer *buf;
+
+    if (!source_highlight_pending(sview))
+        return 0;
+
+    buf = &sview->cur->file_buf;
+    gettimeofday(&start, NULL);
+
+    do
+    {
+        /* Highlighting first, then search matches */
+        if (highlight_pending(buf))
+            updated |= highlight_advance(buf, buf->hl_line + HL_STEP_LINES);
+        else
+            match_index_advance(sview, buf, buf->match_line + MATCH_STEP_LINES);
+
+        gettimeofday(&now, NULL);
+    } while (source_highlight_pending(sview) &&
+        ((now.tv_sec - start.tv_sec) * 1000 + (now.tv_usec - start.tv_usec) / 1000 < msecs));
+
+    highlight_cache_save(sview->cur);
+
+    return updated;
+}
+
+static int destroy_breakpoints_key(void *data)
+{
+    free(data);
+    return 0;
+}
+
+static int destroy_breakpoints_value(void *data)
+{
+    struct source_file_breakpoints *file_bps = (struct source_file_breakpoints *)data;
+
+    sbfree(file_bps->bps);
+    free(file_bps);
+    return 0;
+}
+
 struct sviewer *source_new()
 {
     struct sviewer *rv;
@@ -609,6 +1875,9 @@ struct sviewer *source_new()
     /* Initialize the structure */
     rv->cur = NULL;
     rv->list_head = NULL;
+    rv->node_index = std_hash_table_new(std_str_hash, std_str_equal);
+    rv->asm_nodes = NULL;
+    rv->asm_nodes_max_end = NULL;
 
     /* Initialize global marks */
     memset(rv->global_marks, 0, sizeof(rv->global_marks));
@@ -617,6 +1886,20 @@ struct sviewer *source_new()
 
     rv->addr_frame = 0;
 
+    rv->breakpoints = std_hash_table_new_full(std_str_hash, std_str_equal,
+        destroy_breakpoints_key, destroy_breakpoints_value);
+    rv->addr_breakpoints = NULL;
+    rv->breakpoints_gen = 0;
+
+    rv->display_count = 0;
+
+    rv->watch_fd = -1;
+#if HAVE_SYS_INOTIFY_H
+    rv->watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+
+    memset(&rv->frame, 0, sizeof(rv->frame));
+
     rv->regex_is_searching = 0;
     rv->hlregex = NULL;
 
@@ -637,6 +1920,9 @@ struct list_node *source_add(struct sviewer *sview, const char *path)
     init_file_buffer(&new_node->file_buf);
 
     new_node->lflags = NULL;
+    new_node->bp_lines = NULL;
+    new_node->bp_gen = -1;
+    new_node->last_display = 0;
     new_node->sel_line = 0;
     new_node->sel_col = 0;
     new_node->sel_rline = 0;
@@ -645,10 +1931,14 @@ struct list_node *source_add(struct sviewer *sview, const char *path)
     new_node->language = TOKENIZER_LANGUAGE_UNKNOWN;
     new_node->addr_start = 0;
     new_node->addr_end = 0;
+    new_node->watch_wd = -1;
+    new_node->file_changed = 0;
 
     /* Initialize all local marks to -1 */
     memset(new_node->local_marks, 0xff, sizeof(new_node->local_marks));
 
+    std_hash_table_insert(sview->node_index, new_node->path, new_node);
+
     if (sview->list_head == NULL)
     {
         /* List is empty, this is the first node */
@@ -679,6 +1969,60 @@ static uint64_t disassemble_parse_address(const char *line)
     return val;
 }
 
+/* Rebuild the running max of disassembly node end addresses from index i */
+static void source_update_asm_nodes_max_end(struct sviewer *sview, int i)
+{
+    sbsetcount(sview->asm_nodes_max_end, sbcount(sview->asm_nodes));
+
+    for (; i < sbcount(sview->asm_nodes); i++)
+    {
+        uint64_t addr_end = sview->asm_nodes[i]->addr_end;
+
+        if (i > 0 && sview->asm_nodes_max_end[i - 1] > addr_end)
+            addr_end = sview->asm_nodes_max_end[i - 1];
+        sview->asm_nodes_max_end[i] = addr_end;
+    }
+}
+
+/* Remove a node from the disassembly node index */
+static void source_remove_asmnode(struct sviewer *sview, struct list_node *node)
+{
+    int i;
+
+    for (i = 0; i < sbcount(sview->asm_nodes); i++)
+    {
+        if (sview->asm_nodes[i] == node)
+        {
+            memmove(&sview->asm_nodes[i], &sview->asm_nodes[i + 1],
+                (sbcount(sview->asm_nodes) - i - 1) * sizeof(sview->asm_nodes[0]));
+            sbsetcount(sview->asm_nodes, sbcount(sview->asm_nodes) - 1);
+
+            source_update_asm_nodes_max_end(sview, i);
+            break;
+        }
+    }
+}
+
+void source_set_asmnode_range(struct sviewer *sview, struct list_node *node,
+    uint64_t addr_start, uint64_t addr_end)
+{
+    int i;
+
+    source_remove_asmnode(sview, node);
+
+    node->addr_start = addr_start;
+    node->addr_end = addr_end;
+
+    /* Insert in addr_start order */
+    i = source_asm_nodes_upper_bound(sview, addr_start);
+    sbpush(sview->asm_nodes, node);
+    memmove(&sview->asm_nodes[i + 1], &sview->asm_nodes[i],
+        (sbcount(sview->asm_nodes) - i - 1) * sizeof(sview->asm_nodes[0]));
+    sview->asm_nodes[i] = node;
+
+    source_update_asm_nodes_max_end(sview, i);
+}
+
 void source_add_disasm_line(struct list_node *node, const char *line)
 {
     uint64_t addr;
@@ -689,15 +2033,33 @@ void source_add_disasm_line(struct list_node *node, const char *line)
     strcpy(sline.line, line);
     sline.line = detab_buffer(sline.line, node->file_buf.tabstop);
 
-    sline.attrs = NULL;
     sline.len = sbcount(sline.line);
 
     addr = disassemble_parse_address(line);
     sbpush(node->file_buf.addrs, addr);
 
+    /* Disassembly comes in address order, so this is almost always an
+     * append. Otherwise insert the line where it belongs. */
+    if (addr)
+    {
+        struct buffer *buf = &node->file_buf;
+        int i = sbcount(buf->addr_lines);
+
+        sbpush(buf->addr_lines, sbcount(buf->addrs) - 1);
+
+        for (; i > 0 && buf->addrs[buf->addr_lines[i - 1]] > addr; i--)
+        {
+            buf->addr_lines[i] = buf->addr_lines[i - 1];
+            buf->addr_lines[i - 1] = sbcount(buf->addrs) - 1;
+        }
+    }
+
     struct line_flags lf = { 0, 0 };
     sbpush(node->file_buf.lines, sline);
     sbpush(node->lflags, lf);
+
+    /* Apply breakpoints to the new line when next displayed */
+    node->bp_gen = -1;
 }
 
 int source_del(struct sviewer *sview, const char *path)
@@ -717,6 +2079,13 @@ int source_del(struct sviewer *sview, const char *path)
     if (cur == NULL)
         return 1; /* Node not found */
 
+    std_hash_table_remove(sview->node_index, cur->path);
+    source_remove_asmnode(sview, cur);
+    source_unwatch_node(sview, cur);
+
+    if (sview->frame.node == cur)
+        sview->frame.node = NULL;
+
     /* Release file buffers */
     release_file_buffer(&cur->file_buf);
 
@@ -727,6 +2096,9 @@ int source_del(struct sviewer *sview, const char *path)
     sbfree(cur->lflags);
     cur->lflags = NULL;
 
+    sbfree(cur->bp_lines);
+    cur->bp_lines = NULL;
+
     /* Remove link from list */
     if (cur == sview->list_head)
         sview->list_head = sview->list_head->next;
@@ -751,7 +2123,7 @@ int source_length(struct sviewer *sview, const char *path)
     struct list_node *cur = source_get_node(sview, path);
 
     /* Load the file if it's not already */
-    if (load_file(cur))
+    if (load_file(sview, cur))
         return -1;
 
     return sbcount(cur->file_buf.lines);
@@ -858,6 +2230,10 @@ int source_goto_mark(struct sviewer *sview, int key)
         node = (line >= 0) ? sview->cur : NULL;
     }
 
+    /* Reload the file if it was evicted from the source cache */
+    if (node && load_file(sview, node))
+        node = NULL;
+
     if (node)
     {
         sview->jump_back_mark.line = sview->cur->sel_line;
@@ -865,6 +2241,8 @@ int source_goto_mark(struct sviewer *sview, int key)
 
         sview->cur = node;
         source_set_sel_line(sview, line + 1);
+
+        source_cache_trim(sview);
         return 1;
     }
 
@@ -888,6 +2266,73 @@ static int get_line_leading_ws_count(const char *otext, int length)
     return column_offset;
 }
 
+/**
+ * Update the line flags of a node with the current breakpoints if they
+ * have changed since the last time it was displayed.
+ *
+ * \param sview
+ * The source viewer object
+ *
+ * \param node
+ * The node to apply breakpoints to
+ */
+static void source_apply_breakpoints(struct sviewer *sview, struct list_node *node)
+{
+    int i;
+    int count = sbcount(node->lflags);
+    struct source_file_breakpoints *file_bps;
+
+    if (node->bp_gen == sview->breakpoints_gen)
+        return;
+
+    /* Clear the breakpoints applied last time */
+    for (i = 0; i < sbcount(node->bp_lines); i++)
+    {
+        if (node->bp_lines[i] < count)
+            node->lflags[node->bp_lines[i]].breakpt = 0;
+    }
+    sbsetcount(node->bp_lines, 0);
+
+    file_bps = (struct source_file_breakpoints *)
+        std_hash_table_lookup(sview->breakpoints, node->path);
+    if (file_bps)
+    {
+        for (i = 0; i < sbcount(file_bps->bps); i++)
+        {
+            int line = file_bps->bps[i].line;
+
+            if (line > 0 && line <= count)
+            {
+                node->lflags[line - 1].breakpt = file_bps->bps[i].enabled ? 1 : 2;
+                sbpush(node->bp_lines, line - 1);
+            }
+        }
+    }
+
+    /* Disassembly buffers */
+    if (node->addr_start)
+    {
+        for (i = 0; i < sbcount(sview->addr_breakpoints); i++)
+        {
+            int line = -1;
+            uint64_t addr = sview->addr_breakpoints[i].addr;
+
+            if (addr >= node->addr_start && addr <= node->addr_end)
+            {
+                source_get_asmnode_line(node, addr, &line);
+
+                if (line >= 0 && line < count)
+                {
+                    node->lflags[line].breakpt = sview->addr_breakpoints[i].enabled ? 1 : 2;
+                    sbpush(node->bp_lines, line);
+                }
+            }
+        }
+    }
+
+    node->bp_gen = sview->breakpoints_gen;
+}
+
 static int draw_line_arrow(struct sviewer *sview, SWINDOW *win, int line, int arrow_attr)
 {
     int i;
@@ -901,7 +2346,7 @@ static int draw_line_arrow(struct sviewer *sview, SWINDOW *win, int line, int ar
     /* Get length of arrow if it's long */
     if (arrowstyle == ARROWSTYLE_LONG)
     {
-        struct source_line *sline = &sview->cur->file_buf.lines[line];
+        struct source_line *sline = buffer_get_line(&sview->cur->file_buf, line);
 
         arrow_length = get_line_leading_ws_count(sline->line, sline->len);
         arrow_length -= (sview->cur->sel_col + 1);
@@ -916,6 +2361,98 @@ static int draw_line_arrow(struct sviewer *sview, SWINDOW *win, int line, int ar
     return arrow_length;
 }
 
+/**
+ * Get a hash of the highlight runs of a line, to tell if the line has to
+ * be drawn again.
+ *
+ * \param buf
+ * The buffer
+ *
+ * \param line
+ * The line
+ *
+ * \return
+ * The hash.
+ */
+static uint32_t buffer_get_line_runs_key(struct buffer *buf, int line)
+{
+    int i;
+    uint32_t hash = 2166136261u;
+
+    if (line + 1 >= sbcount(buf->hl_offsets))
+        return hash;
+
+    for (i = buf->hl_offsets[line]; i < buf->hl_offsets[line + 1]; i++)
+        hash = hash_int(hash, buf->hl_runs[i]);
+
+    return hash;
+}
+
+static int source_row_equal(const struct source_row *a, const struct source_row *b)
+{
+    return a->valid && b->valid &&
+        a->line == b->line &&
+        a->text == b->text &&
+        a->len == b->len &&
+        a->runs_key == b->runs_key &&
+        a->attr == b->attr &&
+        a->draw_arrow == b->draw_arrow &&
+        a->mark_char == b->mark_char &&
+        a->search_key == b->search_key &&
+        !a->searched && !b->searched;
+}
+
+/**
+ * Make the last frame match what is about to be drawn. If the window,
+ * file or anything rows are drawn with changed, every row is drawn again.
+ * If the view only moved up or down, the rows still shown are scrolled
+ * into place and only the ones scrolled in are drawn.
+ */
+static void source_frame_update(struct source_frame *frame, SWINDOW *win,
+    struct list_node *node, int top, int width, int height, uint32_t key)
+{
+    int offset = top - frame->top;
+    size_t row_size = sizeof(frame->rows[0]);
+
+    if (frame->win != win || frame->node != node ||
+        frame->width != width || frame->height != height ||
+        frame->key != key || abs(offset) >= height)
+    {
+        /* Let curses use scroll regions when it sees lines move */
+        if (frame->win != win)
+            swin_idlok(win, 1);
+
+        frame->win = win;
+        frame->node = node;
+        frame->width = width;
+        frame->height = height;
+        frame->key = key;
+
+        sbsetcount(frame->rows, height);
+        memset(frame->rows, 0, height * row_size);
+    }
+    else if (offset > 0)
+    {
+        swin_scrollok(win, 1);
+        swin_wscrl(win, offset);
+        swin_scrollok(win, 0);
+
+        memmove(frame->rows, frame->rows + offset, (height - offset) * row_size);
+        memset(frame->rows + height - offset, 0, offset * row_size);
+    }
+    else if (offset < 0)
+    {
+        swin_scrollok(win, 1);
+        swin_wscrl(win, offset);
+        swin_scrollok(win, 0);
+
+        memmove(frame->rows - offset, frame->rows, (height + offset) * row_size);
+        memset(frame->rows, 0, -offset * row_size);
+    }
+
+    frame->top = top;
+}
+
 int source_display(struct sviewer *sview, SWINDOW *win, int focus, enum win_refresh dorefresh)
 {
     int i;
@@ -929,11 +2466,23 @@ int source_display(struct sviewer *sview, SWINDOW *win, int focus, enum win_refr
     int sellineno_attr;
     int enabled_bp_attr, disabled_bp_attr;
     int arrow_sel_attr, arrow_attr;
+    int searching, showmarks, has_colors;
+    int search_attr;
+    uint32_t key = 2166136261u;
+    struct buffer *buf;
+    struct source_frame *frame = &sview->frame;
+    struct hl_line_attr *line_attrs = NULL;
+    struct hl_line_attr *search_attrs = NULL;
+
+    /* Load a file that was truncated while it was mapped in again */
+    if (sview->cur && buffer_faulted(&sview->cur->file_buf))
+        source_reload(sview, sview->cur->path, 1);
 
     /* Check that a file is loaded */
     if (!sview->cur || !sview->cur->file_buf.lines)
     {
         logo_display(win);
+        frame->win = NULL;
 
         if (dorefresh == WIN_REFRESH)
             swin_wrefresh(win);
@@ -948,6 +2497,9 @@ int source_display(struct sviewer *sview, SWINDOW *win, int focus, enum win_refr
     hl_groups_get_attr(hl_groups_instance, HLG_DISABLED_BREAKPOINT, &disabled_bp_attr);
     hl_groups_get_attr(hl_groups_instance, HLG_ARROW, &arrow_attr);
     hl_groups_get_attr(hl_groups_instance, HLG_ARROW_SEL, &arrow_sel_attr);
+    hl_groups_get_attr(hl_groups_instance, HLG_SEARCH, &search_attr);
+
+    buf = &sview->cur->file_buf;
 
     /* Make sure cursor is visible */
     swin_curs_set(!!focus);
@@ -976,16 +2528,68 @@ int source_display(struct sviewer *sview, SWINDOW *win, int focus, enum win_refr
     snprintf(fmt, sizeof(fmt), "%%%dd", lwidth);
 
     arrow_selected_line = focus && cgdbrc_get_int(CGDBRC_ARROWSELECTEDLINE);
+    showmarks = cgdbrc_get_int(CGDBRC_SHOWMARKS);
+    has_colors = swin_has_colors();
+
+    /* Search matches are drawn over every row while searching */
+    searching = (sview->regex_is_searching == 1) ||
+        (sview->regex_is_searching == 2 && focus);
+
+    /* Remember when this file was last displayed for source_cache_trim */
+    sview->cur->last_display = ++sview->display_count;
+
+    /* Update breakpoint flags if breakpoints changed */
+    source_apply_breakpoints(sview, sview->cur);
+
+    /* Highlight the lines we're about to show if they haven't been yet */
+    highlight_view(&sview->cur->file_buf, line, line + height);
+    highlight_cache_save(sview->cur);
+
+    /* Search matches on the rows come from the match index, if it has
+     * reached them or is close to */
+    if (searching && match_index_sync(sview, buf) &&
+        !buf->match_full && line < buf->match_line + MATCH_STEP_LINES)
+        match_index_advance(sview, buf, line + height);
+
+    /* Everything rows are drawn with, other than the rows themselves */
+    key = hash_int(key, focus_attr);
+    key = hash_int(key, sellineno_attr);
+    key = hash_int(key, enabled_bp_attr);
+    key = hash_int(key, disabled_bp_attr);
+    key = hash_int(key, arrow_attr);
+    key = hash_int(key, arrow_sel_attr);
+    key = hash_int(key, lwidth);
+    key = hash_int(key, sview->cur->sel_col);
+    key = hash_int(key, cgdbrc_get_arrowstyle(CGDBRC_ARROWSTYLE));
+    key = hash_int(key, has_colors);
+    for (i = HLG_KEYWORD; i < HLG_LAST; i++)
+    {
+        int attr;
+
+        hl_groups_get_attr(hl_groups_instance, (enum hl_group_kind)i, &attr);
+        key = hash_int(key, attr);
+    }
+
+    source_frame_update(frame, win, sview->cur, line, width, height, key);
 
     for (i = 0; i < height; i++, line++)
     {
-        swin_wmove(win, i, 0);
+        struct source_row row;
+
+        memset(&row, 0, sizeof(row));
+        row.valid = 1;
 
         /* Outside of file, just draw the vertical line */
         if (line < 0 || line >= count)
         {
             int j;
 
+            row.line = -1;
+            if (source_row_equal(&row, &frame->rows[i]))
+                continue;
+
+            swin_wmove(win, i, 0);
+
             for (j = 1; j < lwidth; j++)
                 swin_waddch(win, ' ');
             swin_waddch(win, '~');
@@ -995,53 +2599,75 @@ int source_display(struct sviewer *sview, SWINDOW *win, int focus, enum win_refr
             swin_wattroff(win, focus_attr);
 
             swin_wclrtoeol(win);
+
+            row.cursor_x = swin_getcurx(win);
+            frame->rows[i] = row;
+            continue;
+        }
+
+        /* Current line, length, and attributes */
+        struct source_line *sline = buffer_get_line(&sview->cur->file_buf, line);
+
+        if (!has_colors)
+        {
+            swin_wmove(win, i, 0);
+            swin_wprintw(win, "%.*s\n", sline->len, sline->line);
             continue;
         }
 
-        if (!swin_has_colors())
-        {
-            swin_wprintw(win, "%.*s\n",
-                sview->cur->file_buf.lines[line].len,
-                sview->cur->file_buf.lines[line].line);
+        /* Is this the current selected line? */
+        int is_sel_line = (sview->cur->sel_line == line);
+        /* Is this the current executing line */
+        int is_exe_line = (sview->cur->exe_line == line);
+
+        row.line = line;
+        row.text = sline->line;
+        row.len = sline->len;
+        row.runs_key = buffer_get_line_runs_key(&sview->cur->file_buf, line);
+        row.draw_arrow = is_exe_line || (arrow_selected_line && is_sel_line);
+        row.mark_char = showmarks ? source_get_mark_char(sview, sview->cur, line) : 0;
+
+        if (searching)
+        {
+            if (line < buf->match_line)
+                row.search_key = match_index_line_attrs(buf, line, search_attr, &search_attrs);
+            else
+                row.searched = 1;
+        }
+
+        if (sview->cur->lflags[line].breakpt)
+        {
+            /* If this line has a breakpoint, use that color */
+            row.attr = (sview->cur->lflags[line].breakpt == 1) ? enabled_bp_attr : disabled_bp_attr;
+        }
+        else if (row.draw_arrow)
+        {
+            /* Or if it has an arrow, use that color */
+            row.attr = (is_sel_line && !is_exe_line) ? arrow_sel_attr : arrow_attr;
+        }
+        else
+        {
+            /* Use regular colors */
+            row.attr = (focus && is_sel_line) ? sellineno_attr : 0;
+        }
+
+        /* The row still shows this */
+        if (source_row_equal(&row, &frame->rows[i]))
             continue;
-        }
 
-        /* Current line, length, and attributes */
-        int x, y, col;
-        struct source_line *sline = &sview->cur->file_buf.lines[line];
-        /* Is this the current selected line? */
-        int is_sel_line = (sview->cur->sel_line == line);
-        /* Is this the current executing line */
-        int is_exe_line = (sview->cur->exe_line == line);
+        swin_wmove(win, i, 0);
 
         /* Draw the current line */
         {
-            int attr;
+            int attr = row.attr;
             int arrow_length = 0;
-            int draw_arrow = is_exe_line || (arrow_selected_line && is_sel_line);
-
-            if (sview->cur->lflags[line].breakpt)
-            {
-                /* If this line has a breakpoint, use that color */
-                attr = (sview->cur->lflags[line].breakpt == 1) ? enabled_bp_attr : disabled_bp_attr;
-            }
-            else if (draw_arrow)
-            {
-                /* Or if it has an arrow, use that color */
-                attr = (is_sel_line && !is_exe_line) ? arrow_sel_attr : arrow_attr;
-            }
-            else
-            {
-                /* Use regular colors */
-                attr = (focus && is_sel_line) ? sellineno_attr : 0;
-            }
 
             /* Print line number */
             swin_wattron(win, attr);
             swin_wprintw(win, fmt, line + 1);
             swin_wattroff(win, attr);
 
-            if (draw_arrow)
+            if (row.draw_arrow)
             {
                 /* Draw line arrow and get the arrow length */
                 swin_wattron(win, attr);
@@ -1057,50 +2683,73 @@ int source_display(struct sviewer *sview, SWINDOW *win, int focus, enum win_refr
                 swin_waddch(win, ' ');
             }
 
-            /* Print the source line */
-            y = swin_getcury(win);
-            x = swin_getcurx(win);
+            /* Print the source line, with search matches over it if we're
+             * searching right now or we finished search and have focus */
+            struct hl_line_attr *attrs = NULL;
+
+            if (searching)
+            {
+                attrs = search_attrs;
+
+                /* Past the match index, search the line */
+                if (row.searched)
+                    attrs = hl_regex_highlight_len(&sview->hlregex,
+                        sline->line, sline->len);
+            }
+
+            hl_printline_overlay(win, sline->line, sline->len,
+                buffer_get_line_attrs(&sview->cur->file_buf, line, &line_attrs), attrs,
+                -1, -1, sview->cur->sel_col + arrow_length, width - lwidth - 2);
 
-            col = sview->cur->sel_col + arrow_length;
-            hl_printline(win, sline->line, sline->len, sline->attrs, -1, -1,
-                sview->cur->sel_col + arrow_length, width - lwidth - 2);
+            if (row.searched)
+                sbfree(attrs);
         }
 
-        if (cgdbrc_get_int(CGDBRC_SHOWMARKS))
+        if (row.mark_char > 0)
         {
             /* Show marks if option is set */
-            int mark_char = source_get_mark_char(sview, sview->cur, line);
+            swin_wmove(win, i, lwidth);
 
-            if (mark_char > 0)
-            {
-                swin_wmove(win, i, lwidth);
-
-                swin_wattron(win, arrow_attr);
-                swin_waddch(win, mark_char);
-                swin_wattroff(win, arrow_attr);
-            }
+            swin_wattron(win, arrow_attr);
+            swin_waddch(win, row.mark_char);
+            swin_wattroff(win, arrow_attr);
         }
 
-        /* If we're searching right now or we finished search and have focus... */
-        if ((sview->regex_is_searching == 1) || (sview->regex_is_searching == 2 && focus))
-        {
-            struct hl_line_attr *attrs;
+        row.cursor_x = swin_getcurx(win);
+        frame->rows[i] = row;
+    }
 
-            attrs = hl_regex_highlight(&sview->hlregex, sline->line);
+    sbfree(line_attrs);
+    sbfree(search_attrs);
 
-            if (sbcount(attrs))
-            {
-                hl_printline_highlight(win, sline->line, sline->len,
-                    attrs, x, y, col, width - lwidth - 2);
-                sbfree(attrs);
-            }
-        }
+    if (has_colors)
+    {
+        /* Leave the cursor where drawing every row would have */
+        swin_wmove(win, height - 1, frame->rows[height - 1].cursor_x);
+    }
+    else
+    {
+        frame->win = NULL;
     }
 
+    /* Rows that weren't drawn are still in the window, but other windows
+     * like the file dialog may have covered them on the screen. Curses only
+     * sends the terminal what differs from what it shows. */
+    swin_touchwin(win);
+
     if (dorefresh == WIN_REFRESH)
         swin_wrefresh(win);
     else
         swin_wnoutrefresh(win);
+
+    /* The file was truncated while it was being drawn */
+    if (buffer_faulted(&sview->cur->file_buf) &&
+        !source_reload(sview, sview->cur->path, 1) &&
+        !buffer_faulted(&sview->cur->file_buf))
+    {
+        return source_display(sview, win, focus, dorefresh);
+    }
+
     return 0;
 }
 
@@ -1168,9 +2817,12 @@ int source_set_exec_line(struct sviewer *sview, const char *path, int sel_line,
     }
 
     /* Buffer the file if it's not already */
-    if (load_file(sview->cur))
+    if (load_file(sview, sview->cur))
         return 4;
 
+    /* Make room for it in the source cache */
+    source_cache_trim(sview);
+
     /* Update line, if set */
     if (sel_line > 0)
         sview->cur->sel_line = clamp_line(sview, sel_line - 1);
@@ -1211,6 +2863,26 @@ void source_free(struct sviewer *sview)
     sview->hlregex = NULL;
     sview->regex_is_searching = 0;
 
+    std_hash_table_destroy(sview->breakpoints);
+    sview->breakpoints = NULL;
+
+    std_hash_table_destroy(sview->node_index);
+    sview->node_index = NULL;
+
+    sbfree(sview->asm_nodes);
+    sview->asm_nodes = NULL;
+
+    sbfree(sview->asm_nodes_max_end);
+    sview->asm_nodes_max_end = NULL;
+
+    sbfree(sview->addr_breakpoints);
+    sbfree(sview->frame.rows);
+    sview->addr_breakpoints = NULL;
+
+    if (sview->watch_fd != -1)
+        close(sview->watch_fd);
+    sview->watch_fd = -1;
+
     free(sview);
 }
 
@@ -1249,14 +2921,16 @@ int source_search_regex(struct sviewer *sview,
      */
     sview->regex_is_searching = (regex && regex[0]) ? opt : 0;
 
-    if (sview->regex_is_searching)
+    if (sview->regex_is_searching &&
+        !hl_regex_compile(&sview->hlregex, regex, icase))
     {
         int line;
         int line_end;
-        int line_inc = direction ? +1 : -1;
+        int lines;
+        struct buffer *buf = &node->file_buf;
+        int count = sbcount(buf->lines);
         int line_start = node->sel_rline;
-
-        line = wrap_line(node, line_start + line_inc);
+        int first = wrap_line(node, line_start + (direction ? +1 : -1));
 
         if (cgdbrc_get_int(CGDBRC_WRAPSCAN))
         {
@@ -1267,30 +2941,39 @@ int source_search_regex(struct sviewer *sview,
         {
             // No wrapping. Stop at line 0 if searching down and last line
             // if searching up.
-            line_end = direction ? 0 : sbcount(node->file_buf.lines) - 1;
+            line_end = direction ? 0 : count - 1;
         }
 
-        for (;;)
-        {
-            int ret;
-            int start, end;
-            char *line_str = node->file_buf.lines[line].line;
+        /* Number of lines to look at, going from first and wrapping
+         * around the end of the file until line_end */
+        lines = direction ? (line_end - first) : (first - line_end);
+        if (lines <= 0)
+            lines += count;
 
-            ret = hl_regex_search(&sview->hlregex, line_str, regex, icase, &start, &end);
-            if (ret > 0)
-            {
-                /* Got a match */
-                node->sel_line = line;
+        match_index_sync(sview, buf);
 
-                /* Finalized match - move to this location */
-                if (opt == 2)
-                    node->sel_rline = line;
-                return 1;
-            }
+        if (direction)
+        {
+            line = match_index_find(sview, buf, first, MIN(count, first + lines), 1);
+            if (line == -1 && first + lines > count)
+                line = match_index_find(sview, buf, 0, first + lines - count, 1);
+        }
+        else
+        {
+            line = match_index_find(sview, buf, MAX(0, first - lines + 1), first + 1, 0);
+            if (line == -1 && first - lines + 1 < 0)
+                line = match_index_find(sview, buf, count + first - lines + 1, count, 0);
+        }
 
-            line = wrap_line(node, line + line_inc);
-            if (line == line_end)
-                break;
+        if (line != -1)
+        {
+            /* Got a match */
+            node->sel_line = line;
+
+            /* Finalized match - move to this location */
+            if (opt == 2)
+                node->sel_rline = line;
+            return 1;
         }
     }
 
@@ -1305,84 +2988,482 @@ void source_set_breakpoints(struct sviewer *sview, struct tgdb_breakpoint *break
 
     for (i = 0; i < sbcount(breakpoints); i++)
     {
-        if (breakpoints[i].addr)
-        {
-            int line = 0;
-            struct list_node *node = source_get_asmnode(sview,
-                breakpoints[i].addr, &line);
+        struct source_breakpoint bp;
 
-            if (node)
-            {
-                node->lflags[line].breakpt = breakpoints[i].enabled ? 1 : 2;
-            }
-        }
+        bp.line = breakpoints[i].line;
+        bp.addr = breakpoints[i].addr;
+        bp.enabled = breakpoints[i].enabled;
+        bp.number = breakpoints[i].number;
+
+        if (bp.addr)
+            sbpush(sview->addr_breakpoints, bp);
 
         if (breakpoints[i].file)
         {
-            struct list_node *node = source_get_node(sview, breakpoints[i].file);
+            struct source_file_breakpoints *file_bps = (struct source_file_breakpoints *)
+                std_hash_table_lookup(sview->breakpoints, breakpoints[i].file);
 
-            if (!load_file(node))
+            if (!file_bps)
             {
-                int line = breakpoints[i].line;
-                int enabled = breakpoints[i].enabled;
+                file_bps = (struct source_file_breakpoints *)cgdb_malloc(sizeof(*file_bps));
+                file_bps->bps = NULL;
 
-                if (line > 0 && line <= sbcount(node->lflags))
-                {
-                    node->lflags[line - 1].breakpt = enabled ? 1 : 2;
-                }
+                std_hash_table_insert(sview->breakpoints,
+                    strdup(breakpoints[i].file), file_bps);
             }
+
+            sbpush(file_bps->bps, bp);
+        }
+    }
+
+    sview->breakpoints_gen++;
+}
+
+/* Remove the breakpoints with a number from a stretchy buffer */
+static void remove_breakpoint_number(struct source_breakpoint *bps, int number)
+{
+    int i = 0;
+
+    while (i < sbcount(bps))
+    {
+        if (bps[i].number == number)
+            bps[i] = sbpop(bps);
+        else
+            i++;
+    }
+}
+
+void source_remove_breakpoints(struct sviewer *sview, struct tgdb_breakpoint *removed)
+{
+    int i;
+
+    for (i = 0; i < sbcount(removed); i++)
+    {
+        if (removed[i].addr)
+            remove_breakpoint_number(sview->addr_breakpoints, removed[i].number);
+
+        if (removed[i].file)
+        {
+            struct source_file_breakpoints *file_bps = (struct source_file_breakpoints *)
+                std_hash_table_lookup(sview->breakpoints, removed[i].file);
+
+            if (file_bps)
+                remove_breakpoint_number(file_bps->bps, removed[i].number);
         }
     }
+
+    sview->breakpoints_gen++;
+}
+
+static int remove_all_breakpoints(void *key, void *value, void *user_data)
+{
+    return 1;
 }
 
 void source_clear_breakpoints(struct sviewer *sview)
+{
+    std_hash_table_foreach_remove(sview->breakpoints, remove_all_breakpoints, NULL);
+
+    sbsetcount(sview->addr_breakpoints, 0);
+
+    sview->breakpoints_gen++;
+}
+
+void source_cache_trim(struct sviewer *sview)
 {
     struct list_node *node;
+    long total = 0;
+    long budget = (long)cgdbrc_get_int(CGDBRC_SOURCECACHE) * 1024 * 1024;
+
+    /* No limit */
+    if (budget <= 0)
+        return;
 
-    for (node = sview->list_head; node != NULL; node = node->next)
+    for (node = sview->list_head; node; node = node->next)
+        total += node->file_buf.mem_size;
+
+    while (total > budget)
     {
-        int i;
-        for (i = 0; i < sbcount(node->lflags); i++)
-            node->lflags[i].breakpt = 0;
+        struct list_node *lru = NULL;
+
+        /* Find the least recently displayed file we can reload later.
+         * Disassembly and other buffers not backed by files are kept. */
+        for (node = sview->list_head; node; node = node->next)
+        {
+            if (node != sview->cur && node->path[0] != '*' &&
+                node->file_buf.lines &&
+                (!lru || node->last_display < lru->last_display))
+            {
+                lru = node;
+            }
+        }
+
+        if (!lru)
+            break;
+
+        /* Line flags, marks and the selected line stay with the node */
+        total -= lru->file_buf.mem_size;
+        release_file_memory(lru);
+    }
+}
+
+/* Returns the lexer state line starts in. line must be <= hl_line. */
+static int highlight_state_at(struct buffer *buf, int line)
+{
+    int lo = 0;
+    int hi = sbcount(buf->hl_states);
+
+    if (line == buf->hl_line)
+        return buf->hl_state;
+
+    /* Lines without an entry start in the initial state */
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+
+        if (buf->hl_states[mid].line < line)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return (lo < sbcount(buf->hl_states) && buf->hl_states[lo].line == line) ?
+        buf->hl_states[lo].state : 0;
+}
+
+/**
+ * Append the highlight runs and start states of lines from another buffer.
+ *
+ * \param buf
+ * struct buffer pointer, highlighted up to the line being appended
+ *
+ * \param src
+ * The buffer to copy from
+ *
+ * \param src_start
+ * The first line in src to copy
+ *
+ * \param count
+ * Number of lines to copy
+ */
+static void highlight_append_lines(struct buffer *buf, struct buffer *src,
+    int src_start, int count)
+{
+    int i;
+    int line = sbcount(buf->hl_offsets) ? sbcount(buf->hl_offsets) - 1 : 0;
+    int base = sbcount(buf->hl_runs);
+    int run_start, run_end;
+
+    if (count <= 0)
+        return;
+
+    run_start = src->hl_offsets[src_start];
+    run_end = src->hl_offsets[src_start + count];
+
+    buf->mem_size -= sbcount(buf->hl_runs) * sizeof(buf->hl_runs[0]) +
+        sbcount(buf->hl_offsets) * sizeof(buf->hl_offsets[0]) +
+        sbcount(buf->hl_states) * sizeof(buf->hl_states[0]);
+
+    if (!buf->hl_offsets)
+        sbpush(buf->hl_offsets, 0);
+
+    if (run_end > run_start)
+    {
+        memcpy(sbadd(buf->hl_runs, run_end - run_start),
+            src->hl_runs + run_start, (run_end - run_start) * sizeof(buf->hl_runs[0]));
+    }
+
+    for (i = 1; i <= count; i++)
+        sbpush(buf->hl_offsets, base + src->hl_offsets[src_start + i] - run_start);
+
+    for (i = 0; i < sbcount(src->hl_states); i++)
+    {
+        struct source_line_state line_state = src->hl_states[i];
+
+        if (line_state.line > src_start && line_state.line <= src_start + count)
+        {
+            line_state.line += line - src_start;
+            sbpush(buf->hl_states, line_state);
+        }
+    }
+
+    buf->mem_size += sbcount(buf->hl_runs) * sizeof(buf->hl_runs[0]) +
+        sbcount(buf->hl_offsets) * sizeof(buf->hl_offsets[0]) +
+        sbcount(buf->hl_states) * sizeof(buf->hl_states[0]);
+}
+
+/**
+ * Highlight a reloaded file, reusing what can be kept from the highlighting
+ * of the old version of the file. The lines before the first change keep
+ * their highlighting. The changed lines are highlighted again, and if the
+ * lexer ends up in the same state going into the unchanged lines at the end
+ * of the file as it did before, those keep their highlighting too.
+ *
+ * \param buf
+ * The buffer with the new version of the file loaded
+ *
+ * \param old
+ * The buffer with the old version of the file
+ */
+static void highlight_changed_lines(struct buffer *buf, struct buffer *old)
+{
+    long prefix = 0, suffix = 0;
+    long min_size = MIN(old->file_size, buf->file_size);
+    int old_count = sbcount(old->lines);
+    int new_count = sbcount(buf->lines);
+    int delta = new_count - old_count;
+    int first, old_end, new_end;
+    int lo, hi;
+    int state;
+
+    /* Bytes at the start of the file which didn't change */
+    while (prefix + 4096 <= min_size &&
+        !memcmp(old->file_data + prefix, buf->file_data + prefix, 4096))
+        prefix += 4096;
+    while (prefix < min_size && old->file_data[prefix] == buf->file_data[prefix])
+        prefix++;
+
+    /* Bytes at the end of the file which didn't change */
+    while (suffix < min_size - prefix &&
+        old->file_data[old->file_size - suffix - 1] == buf->file_data[buf->file_size - suffix - 1])
+        suffix++;
+
+    /* First line which changed. Lines before the one holding the first
+     * changed byte are the same, as long as they end in a line feed. */
+    lo = 0;
+    hi = old_count + 1;
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+
+        if (old->line_offsets[mid] <= prefix)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    first = lo - 1;
+    if (first == old_count && old->file_data[old->file_size - 1] != '\n')
+        first--;
+    first = MIN(first, old->hl_line);
+
+    /* Lines after the last change. A line only counts if the line feed
+     * before it is part of the unchanged bytes. */
+    lo = 0;
+    hi = old_count;
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+
+        if (old->line_offsets[mid] <= old->file_size - suffix)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    old_end = lo;
+    new_end = old_end + delta;
+    if (new_end < first || old_end < first)
+    {
+        old_end = old_count;
+        new_end = new_count;
+    }
+
+    /* Keep the lines before the change */
+    state = highlight_state_at(old, first);
+    highlight_append_lines(buf, old, 0, first);
+
+    buf->hl_line = first;
+    buf->hl_state = state;
+
+    /* Too much changed, let source_highlight_step do the rest */
+    if (new_end - first > HL_RELOAD_MAX_LINES)
+        return;
+
+    highlight_advance(buf, new_end);
+
+    /* Keep the lines after the change if the lexer state going into them
+     * didn't change */
+    if (old_end < old->hl_line && buf->hl_line == new_end &&
+        buf->hl_state == highlight_state_at(old, old_end))
+    {
+        highlight_append_lines(buf, old, old_end, old->hl_line - old_end);
+
+        buf->hl_line = old->hl_line + delta;
+        buf->hl_state = old->hl_state;
+    }
+}
+
+/**
+ * Reload a file which changed since it was loaded. The highlighting of
+ * lines that didn't change is kept where possible.
+ *
+ * \param sview
+ * The source viewer object
+ *
+ * \param node
+ * The node to reload, with its file loaded
+ *
+ * \return
+ * 0 on success, -1 on error.
+ */
+static int reload_file(struct sviewer *sview, struct list_node *node)
+{
+    struct buffer old = node->file_buf;
+    struct buffer *buf = &node->file_buf;
+    int do_color = sources_syntax_on &&
+        (node->language != TOKENIZER_LANGUAGE_UNKNOWN) &&
+        swin_has_colors();
+    int count;
+
+    /* Watch for changes before reading, so none are missed. If the file
+     * was replaced, this moves the watch to the new file. */
+    node->file_changed = 0;
+    source_watch_node(sview, node);
+
+    if (sview->frame.node == node)
+        sview->frame.node = NULL;
+
+    init_file_buffer(buf);
+    if (load_file_buf(buf, node->path) || !buf->lines)
+    {
+        release_file_buffer(buf);
+        release_file_buffer(&old);
+        return -1;
+    }
+
+    node->last_modification = buf->file_mtime;
+
+    /* Resize the line flags, breakpoints are applied again when displayed */
+    count = sbcount(buf->lines);
+    resize_line_flags(node);
+
+    node->sel_line = MIN(node->sel_line, count - 1);
+
+    if (do_color)
+    {
+        buf->language = node->language;
+
+        if (!highlight_cache_load_runs(node))
+        {
+            buf->hl_line = count;
+            buf->hl_cached = 1;
+        }
+        /* A mapped file written in place shows its new contents through
+         * the old mapping, so there is nothing left to compare against */
+        else if (old.file_data && old.language == buf->language &&
+            old.tabstop == buf->tabstop && old.synmaxcol == buf->synmaxcol &&
+            (!old.file_mapped || old.file_ino != buf->file_ino))
+        {
+            highlight_changed_lines(buf, &old);
+        }
     }
+
+    release_file_buffer(&old);
+    return 0;
 }
 
 int source_reload(struct sviewer *sview, const char *path, int force)
 {
     time_t timestamp;
     struct list_node *cur;
-    struct list_node *prev = NULL;
+    int dirty;
     int auto_source_reload = cgdbrc_get_int(CGDBRC_AUTOSOURCERELOAD);
 
     if (!path)
         return -1;
 
-    if (get_timestamp(path, &timestamp) == -1)
-        return -1;
-
     /* Find the target node */
-    for (cur = sview->list_head; cur != NULL; cur = cur->next)
+    cur = source_get_node(sview, path);
+
+    if (cur && cur->watch_wd != -1)
     {
-        if (strcmp(path, cur->path) == 0)
-            break;
-        prev = cur;
+        /* The kernel tells us when a watched file changes */
+        dirty = cur->file_changed;
     }
+    else
+    {
+        if (get_timestamp(path, &timestamp) == -1)
+            return -1;
 
-    if (cur == NULL)
-        return 1; /* Node not found */
+        if (cur == NULL)
+            return 1; /* Node not found */
+
+        dirty = cur->last_modification < timestamp;
+    }
 
-    /* If the file timestamp or tab size changed, reload the file */
-    int dirty = cur->last_modification < timestamp;
+    /* If the file changed or tab size changed, reload the file */
     dirty |= cgdbrc_get_int(CGDBRC_TABSTOP) != cur->file_buf.tabstop;
+    dirty |= cgdbrc_get_int(CGDBRC_SYNMAXCOL) != cur->file_buf.synmaxcol;
+
+    /* A mapped file that was truncated has lost its contents */
+    dirty |= buffer_faulted(&cur->file_buf);
 
     if ((auto_source_reload || force) && dirty)
     {
-        if (release_file_memory(sview->cur) == -1)
-            return -1;
+        /* Files released by the source cache are loaded from scratch.
+         * source_highlight sizes the line flags to the new file. */
+        if (!cur->file_buf.lines)
+            return load_file(sview, cur) ? -1 : 0;
 
-        if (load_file(cur))
+        if (reload_file(sview, cur))
             return -1;
     }
 
     return 0;
 }
+
+int source_get_watch_fd(struct sviewer *sview)
+{
+    return sview ? sview->watch_fd : -1;
+}
+
+int source_read_watch_events(struct sviewer *sview)
+{
+#if HAVE_SYS_INOTIFY_H
+    /* Aligned for struct inotify_event */
+    union
+    {
+        struct inotify_event event;
+        char buf[4096];
+    } events;
+
+    if (sview->watch_fd == -1)
+        return -1;
+
+    for (;;)
+    {
+        char *ptr;
+        ssize_t len = read(sview->watch_fd, events.buf, sizeof(events.buf));
+
+        if (len == -1 && errno == EINTR)
+            continue;
+
+        /* No more events */
+        if (len <= 0)
+            break;
+
+        for (ptr = events.buf; ptr < events.buf + len;)
+        {
+            struct list_node *node;
+            const struct inotify_event *event = (const struct inotify_event *)ptr;
+
+            for (node = sview->list_head; node; node = node->next)
+            {
+                if (node->watch_wd != event->wd)
+                    continue;
+
+                node->file_changed = 1;
+
+                /* The file was deleted or the watch was removed */
+                if (event->mask & IN_IGNORED)
+                    node->watch_wd = -1;
+            }
+
+            ptr += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    return 0;
+#else
+    return -1;
+#endif
+}
@@ -3,17 +3,19 @@
  * 
  * Source file management routines for the GUI.  Provides the ability to
  * add files to the list, load files, and display within a curses window.
- * Files are buffered in memory when they are displayed, and held in
- * memory for the duration of execution.  If memory consumption becomes a
- * problem, this can be optimized to unload files which have not been
- * displayed recently, or only load portions of large files at once. (May
- * affect syntax highlighting.)
+ * Files are mapped into memory when they are displayed.  Only an index of
+ * line offsets is built when a file is loaded; individual lines are tab
+ * expanded and materialized the first time they are displayed or searched.
+ * If the sourcecache option is set, the least recently displayed files are
+ * released when the cache goes over budget, and reloaded when shown again.
  *
  */
 
 #ifndef _SOURCES_H_
 #define _SOURCES_H_
 
+struct std_hashtable;
+
 /* ----------- */
 /* Definitions */
 /* ----------- */
@@ -28,6 +30,21 @@
 /* Data Structures */
 /* --------------- */
 
+/* Breakpoint on a source file line or disassembly address */
+struct source_breakpoint
+{
+    int line;      /* Line number (1 based) */
+    uint64_t addr; /* Address, or 0 if not known */
+    int enabled;   /* 1 if enabled, 0 if disabled */
+    int number;    /* Breakpoint number */
+};
+
+/* Breakpoints set in a source file */
+struct source_file_breakpoints
+{
+    struct source_breakpoint *bps; /* Stretch buffer array of breakpoints */
+};
+
 /* Global mark: source file and line number */
 struct sviewer_mark
 {
@@ -35,34 +52,122 @@ struct sviewer_mark
     int line;
 };
 
+/* A row of the source window as it was last drawn */
+struct source_row
+{
+    int valid;         /* 0 if the row has to be drawn */
+    int line;          /* File line shown on the row */
+    const char *text;  /* Text of the line */
+    int len;           /* Length of text */
+    uint32_t runs_key; /* Hash of the line's highlight runs */
+    int attr;          /* Attribute of the line number */
+    int draw_arrow;    /* 1 if an arrow was drawn instead of the separator */
+    int mark_char;     /* Mark drawn on the row, or 0 */
+    int searched;      /* 1 if search matches not in the match index were drawn */
+    uint32_t search_key; /* Hash of the search matches drawn over the row */
+    int cursor_x;      /* Where the cursor was left after drawing the row */
+};
+
+/* The last frame drawn in the source window. Only rows which changed are
+ * drawn again, and vertical scrolls move the rows that are still shown. */
+struct source_frame
+{
+    SWINDOW *win;            /* Window drawn in, NULL if nothing valid is shown */
+    struct list_node *node;  /* File shown */
+    int top;                 /* File line on the first row */
+    int width;               /* Window width */
+    int height;              /* Window height */
+    uint32_t key;            /* Hash of the options and colors rows were drawn with */
+    struct source_row *rows; /* Stretch buffer of height rows */
+};
+
 /* Source viewer object */
 struct sviewer
 {
     struct list_node *list_head;           /* File list */
     struct list_node *cur;                 /* Current node we're displaying */
+    struct std_hashtable *node_index;      /* Path -> list_node */
+    struct list_node **asm_nodes;          /* Disassembly nodes sorted by addr_start */
+    uint64_t *asm_nodes_max_end;           /* Max addr_end of asm_nodes[0..i] */
     sviewer_mark global_marks[MARK_COUNT]; /* Global A-Z marks */
     sviewer_mark jump_back_mark;           /* Location where last jump occurred from */
 
     uint64_t addr_frame; /* Current frame address */
+
+    /* Breakpoints are kept here and only applied to a file's line flags
+     * when it's displayed. breakpoints_gen is bumped when they change. */
+    struct std_hashtable *breakpoints;              /* Path -> source_file_breakpoints */
+    struct source_breakpoint *addr_breakpoints;     /* Stretch buffer of address breakpoints */
+    int breakpoints_gen;
+
+    int display_count; /* Bumped each time a file is displayed */
+
+    int watch_fd; /* inotify descriptor watching loaded files, or -1 */
+
+    struct source_frame frame; /* What the source window shows */
+
     int regex_is_searching;
     struct hl_regex_info *hlregex;
 };
 
 struct source_line
 {
-    char *line;
-    int len;
-    struct hl_line_attr *attrs;
+    char *line; /* Line text, NULL until materialized */
+    int len;    /* Length of line (after tab expansion) */
+};
+
+/* Lexer state a line starts in. Only kept for lines which don't start in
+ * the initial state, so a reloaded file can be highlighted again from the
+ * first line that changed. */
+struct source_line_state
+{
+    int line;  /* Line number (0 based) */
+    int state; /* Tokenizer start state */
 };
 
+/* A search match, in tab expanded columns of the line */
+struct source_match
+{
+    int line;  /* Line number (0 based) */
+    int start; /* First column of the match */
+    int end;   /* One past the last column of the match */
+};
+
+/* Highlight runs are packed into 32 bits: the column the run starts at in
+ * the upper 24 bits and the hl_group_kind in the lower 8. The group is
+ * turned into a curses attribute when the line is drawn. */
+#define HL_RUN(col, kind) (((uint32_t)MIN((col), 0xffffff) << 8) | (uint32_t)(kind))
+#define HL_RUN_COL(run) ((int)((run) >> 8))
+#define HL_RUN_KIND(run) ((enum hl_group_kind)((run) & 0xff))
+
 struct buffer
 {
     struct source_line *lines;                /* Stretch buffer array with line information */
     uint64_t *addrs;                          /* Stretch buffer array of asm addresses */
+    int *addr_lines;                          /* Stretch buffer of lines with addresses, sorted by address */
+    uint32_t *hl_runs;                        /* Stretch buffer of packed highlight runs for all lines */
+    int *hl_offsets;                          /* Stretch buffer, line i has runs hl_offsets[i] to hl_offsets[i + 1] */
+    struct source_line_state *hl_states;      /* Stretch buffer of start states up to hl_line, sorted by line */
     int max_width;                            /* Width of longest line in file */
-    char *file_data;                          /* Entire file pointer if read in that way */
+    char *file_data;                          /* Entire file contents (mapped or read in) */
+    long file_size;                           /* Size of file_data in bytes */
+    time_t file_mtime;                        /* Modification time of file when loaded */
+    unsigned long file_ino;                   /* Inode of file when loaded */
+    int file_mapped;                          /* 1 if file_data was mapped with mmap */
+    long *line_offsets;                       /* Stretch buffer of line offsets into file_data */
+    long mem_size;                            /* Approximate memory used by this buffer */
+    int hl_line;                              /* Lines before this are fully highlighted */
+    int hl_state;                             /* Tokenizer state at start of hl_line */
+    int hl_prov_start;                        /* Start of provisionally highlighted lines */
+    int hl_prov_end;                          /* End of provisionally highlighted lines */
+    int hl_cached;                            /* 1 if highlight cache was loaded or saved */
     int tabstop;                              /* Tabstop value used to load file */
+    int synmaxcol;                            /* Lines longer than this are only highlighted this far */
     enum tokenizer_language_support language; /* The language type of this file */
+    struct source_match *matches;             /* Stretch buffer of search matches before match_line, sorted */
+    int match_gen;                            /* hl_regex_generation matches are for, 0 if none */
+    int match_line;                           /* Lines before this have been searched */
+    int match_full;                           /* 1 if matches stopped growing at MATCH_INDEX_MAX */
 };
 
 struct line_flags
@@ -76,6 +181,9 @@ struct list_node
     char *path;             /* Full path to source file */
     struct buffer file_buf; /* File buffer */
     line_flags *lflags;     /* Breakpoints */
+    int *bp_lines;          /* Stretch buffer of lines breakpoints were applied to */
+    int bp_gen;             /* breakpoints_gen when breakpoints were applied */
+    int last_display;       /* display_count when last displayed */
     int sel_line;           /* Current line selected in viewer */
     int sel_col;            /* Current column selected in viewer */
     int exe_line;           /* Current line executing, or -1 if not set */
@@ -85,6 +193,8 @@ struct list_node
     enum tokenizer_language_support language; /* The language type of this file */
 
     time_t last_modification; /* timestamp of last modification */
+    int watch_wd;             /* inotify watch on the file, or -1 */
+    int file_changed;         /* 1 if the watch saw the file change since it was loaded */
 
     int local_marks[MARK_COUNT]; /* Line numbers for local (a..z) marks */
 
@@ -118,8 +228,40 @@ struct list_node *source_add(struct sviewer *sview, const char *path);
 
 void source_add_disasm_line(struct list_node *node, const char *line);
 
+/* source_set_asmnode_range:  Set the address range of a disassembly node
+ * -------------------------  so source_get_asmnode can find it.
+ *
+ *   sview:       Source viewer object
+ *   node:        Disassembly node
+ *   addr_start:  First address in the disassembly
+ *   addr_end:    Last address in the disassembly
+ */
+void source_set_asmnode_range(struct sviewer *sview, struct list_node *node,
+    uint64_t addr_start, uint64_t addr_end);
+
 int source_highlight(struct list_node *node);
 
+/* source_highlight_pending:  Check if the current file still has lines
+ * -------------------------  which need syntax highlighting.
+ *
+ *   sview:  Source viewer object
+ *
+ * Return Value:  1 if there is highlighting left to do, 0 otherwise.
+ */
+int source_highlight_pending(struct sviewer *sview);
+
+/* source_highlight_step:  Syntax highlight more of the current file. Files
+ * ----------------------  are highlighted around the view when displayed,
+ *                         and the rest is done with this when idle.
+ *
+ *   sview:  Source viewer object
+ *   msecs:  Roughly how long to spend highlighting
+ *
+ * Return Value:  1 if lines that were highlighted provisionally changed
+ *                and the source window should be redrawn, 0 otherwise.
+ */
+int source_highlight_step(struct sviewer *sview, int msecs);
+
 struct list_node *source_get_node(struct sviewer *sview, const char *path);
 
 /* source_del:  Remove a file from the list of source files.
@@ -255,6 +397,15 @@ void source_free(struct sviewer *sview);
 void source_set_breakpoints(struct sviewer *sview,
     struct tgdb_breakpoint *breakpoints);
 
+/* source_remove_breakpoints:  Remove breakpoints that were deleted or changed.
+ * --------------------
+ *
+ *   sview:  The source viewer object
+ *   removed: stretchy buffer array of the breakpoints as they were set
+ */
+void source_remove_breakpoints(struct sviewer *sview,
+    struct tgdb_breakpoint *removed);
+
 /* source_clear_breakpoints:  Clear all breakpoints from all files.
  * --------------------
  *
@@ -280,6 +431,40 @@ void source_clear_breakpoints(struct sviewer *sview);
  */
 int source_reload(struct sviewer *sview, const char *path, int force);
 
+/**
+ * Get the descriptor to select on for changes to loaded source files.
+ *
+ * \param sview
+ * The source viewer object
+ *
+ * \return
+ * The descriptor, or -1 if files aren't being watched. In that case
+ * source_reload checks the modification time of the file instead.
+ */
+int source_get_watch_fd(struct sviewer *sview);
+
+/**
+ * Read the pending events from the watch descriptor and mark the files
+ * which changed, so the next source_reload reloads them.
+ *
+ * \param sview
+ * The source viewer object
+ *
+ * \return
+ * 0 on success or -1 on error
+ */
+int source_read_watch_events(struct sviewer *sview);
+
+/**
+ * Release the least recently displayed files until the memory used by
+ * loaded files fits in the sourcecache option. The file being displayed
+ * and buffers not backed by a file are never released.
+ *
+ * \param sview
+ * The source viewer object
+ */
+void source_cache_trim(struct sviewer *sview);
+
 /* ----- */
 /* Marks */
 /* ----- */
@@ -70,8 +70,8 @@ int ibuf_adddata(struct ibuf *s, const char *d, int len)
 
     memcpy(s->buf + s->pos, d, len);
 
-    s->buf[len] = 0;
     s->pos += len;
+    s->buf[s->pos] = 0;
     return len;
 }
 
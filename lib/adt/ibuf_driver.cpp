@@ -41,6 +41,7 @@ typedef struct ibuf *ibuf_ptr;
 /* Tests */
 static int test_add(ibuf_ptr s);
 static int test_addchar(ibuf_ptr s);
+static int test_adddata(ibuf_ptr s);
 static int test_delchar(ibuf_ptr s);
 static int test_dup(ibuf_ptr s);
 
@@ -66,6 +67,7 @@ int main(int argc, char *argv[])
     /* Run tests */
     result |= test_add(s);
     result |= test_addchar(s);
+    result |= test_adddata(s);
     result |= test_delchar(s);
     result |= test_dup(s);
 
@@ -123,6 +125,30 @@ static int test_addchar(ibuf_ptr s)
     return 0;
 }
 
+static int test_adddata(ibuf_ptr s)
+{
+
+    /* Add part of a string after what's there, then remove it again */
+    ibuf_adddata(s, " and more data", 9);
+
+    /* Make sure it was added after the old string, and nil terminated */
+    if (strcmp(ibuf_get(s), "hello world! and more") != 0 ||
+        ibuf_length(s) != 21)
+    {
+        debug("test_adddata: Mismatch, expected \"hello world! and more\", got: %s\n",
+            ibuf_get(s));
+        return 1;
+    }
+
+    while (ibuf_length(s) > 12)
+    {
+        ibuf_delchar(s);
+    }
+
+    debug("test_adddata: Succeeded.\n");
+    return 0;
+}
+
 static int test_delchar(ibuf_ptr s)
 {
 
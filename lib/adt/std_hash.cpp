@@ -17,6 +17,8 @@
  * Boston, MA 02111-1307, USA.
  */
 
+#include <string.h>
+
 #include "std_hash.h"
 
 #define HASH_TABLE_MIN_SIZE 11
@@ -639,7 +641,7 @@ static void std_hash_table_resize(struct std_hashtable *hash_table)
     new_size = std_spaced_primes_closest(hash_table->nnodes);
     new_size = CLAMP(new_size, HASH_TABLE_MIN_SIZE, HASH_TABLE_MAX_SIZE);
 
-    new_nodes = (struct ghashnode **)malloc(sizeof(struct ghashnode *) * new_size);
+    new_nodes = (struct ghashnode **)calloc(new_size, sizeof(struct ghashnode *));
 
     for (i = 0; i < hash_table->size; i++)
         for (node = hash_table->nodes[i]; node; node = next)
@@ -709,3 +711,35 @@ unsigned int std_direct_hash(const void *v)
 {
     return (size_t)v;
 }
+
+int std_direct_equal(const void *v, const void *v2)
+{
+    return v == v2;
+}
+
+int std_str_equal(const void *v, const void *v2)
+{
+    return strcmp((const char *)v, (const char *)v2) == 0;
+}
+
+/* This is the djb2 string hash used by glib's g_str_hash */
+unsigned int std_str_hash(const void *v)
+{
+    const signed char *p;
+    unsigned int h = 5381;
+
+    for (p = (const signed char *)v; *p != '\0'; p++)
+        h = (h << 5) + h + *p;
+
+    return h;
+}
+
+int std_int_equal(const void *v, const void *v2)
+{
+    return *((const int *)v) == *((const int *)v2);
+}
+
+unsigned int std_int_hash(const void *v)
+{
+    return *(const int *)v;
+}
@@ -306,7 +306,6 @@ unsigned int std_hash_table_size(struct std_hashtable *hash_table);
 
 /* 
  * Some standard hash functions 
- * TODO: These are unimplemented. Please implement them when needed.
  */
 
 int std_str_equal(const void *v, const void *v2);
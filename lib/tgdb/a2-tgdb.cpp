@@ -19,7 +19,9 @@
 #include "io.h"
 #include "state_machine.h"
 #include "commands.h"
+#include "tgdb.h"
 #include "ibuf.h"
+#include "terminal.h"
 
 /* Here are the two functions that deal with getting tty information out
  * of the annotate_two subsystem.
@@ -46,6 +48,93 @@ int a2_open_new_tty(struct annotate_two *a2, int *inferior_stdin, int *inferior_
     return 0;
 }
 
+int a2_open_mi_channel(struct annotate_two *a2)
+{
+    int slavefd;
+
+    a2_close_mi_channel(a2);
+
+    a2->mi_pty_pair = pty_pair_create();
+    if (!a2->mi_pty_pair)
+    {
+        clog_error(CLOG_CGDB, "pty_pair_create failed");
+        return -1;
+    }
+
+    /* Don't echo the commands back, and leave newlines alone */
+    slavefd = pty_pair_get_slavefd(a2->mi_pty_pair);
+    if (tty_set_echo(slavefd, 0) == -1 || tty_output_nl(slavefd) == -1)
+    {
+        clog_error(CLOG_CGDB, "could not set GDB/MI pty attributes");
+        a2_close_mi_channel(a2);
+        return -1;
+    }
+
+    a2->mi_line = ibuf_init();
+    a2->mi_output = ibuf_init();
+    a2->mi_state = A2_MI_STARTING;
+
+    commands_issue_command(a2, ANNOTATE_NEW_UI,
+        pty_pair_get_slavename(a2->mi_pty_pair), 1, NULL);
+
+    return 0;
+}
+
+void a2_close_mi_channel(struct annotate_two *a2)
+{
+    int i;
+
+    if (a2->mi_pty_pair)
+    {
+        pty_pair_destroy(a2->mi_pty_pair);
+        a2->mi_pty_pair = NULL;
+    }
+
+    if (a2->mi_line)
+    {
+        ibuf_free(a2->mi_line);
+        a2->mi_line = NULL;
+    }
+
+    if (a2->mi_output)
+    {
+        ibuf_free(a2->mi_output);
+        a2->mi_output = NULL;
+    }
+
+    /* gdb won't answer the commands sent to the channel. Send the ones
+     * still wanted to the console instead, keeping their tokens so the
+     * requests waiting on them are answered. */
+    for (i = 0; i < sbcount(a2->mi_commands); i++)
+    {
+        struct tgdb_command *tc = a2->mi_commands[i];
+
+        if (tc->superseded ||
+            (tc->per_stop && tc->generation != a2->stop_generation))
+        {
+            tgdb_request_destroy(tgdb_pop_request_id(tc->id));
+            tgdb_command_destroy(tc);
+        }
+        else
+        {
+            commands_move_to_console(tc);
+            sbpush(a2->client_commands, tc);
+        }
+    }
+    sbfree(a2->mi_commands);
+    a2->mi_commands = NULL;
+
+    a2->mi_state = A2_MI_NONE;
+}
+
+int a2_get_mi_fd(struct annotate_two *a2)
+{
+    if (!a2->mi_pty_pair)
+        return -1;
+
+    return pty_pair_get_masterfd(a2->mi_pty_pair);
+}
+
 /* tgdb_setup_config_file: 
  * -----------------------
  *  Creates a config file for the user.
@@ -144,17 +233,17 @@ int a2_shutdown(struct annotate_two *a2)
     state_machine_shutdown(a2->sm);
     a2->sm = NULL;
 
+    a2_close_mi_channel(a2);
+
+    commands_free_breakpoints(a2->breakpoints);
+    a2->breakpoints = NULL;
+
     a2_delete_responses(a2);
     sbfree(a2->responses);
     a2->responses = NULL;
 
     for (i = 0; i < sbcount(a2->client_commands); i++)
-    {
-        struct tgdb_command *tc = a2->client_commands[i];
-
-        free(tc->gdb_command);
-        free(tc);
-    }
+        tgdb_command_destroy(a2->client_commands[i]);
     sbfree(a2->client_commands);
     a2->client_commands = NULL;
     return 0;
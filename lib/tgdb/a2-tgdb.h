@@ -10,6 +10,19 @@
  * This interface documents the annotate two context.
  */
 
+/** The state of the GDB/MI channel opened with gdb's new-ui command */
+enum a2_mi_state
+{
+    /** No channel. Internal commands are wrapped and sent to the console. */
+    A2_MI_NONE,
+
+    /** The new-ui command was sent, waiting for gdb to answer it */
+    A2_MI_STARTING,
+
+    /** Internal commands are sent to the channel */
+    A2_MI_READY
+};
+
 /** This is the main context for the annotate two subsytem. */
 struct annotate_two
 {
@@ -56,6 +69,29 @@ struct annotate_two
      * the prompt, we should issue a ANNOTATE_INFO_FRAME to see if the
      * inferior is still running. */
     int got_frames_invalid_annotation;
+
+    /** Incremented each time the inferior resumes. Commands that ask about
+     * where it stopped are stale once it changes. */
+    int stop_generation;
+
+    /** The pty gdb runs a second, GDB/MI, interpreter on. NULL if none. */
+    pty_pair_ptr mi_pty_pair;
+
+    /** The state of the GDB/MI channel */
+    enum a2_mi_state mi_state;
+
+    /** The line of GDB/MI output being read */
+    struct ibuf *mi_line;
+
+    /** The stream records read for the current GDB/MI command */
+    struct ibuf *mi_output;
+
+    /** The commands sent to the GDB/MI channel waiting for a result record */
+    struct tgdb_command **mi_commands;
+
+    /** Stretchy buffer of the breakpoints the front end was told about.
+     * The GDB/MI channel's breakpoint notifications keep it up to date. */
+    struct tgdb_breakpoint *breakpoints;
 };
 
 /**  
@@ -90,6 +126,9 @@ enum annotate_commands
     /** Run gdb/mi -gdb-version command */
     ANNOTATE_GDB_VERSION,
 
+    /** Open a GDB/MI interpreter on a new pty */
+    ANNOTATE_NEW_UI,
+
     /** This is a command issued by the user (tgdb_send) */
     ANNOTATE_USER_COMMAND,
 };
@@ -255,6 +294,37 @@ pid_t a2_get_debugger_pid(struct annotate_two *a2);
  */
 int a2_open_new_tty(struct annotate_two *a2, int *inferior_stdin, int *inferior_stdout);
 
+/**
+ * Asks gdb to run a GDB/MI interpreter on a new pty, with the new-ui
+ * command. Once gdb accepts it, internal commands are sent there instead
+ * of through the console.
+ *
+ * \param ctx
+ * The annotate two context.
+ *
+ * @return
+ * 0 on success, otherwise -1 on error.
+ */
+int a2_open_mi_channel(struct annotate_two *a2);
+
+/**
+ * Closes the GDB/MI channel. Internal commands go back to the console.
+ *
+ * \param ctx
+ * The annotate two context.
+ */
+void a2_close_mi_channel(struct annotate_two *a2);
+
+/**
+ * \param ctx
+ * The annotate two context.
+ *
+ * @return
+ * The descriptor to read the GDB/MI channel from and write commands to,
+ * or -1 if there is no channel.
+ */
+int a2_get_mi_fd(struct annotate_two *a2);
+
 /*@}*/
 
 #endif /* __A2_TGDB_H__ */
@@ -24,6 +24,7 @@
 #include "commands.h"
 #include "io.h"
 #include "tgdb_types.h"
+#include "tgdb.h"
 #include "ibuf.h"
 #include "mi_gdb.h"
 
@@ -360,6 +361,39 @@ commands_process_gdbversion(struct annotate_two *a2, struct ibuf *buf,
 
         str = end;
     }
+
+    /* GDB 7.12 adds the new-ui command. Use it to run our commands on
+     * a GDB/MI channel of their own, instead of through the console. */
+    if ((gdb_version_major > 7 ||
+            (gdb_version_major == 7 && gdb_version_minor >= 12)) &&
+        a2->mi_state == A2_MI_NONE)
+    {
+        a2_open_mi_channel(a2);
+    }
+}
+
+/* process's new-ui result */
+static void
+commands_process_new_ui(struct annotate_two *a2, struct ibuf *buf,
+    int result_record, char *result_line, int id)
+{
+    if (a2->mi_state != A2_MI_STARTING)
+        return;
+
+    if (result_record == MI_CL_DONE)
+    {
+        a2->mi_state = A2_MI_READY;
+
+        /* Breakpoint notifications keep the table up to date from here on.
+         * Start it from what gdb has now. */
+        commands_issue_command(a2, ANNOTATE_INFO_BREAKPOINTS, NULL, 0, NULL);
+    }
+    else
+    {
+        /* Keep wrapping our commands in the console */
+        clog_error(CLOG_CGDB, "new-ui failed: %s", result_line);
+        a2_close_mi_channel(a2);
+    }
 }
 
 /* process's source files */
@@ -386,6 +420,79 @@ commands_process_sources(struct annotate_two *a2, struct ibuf *buf,
     }
 }
 
+void commands_free_breakpoints(struct tgdb_breakpoint *breakpoints)
+{
+    int i;
+
+    for (i = 0; i < sbcount(breakpoints); i++)
+    {
+        free(breakpoints[i].file);
+        free(breakpoints[i].funcname);
+    }
+
+    sbfree(breakpoints);
+}
+
+/* Copy breakpoints, and the strings in them, onto a stretchy buffer */
+static void commands_copy_breakpoints(struct tgdb_breakpoint **dest,
+    struct tgdb_breakpoint *breakpoints)
+{
+    int i;
+
+    for (i = 0; i < sbcount(breakpoints); i++)
+    {
+        struct tgdb_breakpoint tb = breakpoints[i];
+
+        tb.file = tb.file ? strdup(tb.file) : NULL;
+        tb.funcname = tb.funcname ? strdup(tb.funcname) : NULL;
+        sbpush(*dest, tb);
+    }
+}
+
+/* Add the breakpoints in a list of bkpt tuples to a stretchy buffer.
+ * A breakpoint with more than one location is followed by a tuple for each
+ * location, or newer gdbs put them in a locations list in the tuple. */
+static void commands_add_breakpoints(struct tgdb_breakpoint **breakpoints,
+    mi_results *bplist)
+{
+    while (bplist)
+    {
+        mi_bkpt *bkpt;
+        mi_results *locations;
+
+        if (bplist->type != t_tuple)
+        {
+            bplist = bplist->next;
+            continue;
+        }
+
+        bkpt = mi_get_bkpt(bplist->v.rs);
+        if (bkpt && (bkpt->fullname || bkpt->addr))
+        {
+            struct tgdb_breakpoint tb;
+
+            tb.funcname = bkpt->func;
+            tb.file = bkpt->fullname;
+            tb.line = bkpt->line;
+            tb.addr = (uint64_t)bkpt->addr;
+            tb.enabled = bkpt->enabled;
+            tb.number = bkpt->number;
+            sbpush(*breakpoints, tb);
+
+            bkpt->func = NULL;
+            bkpt->fullname = NULL;
+        }
+
+        mi_free_bkpt(bkpt);
+
+        locations = mi_find_var(bplist->v.rs, "locations", t_list);
+        if (locations)
+            commands_add_breakpoints(breakpoints, locations->v.rs);
+
+        bplist = bplist->next;
+    }
+}
+
 static void
 commands_process_breakpoints(struct annotate_two *a2, struct ibuf *buf,
     int result_record, char *result_line, int id)
@@ -396,38 +503,142 @@ commands_process_breakpoints(struct annotate_two *a2, struct ibuf *buf,
     if (miout && (miout->type == MI_T_RESULT_RECORD))
     {
         struct tgdb_breakpoint *breakpoints = NULL;
-        mi_results *bplist = mi_find_var(miout->c, "bkpt", t_tuple);
 
-        while (bplist)
+        commands_add_breakpoints(&breakpoints,
+            mi_find_var(miout->c, "bkpt", t_tuple));
+
+        /* Start the table kept for breakpoint notifications over */
+        commands_free_breakpoints(a2->breakpoints);
+        a2->breakpoints = NULL;
+        commands_copy_breakpoints(&a2->breakpoints, breakpoints);
+
+        response = tgdb_create_response(a2, TGDB_UPDATE_BREAKPOINTS);
+        response->result_id = id;
+        response->choice.update_breakpoints.breakpoints = breakpoints;
+    }
+
+    mi_free_output(miout);
+}
+
+/* Get the delta response for breakpoint notifications. Notifications read
+ * together are given to the front end in one response. */
+static struct tgdb_response *
+commands_get_breakpoints_delta(struct annotate_two *a2)
+{
+    struct tgdb_response *response = NULL;
+
+    if (sbcount(a2->responses))
+        response = sblast(a2->responses);
+
+    if (!response || response->header != TGDB_UPDATE_BREAKPOINTS ||
+        !response->choice.update_breakpoints.is_delta)
+    {
+        response = tgdb_create_response(a2, TGDB_UPDATE_BREAKPOINTS);
+        response->choice.update_breakpoints.is_delta = 1;
+    }
+
+    return response;
+}
+
+/* Process a breakpoint notification from the GDB/MI channel
+    =breakpoint-created,bkpt={number="2",type="breakpoint",...}
+    =breakpoint-modified,bkpt={number="2",type="breakpoint",...}
+    =breakpoint-deleted,id="2"
+
+   The breakpoint table is updated and the front end is told what changed.
+   If the notification can't be parsed, all the breakpoints are asked for.
+ */
+static void
+commands_process_breakpoint_notify(struct annotate_two *a2, const char *line)
+{
+    int i;
+    int count;
+    int number = -1;
+    char *record;
+    mi_output *miout;
+    struct tgdb_response *response;
+    struct tgdb_response_breakpoints *delta;
+    struct tgdb_breakpoint *breakpoints = NULL;
+    const char *results = strchr(line, ',');
+
+    /* Parse the results like they were in a result record */
+    record = sys_aprintf("^done%s", results ? results : "\n");
+    miout = mi_parse_gdb_output(record, NULL);
+    free(record);
+
+    if (miout && (miout->type == MI_T_RESULT_RECORD))
+    {
+        if (!strncmp(line, "=breakpoint-deleted", 19))
         {
-            mi_bkpt *bkpt = mi_get_bkpt(bplist->v.rs);
+            mi_results *res = mi_find_var(miout->c, "id", t_const);
 
-            if (bkpt && (bkpt->fullname || bkpt->addr))
+            if (res)
+                number = atoi(res->v.cstr);
+        }
+        else
+        {
+            mi_results *res = mi_find_var(miout->c, "bkpt", t_tuple);
+            mi_results *num = res ?
+                mi_find_var(res->v.rs, "number", t_const) : NULL;
+
+            if (num)
             {
-                struct tgdb_breakpoint tb;
+                number = atoi(num->v.cstr);
+                commands_add_breakpoints(&breakpoints, res);
+            }
+        }
+    }
 
-                tb.funcname = bkpt->func;
-                tb.file = bkpt->fullname;
-                tb.line = bkpt->line;
-                tb.addr = (uint64_t)bkpt->addr;
-                tb.enabled = bkpt->enabled;
-                sbpush(breakpoints, tb);
+    mi_free_output(miout);
 
-                bkpt->func = NULL;
-                bkpt->fullname = NULL;
-            }
+    if (number <= 0)
+    {
+        clog_error(CLOG_CGDB, "could not parse %s", line);
+        commands_free_breakpoints(breakpoints);
+        commands_issue_command(a2, ANNOTATE_INFO_BREAKPOINTS, NULL, 0, NULL);
+        return;
+    }
 
-            mi_free_bkpt(bkpt);
+    response = commands_get_breakpoints_delta(a2);
+    delta = &response->choice.update_breakpoints;
 
-            bplist = bplist->next;
+    /* Breakpoints with this number the front end was told about are
+     * removed, and any it hasn't been told about yet are replaced. */
+    count = sbcount(a2->breakpoints);
+    for (i = 0; i < count;)
+    {
+        if (a2->breakpoints[i].number == number)
+        {
+            sbpush(delta->removed, a2->breakpoints[i]);
+            a2->breakpoints[i] = a2->breakpoints[--count];
         }
+        else
+            i++;
+    }
+    if (a2->breakpoints)
+        sbsetcount(a2->breakpoints, count);
 
-        response = tgdb_create_response(a2, TGDB_UPDATE_BREAKPOINTS);
-        response->result_id = id;
-        response->choice.update_breakpoints.breakpoints = breakpoints;
+    count = sbcount(delta->breakpoints);
+    for (i = 0; i < count;)
+    {
+        if (delta->breakpoints[i].number == number)
+        {
+            free(delta->breakpoints[i].file);
+            free(delta->breakpoints[i].funcname);
+            memmove(&delta->breakpoints[i], &delta->breakpoints[i + 1],
+                (count - i - 1) * sizeof(delta->breakpoints[0]));
+            count--;
+        }
+        else
+            i++;
     }
+    if (delta->breakpoints)
+        sbsetcount(delta->breakpoints, count);
 
-    mi_free_output(miout);
+    commands_copy_breakpoints(&a2->breakpoints, breakpoints);
+    for (i = 0; i < sbcount(breakpoints); i++)
+        sbpush(delta->breakpoints, breakpoints[i]);
+    sbfree(breakpoints);
 }
 
 /* process's command completion
@@ -620,45 +831,200 @@ commands_process_disassemble_func(struct annotate_two *a2, struct ibuf *buf,
     response->choice.update_disassemble.is_disasm_function = is_disasm_function;
 }
 
-int commands_process_cgdb_gdbmi(struct annotate_two *a2, struct ibuf *buf,
-    int result_record, char *result_line, int id)
+/* The names cgdb-gdbmi blocks use to say what command they are for.
+ * Names are matched as prefixes, so a name comes before its prefixes. */
+static const struct
 {
-    const char *state = strchr(ibuf_get(buf), ':');
+    enum annotate_commands command;
+    const char *name;
+} command_names[] = {
+    { ANNOTATE_INFO_SOURCES, "info_sources" },
+    { ANNOTATE_INFO_SOURCE, "info_source" },
+    { ANNOTATE_INFO_FRAME, "info_frame" },
+    { ANNOTATE_DISASSEMBLE_FUNC, "info_disassemble_func" },
+    { ANNOTATE_DISASSEMBLE, "info_disassemble" },
+    { ANNOTATE_INFO_BREAKPOINTS, "info_breakpoints" },
+    { ANNOTATE_COMPLETE, "info_complete" },
+    { ANNOTATE_GDB_VERSION, "gdb_version" },
+    { ANNOTATE_TTY, "info_tty" },
+    { ANNOTATE_NEW_UI, "new_ui" },
+};
+
+static const char *commands_get_name(enum annotate_commands com)
+{
+    size_t i;
 
-    if (!state)
+    for (i = 0; i < sizeof(command_names) / sizeof(command_names[0]); i++)
     {
-        clog_error(CLOG_CGDB,
-            "commands_process_cgdb_gdbmi state error");
-        return -1;
+        if (command_names[i].command == com)
+            return command_names[i].name;
     }
 
-    state++;
-    if (!strncmp(state, "info_sources", 12))
+    return "unknown";
+}
+
+/* commands_process: Dispatch the output of a command to its parser.
+ *
+ *    com           -> the command the output is for.
+ *    buf           -> the stream records output by the command.
+ *    result_record -> the result class of the result record.
+ *    result_line   -> the result record.
+ *    id            -> the token of the command.
+ */
+static int commands_process(struct annotate_two *a2,
+    enum annotate_commands com, struct ibuf *buf,
+    int result_record, char *result_line, int id)
+{
+    switch (com)
+    {
+    case ANNOTATE_INFO_SOURCES:
         commands_process_sources(a2, buf, result_record, result_line, id);
-    else if (!strncmp(state, "info_source", 11))
+        break;
+    case ANNOTATE_INFO_SOURCE:
         commands_process_info_source(a2, buf, result_record, result_line, id);
-    else if (!strncmp(state, "info_frame", 10))
+        break;
+    case ANNOTATE_INFO_FRAME:
         commands_process_info_frame(a2, buf, result_record, result_line, id);
-    else if (!strncmp(state, "info_disassemble_func", 21))
+        break;
+    case ANNOTATE_DISASSEMBLE_FUNC:
         commands_process_disassemble_func(a2, buf, result_record, result_line, id, 1);
-    else if (!strncmp(state, "info_disassemble", 16))
+        break;
+    case ANNOTATE_DISASSEMBLE:
         commands_process_disassemble_func(a2, buf, result_record, result_line, id, 0);
-    else if (!strncmp(state, "info_breakpoints", 16))
+        break;
+    case ANNOTATE_INFO_BREAKPOINTS:
         commands_process_breakpoints(a2, buf, result_record, result_line, id);
-    else if (!strncmp(state, "info_complete", 13))
+        break;
+    case ANNOTATE_COMPLETE:
         commands_process_complete(a2, buf, result_record, result_line, id);
-    else if (!strncmp(state, "gdb_version", 11))
+        break;
+    case ANNOTATE_GDB_VERSION:
         commands_process_gdbversion(a2, buf, result_record, result_line, id);
-    else if (!strncmp(state, "info_tty", 8))
-        ;
-    else
+        break;
+    case ANNOTATE_NEW_UI:
+        commands_process_new_ui(a2, buf, result_record, result_line, id);
+        break;
+    case ANNOTATE_TTY:
+        break;
+    default:
+        clog_error(CLOG_CGDB, "commands_process error");
+        return -1;
+    }
+
+    return 0;
+}
+
+int commands_process_cgdb_gdbmi(struct annotate_two *a2, struct ibuf *buf,
+    int result_record, char *result_line, int id)
+{
+    size_t i;
+    const char *state = strchr(ibuf_get(buf), ':');
+
+    if (!state)
     {
         clog_error(CLOG_CGDB,
-            "commands_process_cgdb_gdbmi error");
+            "commands_process_cgdb_gdbmi state error");
         return -1;
     }
 
-    return 0;
+    state++;
+    for (i = 0; i < sizeof(command_names) / sizeof(command_names[0]); i++)
+    {
+        if (!strncmp(state, command_names[i].name,
+                strlen(command_names[i].name)))
+        {
+            return commands_process(a2, command_names[i].command,
+                buf, result_record, result_line, id);
+        }
+    }
+
+    clog_error(CLOG_CGDB,
+        "commands_process_cgdb_gdbmi error");
+    return -1;
+}
+
+/* Hand a result record from the GDB/MI channel to the command it's for */
+static void commands_process_mi_result(struct annotate_two *a2,
+    int result_record, char *result_line, int id)
+{
+    int i;
+    int count = sbcount(a2->mi_commands);
+
+    for (i = 0; i < count; i++)
+    {
+        struct tgdb_command *tc = a2->mi_commands[i];
+
+        if (tc->id == id)
+        {
+            memmove(&a2->mi_commands[i], &a2->mi_commands[i + 1],
+                (count - i - 1) * sizeof(a2->mi_commands[0]));
+            sbsetcount(a2->mi_commands, count - 1);
+
+            /* Don't let the front end see answers that are out of date */
+            if (tc->superseded ||
+                (tc->per_stop && tc->generation != a2->stop_generation))
+            {
+                clog_debug(CLOG_GDBIO, "dropped stale result %d", id);
+                tgdb_request_destroy(tgdb_pop_request_id(id));
+            }
+            else
+            {
+                commands_process(a2, tc->command, a2->mi_output,
+                    result_record, result_line, id);
+            }
+
+            tgdb_command_destroy(tc);
+            return;
+        }
+    }
+
+    clog_error(CLOG_CGDB, "no GDB/MI command with id %d", id);
+}
+
+void commands_process_mi_output(struct annotate_two *a2,
+    const char *data, size_t size)
+{
+    size_t i;
+
+    for (i = 0; i < size; i++)
+    {
+        int id;
+        int result_record;
+        char *result_line;
+        char *line;
+
+        if (data[i] == '\r')
+            continue;
+
+        ibuf_addchar(a2->mi_line, data[i]);
+        if (data[i] != '\n')
+            continue;
+
+        line = ibuf_get(a2->mi_line);
+
+        /* Stream records are output of the command being run. Like in a
+         * cgdb-gdbmi block, its result record follows them. */
+        if (line[0] == '~' || line[0] == '&' || line[0] == '@')
+        {
+            ibuf_add(a2->mi_output, line);
+        }
+        else if (!strncmp(line, "=breakpoint-", 12))
+        {
+            commands_process_breakpoint_notify(a2, line);
+        }
+        else if (mi_get_result_record(a2->mi_line, &result_line, &id) != -1)
+        {
+            ibuf_add(a2->mi_output, line);
+            result_record = mi_get_result_record(a2->mi_output,
+                &result_line, &id);
+
+            commands_process_mi_result(a2, result_record, result_line, id);
+            ibuf_clear(a2->mi_output);
+        }
+
+        /* The (gdb) prompt and other async records are dropped */
+        ibuf_clear(a2->mi_line);
+    }
 }
 
 /** 
@@ -671,14 +1037,13 @@ int commands_process_cgdb_gdbmi(struct annotate_two *a2, struct ibuf *buf,
  * Information that may be needed to create the command
  *
  * \return
- * A command ready to be run through the debugger or NULL on error.
+ * The GDB/MI command, without a token, or NULL on error.
  * The memory is malloc'd, and must be freed.
  */
 static char *create_gdb_command(enum annotate_commands com,
-    const char *data, int command_id)
+    const char *data)
 {
     char *cmd = NULL;
-    const char *name = NULL;
 
     /*
      * TODO mikesart
@@ -697,69 +1062,92 @@ static char *create_gdb_command(enum annotate_commands com,
     switch (com)
     {
     case ANNOTATE_GDB_VERSION:
-        name = "gdb_version";
         cmd = strdup("-gdb-version");
         break;
     case ANNOTATE_INFO_SOURCES:
         /* server info sources */
-        name = "info_sources";
         cmd = strdup("-file-list-exec-source-files");
         break;
     case ANNOTATE_INFO_SOURCE:
         /* server info source */
-        name = "info_source";
         cmd = strdup("-file-list-exec-source-file");
         break;
     case ANNOTATE_INFO_FRAME:
         /* server info frame */
-        name = "info_frame";
         cmd = strdup("-stack-info-frame");
         break;
     case ANNOTATE_DISASSEMBLE:
         /* x/20i $pc */
-        name = "info_disassemble";
         cmd = sys_aprintf("x/%s", data);
         break;
     case ANNOTATE_DISASSEMBLE_FUNC:
-        name = "info_disassemble_func";
         cmd = sys_aprintf("disassemble %s", data ? data : "");
         break;
     case ANNOTATE_INFO_BREAKPOINTS:
         /* server info breakpoints */
-        name = "info_breakpoints";
         cmd = strdup("-break-info");
         break;
     case ANNOTATE_TTY:
         /* server tty %s */
-        name = "info_tty";
         cmd = sys_aprintf("-inferior-tty-set %s", data);
         break;
     case ANNOTATE_COMPLETE:
         /* server complete */
-        name = "info_complete";
         cmd = sys_aprintf("complete %s", data);
         break;
+    case ANNOTATE_NEW_UI:
+        cmd = sys_aprintf("new-ui mi %s", data);
+        break;
     default:
         clog_error(CLOG_CGDB, "switch error");
         break;
     };
 
-    if (cmd)
+    return cmd;
+}
+
+/* The key of a command, see tgdb_command. cmd is the GDB/MI command. */
+static char *commands_get_key(enum annotate_commands com, const char *cmd)
+{
+    switch (com)
     {
-        /* Add our gdbmi command with the cgdb-gdbmi pre-command annotation */
-        char *fullcmd = sys_aprintf("server echo \\n\\032\\032cgdb-gdbmi%d:%s\n"
-                                    "server interp mi \"%d%s\"\n",
-            command_id, name, command_id, cmd);
-        free(cmd);
-        return fullcmd;
+    case ANNOTATE_INFO_FRAME:
+    case ANNOTATE_INFO_SOURCE:
+        /* info_source is what info_frame falls back on */
+        return strdup("location");
+    case ANNOTATE_INFO_BREAKPOINTS:
+    case ANNOTATE_INFO_SOURCES:
+    case ANNOTATE_TTY:
+        return strdup(commands_get_name(com));
+    case ANNOTATE_DISASSEMBLE:
+    case ANNOTATE_DISASSEMBLE_FUNC:
+    case ANNOTATE_COMPLETE:
+        /* Only the same command again */
+        return strdup(cmd);
+    default:
+        return NULL;
     }
+}
 
-    return NULL;
+/* Whether the answer to a command describes the stop it was issued in */
+static int commands_is_per_stop(enum annotate_commands com, const char *data)
+{
+    switch (com)
+    {
+    case ANNOTATE_INFO_FRAME:
+    case ANNOTATE_INFO_SOURCE:
+        return 1;
+    case ANNOTATE_DISASSEMBLE:
+        return data && strstr(data, "$pc");
+    default:
+        return 0;
+    }
 }
 
 void tgdb_command_destroy(struct tgdb_command *tc)
 {
     free(tc->gdb_command);
+    free(tc->key);
     free(tc);
 }
 
@@ -771,6 +1159,35 @@ int tgdb_get_gdb_version(int *major, int *minor)
     return (gdb_version_major > 0);
 }
 
+/* Wrap a GDB/MI command to run in the console, with the cgdb-gdbmi
+ * pre-command annotation in front of it */
+static char *commands_wrap_console(enum annotate_commands command, int id,
+    const char *cmd, int len)
+{
+    return sys_aprintf("server echo \\n\\032\\032cgdb-gdbmi%d:%s\n"
+                       "server interp mi \"%d%.*s\"\n",
+        id, commands_get_name(command), id, len, cmd);
+}
+
+void commands_move_to_console(struct tgdb_command *tc)
+{
+    char *gdb_command = tc->gdb_command;
+    const char *cmd = gdb_command;
+
+    if (!tc->mi)
+        return;
+
+    /* Skip the token, and leave the newline off */
+    while (isdigit(*cmd))
+        cmd++;
+
+    tc->gdb_command = commands_wrap_console(tc->command, tc->id,
+        cmd, strcspn(cmd, "\n"));
+    tc->mi = 0;
+
+    free(gdb_command);
+}
+
 static int command_get_next_id()
 {
     static int command_id = 100;
@@ -782,16 +1199,40 @@ void commands_issue_command(struct annotate_two *a2,
     enum annotate_commands command, const char *data, int oob, int *id)
 {
     struct tgdb_command *tc;
-    int command_id = command_get_next_id();
-    char *gdb_command = create_gdb_command(command, data, command_id);
+    char *gdb_command;
+    int command_id;
+    char *cmd = create_gdb_command(command, data);
 
     enum tgdb_command_choice choice = oob ?
         TGDB_COMMAND_TGDB_CLIENT_PRIORITY : TGDB_COMMAND_TGDB_CLIENT;
 
+    if (!cmd)
+        return;
+
+    command_id = command_get_next_id();
+
+    if (a2->mi_state == A2_MI_READY)
+    {
+        /* The GDB/MI channel takes the command with its token */
+        gdb_command = sys_aprintf("%d%s\n", command_id, cmd);
+    }
+    else
+    {
+        gdb_command = commands_wrap_console(command, command_id, cmd, strlen(cmd));
+    }
+
     tc = (struct tgdb_command *)cgdb_malloc(sizeof(struct tgdb_command));
     tc->command_choice = choice;
     tc->command = command;
     tc->gdb_command = gdb_command;
+    tc->id = command_id;
+    tc->mi = (a2->mi_state == A2_MI_READY);
+    tc->key = commands_get_key(command, cmd);
+    tc->generation = a2->stop_generation;
+    tc->per_stop = commands_is_per_stop(command, data);
+    tc->superseded = 0;
+
+    free(cmd);
 
     /* Append to the command_container the commands */
     sbpush(a2->client_commands, tc);
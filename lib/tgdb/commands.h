@@ -44,6 +44,26 @@ struct tgdb_command
 
     /** Private data the client context can use. */
     enum annotate_commands command;
+
+    /** The token gdb puts on the result record of an internal command */
+    int id;
+
+    /** Set if the command goes to the GDB/MI channel, not the console */
+    int mi;
+
+    /**
+     * Commands with the same key ask gdb for the same thing, so a newer one
+     * supersedes the older ones. NULL if the command is never superseded. */
+    char *key;
+
+    /** The stop generation of the inferior when the command was issued */
+    int generation;
+
+    /** Set if the answer is only good for the stop it was issued in */
+    int per_stop;
+
+    /** Set when a newer command with the same key was sent after this one */
+    int superseded;
 };
 
 /**
@@ -56,6 +76,14 @@ struct tgdb_command
  */
 void tgdb_command_destroy(struct tgdb_command *tc);
 
+/**
+ * Free a stretchy buffer of breakpoints and the strings in them.
+ *
+ * \param breakpoints
+ * The breakpoints to free
+ */
+void commands_free_breakpoints(struct tgdb_breakpoint *breakpoints);
+
 /**
  * Get gdb version, major and minor numbers.
  * Ie, major:7, minor:10
@@ -72,6 +100,14 @@ int tgdb_get_gdb_version(int *major, int *minor);
 void commands_issue_command(struct annotate_two *a2,
     enum annotate_commands commmand, const char *data, int oob, int *id);
 
+/* commands_move_to_console:
+ * -------------------------
+ *
+ *  Change a command issued to the GDB/MI channel into the one that would
+ *  have been issued to the console, keeping its token.
+ */
+void commands_move_to_console(struct tgdb_command *tc);
+
 /* commands_process: This function receives the output from gdb when gdb
  *                   is running a command on behalf of this package.
  *
@@ -81,4 +117,16 @@ void commands_issue_command(struct annotate_two *a2,
 int commands_process_cgdb_gdbmi(struct annotate_two *a2, struct ibuf *buf,
     int result_record, char *result_line, int id);
 
+/* commands_process_mi_output: This function receives the output of the
+ *                             GDB/MI channel. Each result record is
+ *                             matched by its token to the command sent.
+ *                             Breakpoint notifications update the
+ *                             breakpoint table.
+ *
+ *    data  -> the data read from the channel.
+ *    size  -> the number of bytes in data.
+ */
+void commands_process_mi_output(struct annotate_two *a2,
+    const char *data, size_t size);
+
 #endif /* __COMMANDS_H__ */
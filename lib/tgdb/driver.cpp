@@ -181,30 +181,10 @@ static void driver_prompt_change(const char *new_prompt)
     change_prompt(nprompt);
 }
 
-static int gdb_input(void)
+static int process_responses(void)
 {
-    size_t i;
-    size_t size;
-    char buf[MAXLINE];
-    int is_finished;
     struct tgdb_response *item;
 
-    if ((size = tgdb_process(tgdb, buf, MAXLINE, &is_finished)) == -1)
-    {
-        clog_error(CLOG_CGDB, "file descriptor closed");
-        return -1;
-    }
-
-    for (i = 0; i < size; ++i)
-    {
-        if (write(STDOUT_FILENO, &(buf[i]), 1) != 1)
-        {
-            clog_error(CLOG_CGDB,
-                "could not write byte");
-            return -1;
-        }
-    }
-
     int index = 0;
     while ((item = tgdb_get_response(tgdb, index++)) != NULL)
     {
@@ -228,6 +208,42 @@ static int gdb_input(void)
         }
     }
 
+    return 0;
+}
+
+static int mi_input(void)
+{
+    tgdb_process_mi(tgdb);
+
+    return process_responses();
+}
+
+static int gdb_input(void)
+{
+    size_t i;
+    size_t size;
+    char buf[MAXLINE];
+    int is_finished;
+
+    if ((size = tgdb_process(tgdb, buf, MAXLINE, &is_finished)) == -1)
+    {
+        clog_error(CLOG_CGDB, "file descriptor closed");
+        return -1;
+    }
+
+    for (i = 0; i < size; ++i)
+    {
+        if (write(STDOUT_FILENO, &(buf[i]), 1) != 1)
+        {
+            clog_error(CLOG_CGDB,
+                "could not write byte");
+            return -1;
+        }
+    }
+
+    if (process_responses() == -1)
+        return -1;
+
     if (is_finished)
     {
         int qsize;
@@ -371,7 +387,7 @@ int main_loop(int gdbfd)
     fd_set rfds;
     int result;
 
-    int masterfd, slavefd, childfd;
+    int masterfd, slavefd, childfd, mifd;
 
     masterfd = pty_pair_get_masterfd(pty_pair);
     if (masterfd == -1)
@@ -396,11 +412,13 @@ int main_loop(int gdbfd)
 
         /* get max fd  for select loop */
         childfd = tgdb_get_inferior_fd(tgdb);
+        mifd = tgdb_get_mi_fd(tgdb);
 
         max = (gdbfd > STDIN_FILENO) ? gdbfd : STDIN_FILENO;
         max = (max > childfd) ? max : childfd;
         max = (max > slavefd) ? max : slavefd;
         max = (max > masterfd) ? max : masterfd;
+        max = (max > mifd) ? max : mifd;
 
         /* Clear the set and 
          *
@@ -421,6 +439,9 @@ int main_loop(int gdbfd)
         if (childfd != -1)
             FD_SET(childfd, &rfds);
 
+        if (mifd != -1)
+            FD_SET(mifd, &rfds);
+
         result = select(max + 1, &rfds, NULL, NULL, NULL);
 
         /* if the signal interrupted system call keep going */
@@ -452,6 +473,11 @@ int main_loop(int gdbfd)
             continue;
         }
 
+        /* gdb's answers to tgdb's own commands */
+        if (mifd != -1 && FD_ISSET(mifd, &rfds))
+            if (mi_input() == -1)
+                return -1;
+
         /* gdb's output -> stdout  */
         if (FD_ISSET(gdbfd, &rfds))
             if (gdb_input() == -1)
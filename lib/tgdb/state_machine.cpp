@@ -151,15 +151,18 @@ void data_set_state(struct annotate_two *a2, enum internal_state state)
     }
 }
 
-static void data_process(struct annotate_two *a2, char a, char *buf, int *n)
+/* Pass a span of gdb's output on to the front end, or to the prompt */
+static void data_process(struct annotate_two *a2, const char *data, size_t size,
+    char *buf, int *n)
 {
     switch (a2->sm->data_state)
     {
     case VOID:
-        buf[(*n)++] = a;
+        memcpy(buf + *n, data, size);
+        *n += size;
         break;
     case AT_PROMPT:
-        ibuf_addchar(a2->sm->gdb_prompt, a);
+        ibuf_adddata(a2->sm->gdb_prompt, data, size);
         break;
     case USER_AT_PROMPT:
     case USER_COMMAND:
@@ -196,10 +199,20 @@ handle_frames_invalid(struct annotate_two *a2, const char *buf, size_t n)
     return 0;
 }
 
+/* starting: The inferior is resuming, where it stopped no longer matters. */
+static int
+handle_starting(struct annotate_two *a2, const char *buf, size_t n)
+{
+    a2->stop_generation++;
+    return 0;
+}
+
 static int
 handle_breakpoints_invalid(struct annotate_two *a2, const char *buf, size_t n)
 {
-    commands_issue_command(a2, ANNOTATE_INFO_BREAKPOINTS, NULL, 0, NULL);
+    /* The GDB/MI channel's breakpoint notifications say what changed */
+    if (a2->mi_state != A2_MI_READY)
+        commands_issue_command(a2, ANNOTATE_INFO_BREAKPOINTS, NULL, 0, NULL);
     return 0;
 }
 
@@ -323,6 +336,7 @@ static struct annotation
     { "breakpoints-invalid", 19, handle_breakpoints_invalid },
     { "frame-end", 9, handle_frame_end },
     { "frames-invalid", 14, handle_frames_invalid },
+    { "starting", 8, handle_starting },
     { "pre-commands", 12, handle_misc_pre_prompt },
     { "commands", 8, handle_misc_prompt },
     { "post-commands", 13, handle_misc_post_prompt },
@@ -369,28 +383,82 @@ static int tgdb_parse_annotation(struct annotate_two *a2,
     return 0;
 }
 
+/* The characters a2_parse_io stops at. Everything between them is copied
+ * in one go. */
+static const char sm_stop_chars[] = { '\r', '\n', '\032' };
+#define SM_STOP_CHAR_COUNT (sizeof(sm_stop_chars) / sizeof(sm_stop_chars[0]))
+
+/* Where the next of each stop character is in the data being parsed */
+struct sm_scan
+{
+    const char *data;
+    size_t size;
+    size_t next[SM_STOP_CHAR_COUNT]; /* size if there isn't one */
+    int scanned;                     /* If next has been filled in */
+};
+
+/* Returns the position of the first stop character at or after pos, or size
+ * if there isn't one. A character is only searched for again once the last
+ * one found has been passed, so the data is scanned once for each. */
+static size_t sm_scan_next(struct sm_scan *scan, size_t pos)
+{
+    size_t k;
+    size_t next = scan->size;
+
+    for (k = 0; k < SM_STOP_CHAR_COUNT; k++)
+    {
+        if (!scan->scanned || scan->next[k] < pos)
+        {
+            const char *p = (const char *)memchr(scan->data + pos,
+                sm_stop_chars[k], scan->size - pos);
+
+            scan->next[k] = p ? p - scan->data : scan->size;
+        }
+
+        if (scan->next[k] < next)
+            next = scan->next[k];
+    }
+
+    scan->scanned = 1;
+    return next;
+}
+
 void a2_parse_io(struct annotate_two *a2,
     const char *data, const size_t size,
     char *gui_data, size_t *gui_size)
 {
-    int i;
+    size_t i = 0;
+    size_t end;
     int gui_len = 0;
     struct state_machine *sm = a2->sm;
+    struct sm_scan scan;
+
+    scan.data = data;
+    scan.size = size;
+    scan.scanned = 0;
 
     /* track state to find next file and line number */
-    for (i = 0; i < size; ++i)
+    while (i < size)
     {
         /* Handle cgdb_gdbmi block */
         if (sm->tgdb_state == SM_CGDB_GDBMI)
         {
-            if (data[i] != '\r')
-                ibuf_addchar(sm->cgdb_gdbmi_buffer, data[i]);
+            /* Only lines matter here, ^Z is added like any character */
+            end = sm_scan_next(&scan, i);
+            while (end < size && data[end] == '\032')
+                end = sm_scan_next(&scan, end + 1);
+
+            ibuf_adddata(sm->cgdb_gdbmi_buffer, data + i, end - i);
+            i = end;
 
-            if (data[i] == '\n')
+            if (i < size && data[i] == '\n')
             {
                 int id;
                 char *result_line;
-                int result_record = mi_get_result_record(
+                int result_record;
+
+                ibuf_addchar(sm->cgdb_gdbmi_buffer, '\n');
+                result_record = mi_get_result_record(
                         sm->cgdb_gdbmi_buffer, &result_line, &id);
 
                 if (result_record != -1)
@@ -404,6 +472,8 @@ void a2_parse_io(struct annotate_two *a2,
                 }
             }
 
+            /* Skip the newline or car return */
+            i++;
             continue;
         }
 
@@ -420,12 +490,11 @@ void a2_parse_io(struct annotate_two *a2,
                 break;
             case SM_NEW_LINE:
                 sm->tgdb_state = SM_NEW_LINE;
-                data_process(a2, '\n', gui_data, &gui_len);
+                data_process(a2, "\n", 1, gui_data, &gui_len);
                 break;
             case SM_CONTROL_Z:
                 sm->tgdb_state = SM_DATA;
-                data_process(a2, '\n', gui_data, &gui_len);
-                data_process(a2, '\032', gui_data, &gui_len);
+                data_process(a2, "\n\032", 2, gui_data, &gui_len);
                 break;
             case SM_ANNOTATION:
             {
@@ -459,7 +528,7 @@ void a2_parse_io(struct annotate_two *a2,
             {
             case SM_DATA:
                 sm->tgdb_state = SM_DATA;
-                data_process(a2, '\032', gui_data, &gui_len);
+                data_process(a2, "\032", 1, gui_data, &gui_len);
                 break;
             case SM_NEW_LINE:
                 sm->tgdb_state = SM_CONTROL_Z;
@@ -479,46 +548,44 @@ void a2_parse_io(struct annotate_two *a2,
             } /* end switch */
             break;
         default:
+            /* Copy everything up to the next stop character. The data
+             * state only changes on annotations, so it holds for all of it. */
+            end = sm_scan_next(&scan, i);
+
             switch (sm->tgdb_state)
             {
             case SM_DATA:
-                data_process(a2, data[i], gui_data, &gui_len);
+                data_process(a2, data + i, end - i, gui_data, &gui_len);
                 break;
             case SM_NL_DATA:
                 sm->tgdb_state = SM_DATA;
-                data_process(a2, data[i], gui_data, &gui_len);
+                data_process(a2, data + i, end - i, gui_data, &gui_len);
                 break;
             case SM_NEW_LINE:
                 sm->tgdb_state = SM_DATA;
-                data_process(a2, '\n', gui_data, &gui_len);
-                data_process(a2, data[i], gui_data, &gui_len);
+                data_process(a2, "\n", 1, gui_data, &gui_len);
+                data_process(a2, data + i, end - i, gui_data, &gui_len);
                 break;
             case SM_CONTROL_Z:
                 sm->tgdb_state = SM_DATA;
-                data_process(a2, '\n', gui_data, &gui_len);
-                data_process(a2, '\032', gui_data, &gui_len);
-                data_process(a2, data[i], gui_data, &gui_len);
+                data_process(a2, "\n\032", 2, gui_data, &gui_len);
+                data_process(a2, data + i, end - i, gui_data, &gui_len);
                 break;
             case SM_ANNOTATION:
-            {
-                int end;
-                for (end = i + 1; end < size; end++)
-                {
-                    if ((data[end] == '\r') || (data[end] == '\n') || (data[end] == '\032'))
-                        break;
-                }
-
                 ibuf_adddata(sm->tgdb_buffer, data + i, end - i);
-                i = end - 1;
                 break;
-            }
             default:
                 clog_error(CLOG_CGDB, "Bad state transition");
+                end = i + 1;
                 break;
             } /* end switch */
-            break;
+
+            i = end;
+            continue;
         } /* end switch */
-    } /* end for */
+
+        i++;
+    } /* end while */
 
     gui_data[gui_len] = '\0';
     *gui_size = gui_len;
@@ -0,0 +1,538 @@
+/* state_machine_driver:
+ * ---------------------
+ *
+ * Checks a2_parse_io against the byte at a time parser it replaced and
+ * measures how fast they are.
+ *
+ * Random gdb output, with annotations, cgdb-gdbmi blocks, car returns and
+ * stray ^Zs, is fed to both parsers in the same chunks, from 1 byte at a
+ * time up to all of it at once. What goes to the front end, the prompt,
+ * the data state, the commands issued and the responses created have to
+ * be the same after every chunk.
+ *
+ * Usage: state_machine_driver
+ */
+
+/* The parser's state and handlers are private to state_machine.cpp, so
+ * it's built into this driver instead of coming from libtgdb.a */
+#include "state_machine.cpp"
+
+#if HAVE_STDLIB_H
+#include <stdlib.h>
+#endif /* HAVE_STDLIB_H */
+
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+
+/* Bytes of gdb output generated for each seed */
+#define OUTPUT_SIZE (256 * 1024)
+
+/* Seeds the output is generated with */
+#define SEEDS 8
+
+/* Times each benchmark is run, the best run is reported */
+#define RUNS 5
+
+/* The parser a2_parse_io used to be: a switch for each byte */
+static void a2_parse_io_bytes(struct annotate_two *a2,
+    const char *data, const size_t size,
+    char *gui_data, size_t *gui_size)
+{
+    size_t i;
+    int gui_len = 0;
+    struct state_machine *sm = a2->sm;
+
+    for (i = 0; i < size; ++i)
+    {
+        /* Handle cgdb_gdbmi block */
+        if (sm->tgdb_state == SM_CGDB_GDBMI)
+        {
+            if (data[i] != '\r')
+                ibuf_addchar(sm->cgdb_gdbmi_buffer, data[i]);
+
+            if (data[i] == '\n')
+            {
+                int id;
+                char *result_line;
+                int result_record = mi_get_result_record(
+                        sm->cgdb_gdbmi_buffer, &result_line, &id);
+
+                if (result_record != -1)
+                {
+                    commands_process_cgdb_gdbmi(a2, sm->cgdb_gdbmi_buffer,
+                        result_record, result_line, id);
+
+                    sm->tgdb_state = SM_NL_DATA;
+                    ibuf_clear(sm->cgdb_gdbmi_buffer);
+                }
+            }
+
+            continue;
+        }
+
+        switch (data[i])
+        {
+        case '\r':
+            break;
+        case '\n':
+            switch (sm->tgdb_state)
+            {
+            case SM_DATA:
+                sm->tgdb_state = SM_NEW_LINE;
+                break;
+            case SM_NEW_LINE:
+                sm->tgdb_state = SM_NEW_LINE;
+                data_process(a2, "\n", 1, gui_data, &gui_len);
+                break;
+            case SM_CONTROL_Z:
+                sm->tgdb_state = SM_DATA;
+                data_process(a2, "\n", 1, gui_data, &gui_len);
+                data_process(a2, "\032", 1, gui_data, &gui_len);
+                break;
+            case SM_ANNOTATION:
+            {
+                int is_cgdb_gdbmi;
+
+                sm->tgdb_state = SM_NL_DATA;
+                tgdb_parse_annotation(a2, ibuf_get(sm->tgdb_buffer),
+                    ibuf_length(sm->tgdb_buffer), &is_cgdb_gdbmi);
+
+                if (is_cgdb_gdbmi)
+                {
+                    sm->tgdb_state = SM_CGDB_GDBMI;
+                    ibuf_add(sm->cgdb_gdbmi_buffer, ibuf_get(sm->tgdb_buffer));
+                }
+
+                ibuf_clear(sm->tgdb_buffer);
+                break;
+            }
+            case SM_NL_DATA:
+                sm->tgdb_state = SM_NEW_LINE;
+                break;
+            default:
+                break;
+            }
+            break;
+
+        case '\032':
+            switch (sm->tgdb_state)
+            {
+            case SM_DATA:
+                sm->tgdb_state = SM_DATA;
+                data_process(a2, "\032", 1, gui_data, &gui_len);
+                break;
+            case SM_NEW_LINE:
+            case SM_NL_DATA:
+                sm->tgdb_state = SM_CONTROL_Z;
+                break;
+            case SM_CONTROL_Z:
+                sm->tgdb_state = SM_ANNOTATION;
+                break;
+            case SM_ANNOTATION:
+                ibuf_addchar(sm->tgdb_buffer, data[i]);
+                break;
+            default:
+                break;
+            }
+            break;
+        default:
+            switch (sm->tgdb_state)
+            {
+            case SM_DATA:
+                data_process(a2, data + i, 1, gui_data, &gui_len);
+                break;
+            case SM_NL_DATA:
+                sm->tgdb_state = SM_DATA;
+                data_process(a2, data + i, 1, gui_data, &gui_len);
+                break;
+            case SM_NEW_LINE:
+                sm->tgdb_state = SM_DATA;
+                data_process(a2, "\n", 1, gui_data, &gui_len);
+                data_process(a2, data + i, 1, gui_data, &gui_len);
+                break;
+            case SM_CONTROL_Z:
+                sm->tgdb_state = SM_DATA;
+                data_process(a2, "\n", 1, gui_data, &gui_len);
+                data_process(a2, "\032", 1, gui_data, &gui_len);
+                data_process(a2, data + i, 1, gui_data, &gui_len);
+                break;
+            case SM_ANNOTATION:
+                ibuf_addchar(sm->tgdb_buffer, data[i]);
+                break;
+            default:
+                break;
+            }
+            break;
+        }
+    }
+
+    gui_data[gui_len] = '\0';
+    *gui_size = gui_len;
+}
+
+typedef void (*parse_io_func)(struct annotate_two *a2,
+    const char *data, const size_t size,
+    char *gui_data, size_t *gui_size);
+
+static unsigned long random_state;
+
+static unsigned int random_next(unsigned int n)
+{
+    random_state = random_state * 6364136223846793005UL + 1442695040888963407UL;
+    return (unsigned int)(random_state >> 33) % n;
+}
+
+static void add_string(char **data, const char *str)
+{
+    int len = strlen(str);
+
+    memcpy(sbadd(*data, len), str, len);
+}
+
+/* Generate gdb output, mostly text with annotations and cgdb-gdbmi
+ * blocks, and the broken up pieces of them the parser has to cope with */
+static char *generate_output(long size)
+{
+    static const char *annotations[] = {
+        "pre-prompt", "prompt", "post-prompt", "breakpoints-invalid",
+        "frame-end", "frames-invalid", "starting", "error-begin", "error",
+        "pre-query", "query", "post-query", "exited 3", "quit",
+        "source /tmp/a.c:5:10:beg:0x400", "frame-begin 0 0x400908",
+    };
+    static const char text[] = "abc xyz=(){}\"\\\t01";
+    char *data = NULL;
+    char buf[512];
+    int id = 100;
+
+    while (sbcount(data) < size)
+    {
+        switch (random_next(14))
+        {
+        case 0:
+        case 1:
+        case 2:
+        {
+            /* Text, with the odd nil */
+            int len = random_next(80);
+
+            while (len--)
+                sbpush(data, text[random_next(sizeof(text))]);
+            break;
+        }
+        case 3:
+            add_string(&data, "\n");
+            break;
+        case 4:
+            add_string(&data, "\r\n");
+            break;
+        case 5:
+            add_string(&data, "\032");
+            break;
+        case 6:
+        case 7:
+            add_string(&data, random_next(2) ? "\n\032\032" : "\r\n\032\032");
+            add_string(&data, annotations[random_next(
+                sizeof(annotations) / sizeof(annotations[0]))]);
+            add_string(&data, random_next(3) ? "\n" : "\r\n");
+            break;
+        case 8:
+            add_string(&data, "(gdb) ");
+            break;
+        case 9:
+        {
+            const char *nl = random_next(2) ? "\n" : "\r\n";
+            int lines = random_next(4);
+            int command = random_next(3);
+
+            snprintf(buf, sizeof(buf), "\n\032\032cgdb-gdbmi%d:%s%s", id,
+                command == 0 ? "info_frame" :
+                command == 1 ? "info_sources" : "info_complete", nl);
+            add_string(&data, buf);
+
+            while (lines--)
+            {
+                snprintf(buf, sizeof(buf), "~\"line \\032 %d\\n\"%s", lines, nl);
+                add_string(&data, buf);
+
+                if (!random_next(4))
+                    add_string(&data, "\032");
+            }
+
+            if (command == 0)
+                snprintf(buf, sizeof(buf), "%d^done,frame={level=\"0\","
+                    "addr=\"0x400908\",func=\"main\",file=\"a.c\","
+                    "fullname=\"/tmp/a.c\",line=\"%d\"}%s",
+                    id, random_next(50), nl);
+            else if (command == 1)
+                snprintf(buf, sizeof(buf), "%d^done,files=[{file=\"a.c\","
+                    "fullname=\"/tmp/a.c\"}]%s", id, nl);
+            else
+                snprintf(buf, sizeof(buf), "%d^done%s", id, nl);
+            add_string(&data, buf);
+            id++;
+            break;
+        }
+        case 10:
+            add_string(&data, "\n\032\n");
+            break;
+        case 11:
+            add_string(&data, "\n\n\032");
+            break;
+        case 12:
+            add_string(&data, "\n\032x");
+            break;
+        case 13:
+            add_string(&data, "\032\032");
+            break;
+        }
+    }
+
+    return data;
+}
+
+static void trace_data(char **trace, const char *data, size_t size)
+{
+    memcpy(sbadd(*trace, (int)size), data, size);
+}
+
+static void trace_int(char **trace, const char *name, int value)
+{
+    char buf[64];
+
+    snprintf(buf, sizeof(buf), " %s=%d", name, value);
+    add_string(trace, buf);
+}
+
+/* Add what a chunk of output did to the trace, and clear it for the next */
+static void trace_chunk(char **trace, struct annotate_two *a2,
+    const char *gui_data, size_t gui_size)
+{
+    int i;
+
+    trace_int(trace, "chunk", (int)gui_size);
+    trace_data(trace, gui_data, gui_size);
+    trace_int(trace, "state", data_get_state(a2->sm));
+    trace_int(trace, "finished", a2->command_finished);
+    trace_int(trace, "misc", sm_is_misc_prompt(a2->sm));
+    trace_int(trace, "frames_invalid", a2->got_frames_invalid_annotation);
+    trace_int(trace, "generation", a2->stop_generation);
+
+    for (i = 0; i < sbcount(a2->client_commands); i++)
+    {
+        trace_int(trace, "command", a2->client_commands[i]->command);
+        tgdb_command_destroy(a2->client_commands[i]);
+    }
+    sbsetcount(a2->client_commands, 0);
+
+    for (i = 0; i < sbcount(a2->responses); i++)
+    {
+        struct tgdb_response *response = a2->responses[i];
+
+        trace_int(trace, "response", response->header);
+
+        switch (response->header)
+        {
+        case TGDB_UPDATE_CONSOLE_PROMPT_VALUE:
+        {
+            const char *prompt =
+                response->choice.update_console_prompt_value.prompt_value;
+
+            trace_data(trace, prompt, strlen(prompt));
+            break;
+        }
+        case TGDB_UPDATE_FILE_POSITION:
+            trace_int(trace, "line", response->choice.update_file_position.
+                file_position->line_number);
+            break;
+        case TGDB_UPDATE_SOURCE_FILES:
+            trace_int(trace, "files",
+                sbcount(response->choice.update_source_files.source_files));
+            break;
+        case TGDB_UPDATE_COMPLETIONS:
+            trace_int(trace, "completions",
+                sbcount(response->choice.update_completions.completions));
+            break;
+        case TGDB_INFERIOR_EXITED:
+            trace_int(trace, "exit",
+                response->choice.inferior_exited.exit_status);
+            break;
+        default:
+            break;
+        }
+    }
+    a2_delete_responses(a2);
+
+    a2->command_finished = 0;
+}
+
+/* Parse output in chunks of 1 to max_chunk bytes, or all of it at once if
+ * max_chunk is 0. Returns the trace of what each chunk did. */
+static char *run_parser(parse_io_func parse_io, const char *data, long size,
+    int max_chunk, unsigned long seed)
+{
+    struct annotate_two *a2 =
+        (struct annotate_two *)cgdb_calloc(1, sizeof(struct annotate_two));
+    char *gui_data = (char *)cgdb_malloc(size * 3 + 1);
+    char *trace = NULL;
+    long pos = 0;
+
+    a2->sm = state_machine_initialize();
+    random_state = seed;
+
+    while (pos < size)
+    {
+        size_t gui_size;
+        long chunk = max_chunk ? 1 + random_next(max_chunk) : size;
+
+        chunk = MIN(chunk, size - pos);
+        parse_io(a2, data + pos, chunk, gui_data, &gui_size);
+        trace_chunk(&trace, a2, gui_data, gui_size);
+
+        pos += chunk;
+    }
+
+    state_machine_shutdown(a2->sm);
+    sbfree(a2->client_commands);
+    sbfree(a2->responses);
+    free(a2);
+    free(gui_data);
+
+    return trace;
+}
+
+/* An annotation split across reads is added to its buffer in pieces */
+static int check_split_annotation(void)
+{
+    static const char *chunks[] = {
+        "\n\032\032pre-pr", "ompt\n(g", "db) ", "\n\032\032pro", "mpt\n"
+    };
+    struct annotate_two *a2 =
+        (struct annotate_two *)cgdb_calloc(1, sizeof(struct annotate_two));
+    const char *prompt = NULL;
+    char gui_data[64];
+    size_t gui_size;
+    size_t i;
+    int result = 0;
+
+    a2->sm = state_machine_initialize();
+
+    for (i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++)
+        a2_parse_io(a2, chunks[i], strlen(chunks[i]), gui_data, &gui_size);
+
+    for (i = 0; i < (size_t)sbcount(a2->responses); i++)
+    {
+        if (a2->responses[i]->header == TGDB_UPDATE_CONSOLE_PROMPT_VALUE)
+            prompt = a2->responses[i]->choice.update_console_prompt_value.prompt_value;
+    }
+
+    if (!prompt || strcmp(prompt, "(gdb) ") ||
+        data_get_state(a2->sm) != USER_AT_PROMPT)
+    {
+        printf("FAIL: prompt split across reads was \"%s\"\n",
+            prompt ? prompt : "");
+        result = 1;
+    }
+
+    a2_delete_responses(a2);
+    sbfree(a2->responses);
+    state_machine_shutdown(a2->sm);
+    free(a2);
+
+    return result;
+}
+
+static double get_time(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/* Times parsing plain text in reads of 4096 bytes, like tgdb_process */
+static void benchmark(const char *name, parse_io_func parse_io)
+{
+    static char data[4096];
+    static char gui_data[4096 + 1];
+    struct annotate_two *a2 =
+        (struct annotate_two *)cgdb_calloc(1, sizeof(struct annotate_two));
+    long size = 64 * 1024 * 1024;
+    double best = 1e9;
+    size_t i;
+    int run;
+
+    for (i = 0; i < sizeof(data); i++)
+        data[i] = (i % 80 == 79) ? '\n' : 'a' + i % 26;
+
+    a2->sm = state_machine_initialize();
+
+    for (run = 0; run < RUNS; run++)
+    {
+        double start = get_time();
+        long pos;
+
+        for (pos = 0; pos < size; pos += sizeof(data))
+        {
+            size_t gui_size;
+
+            parse_io(a2, data, sizeof(data), gui_data, &gui_size);
+        }
+
+        best = MIN(best, get_time() - start);
+    }
+
+    printf("%-28s %8.1f MB/s\n", name, size / best / (1024.0 * 1024.0));
+
+    state_machine_shutdown(a2->sm);
+    free(a2);
+}
+
+int main(int argc, char **argv)
+{
+    static const int max_chunks[] = { 1, 3, 17, 200, 4096, 0 };
+    unsigned long seed;
+    size_t i;
+    int failed = 0;
+
+    /* Errors from handling the random output go to stderr */
+    clog_init_fd(CLOG_CGDB_ID, STDERR_FILENO);
+    clog_init_fd(CLOG_GDBIO_ID, STDERR_FILENO);
+
+    for (seed = 1; seed <= SEEDS; seed++)
+    {
+        char *data;
+
+        random_state = seed;
+        data = generate_output(OUTPUT_SIZE);
+
+        for (i = 0; i < sizeof(max_chunks) / sizeof(max_chunks[0]); i++)
+        {
+            char *expected = run_parser(a2_parse_io_bytes, data,
+                sbcount(data), max_chunks[i], seed);
+            char *trace = run_parser(a2_parse_io, data,
+                sbcount(data), max_chunks[i], seed);
+
+            if (sbcount(expected) != sbcount(trace) ||
+                memcmp(expected, trace, sbcount(trace)))
+            {
+                printf("FAIL: seed %lu in chunks of up to %d bytes differs\n",
+                    seed, max_chunks[i]);
+                failed = 1;
+            }
+
+            sbfree(expected);
+            sbfree(trace);
+        }
+
+        sbfree(data);
+    }
+
+    failed |= check_split_annotation();
+
+    benchmark("parse (byte at a time)", a2_parse_io_bytes);
+    benchmark("parse (spans)", a2_parse_io);
+
+    printf(failed ? "FAILED\n" : "PASSED\n");
+    return failed;
+}
@@ -110,6 +110,16 @@ struct tgdb
      */
     struct tgdb_command **oob_input_queue;
 
+    /**
+     * The GDB/MI channel input queue.
+     *
+     * When gdb runs a GDB/MI interpreter for TGDB on a pty of its own, the
+     * client context's commands are sent there instead of the console.
+     * They don't wait for the console prompt, only for the result of the
+     * command sent before them on the channel.
+     */
+    struct tgdb_command **mi_input_queue;
+
     /** These are 2 very important state variables.  */
 
     /**
@@ -123,6 +133,14 @@ struct tgdb
      * Basically whether gdb is at prompt or not. */
     int is_gdb_ready_for_next_command;
 
+    /**
+     * The round trips made to gdb for internal commands, the internal
+     * commands sent in them and the console commands run, since TGDB was
+     * last idle. They're written to the debug log when TGDB goes idle. */
+    int round_trips;
+    int round_trip_commands;
+    int round_trip_steps;
+
     /** If ^c was hit by user */
     sig_atomic_t control_c;
 
@@ -159,6 +177,7 @@ struct tgdb
 static void tgdb_deliver_command(struct tgdb *tgdb, struct tgdb_command *command);
 static void tgdb_unqueue_and_deliver_command(struct tgdb *tgdb);
 static void tgdb_run_or_queue_command(struct tgdb *tgdb, struct tgdb_command *com);
+static void tgdb_mi_deliver_commands(struct tgdb *tgdb);
 
 /* }}} */
 
@@ -197,6 +216,29 @@ static int tgdb_has_command_to_run(struct tgdb *tgdb)
     return 0;
 }
 
+/**
+ * Determines if a request is answered on the GDB/MI channel. These requests
+ * don't have to wait for the console to be at the prompt.
+ *
+ * \return
+ * 1 if the request goes to the GDB/MI channel. Otherwise 0.
+ */
+static int tgdb_request_uses_mi(struct tgdb *tgdb, struct tgdb_request *request)
+{
+    if (tgdb->a2->mi_state != A2_MI_READY)
+        return 0;
+
+    switch (request->header)
+    {
+    case TGDB_REQUEST_CONSOLE_COMMAND:
+    case TGDB_REQUEST_DEBUGGER_COMMAND:
+    case TGDB_REQUEST_MODIFY_BREAKPOINT:
+        return 0;
+    default:
+        return 1;
+    }
+}
+
 /**
  * If the TGDB instance is not busy, it will run the requested command.
  * Otherwise, the command will get queued to run later.
@@ -212,7 +254,8 @@ static int tgdb_has_command_to_run(struct tgdb *tgdb)
  */
 static void handle_request(struct tgdb *tgdb_in, struct tgdb_request *request)
 {
-    if (tgdb_can_issue_command(tgdb_in))
+    if (tgdb_request_uses_mi(tgdb_in, request) ||
+        tgdb_can_issue_command(tgdb_in))
     {
         tgdb_process_command(tgdb_in, request);
     }
@@ -245,6 +288,15 @@ tgdb_request_ptr tgdb_pop_request_id(int id)
     return NULL;
 }
 
+/* Keep a request around until its response arrives, if it has one */
+static void tgdb_track_request(struct tgdb_request *request)
+{
+    if (request->id > 0)
+        sbpush(requests_with_ids, request);
+    else
+        tgdb_request_destroy(request);
+}
+
 void tgdb_set_last_request(struct tgdb_request *request)
 {
     if (request)
@@ -267,10 +319,7 @@ void tgdb_set_last_request(struct tgdb_request *request)
             break;
         }
 
-        if (request->id > 0)
-            sbpush(requests_with_ids, request);
-        else
-            tgdb_request_destroy(request);
+        tgdb_track_request(request);
     }
     else
     {
@@ -300,6 +349,65 @@ int tgdb_last_request_requires_update()
     return last_request_requires_update;
 }
 
+/**
+ * Determines if a queued command is no longer worth sending.
+ *
+ * \param item
+ * The queued command.
+ *
+ * \param newer
+ * A command being queued after it, or NULL.
+ *
+ * \param generation
+ * The current stop generation of the inferior.
+ *
+ * \return
+ * 1 if newer asks for the same thing, or item asks about a stop the
+ * inferior has since resumed from. Otherwise 0.
+ */
+static int tgdb_command_is_stale(struct tgdb_command *item,
+    struct tgdb_command *newer, int generation)
+{
+    if (item->per_stop && item->generation != generation)
+        return 1;
+
+    if (newer && item->key && newer->key && !strcmp(item->key, newer->key))
+        return 1;
+
+    return 0;
+}
+
+/**
+ * Drops the stale commands from a queue, see tgdb_command_is_stale.
+ * The requests waiting on them are dropped as well.
+ */
+static void tgdb_drop_stale_commands(struct tgdb_command ***queue,
+    struct tgdb_command *newer, int generation)
+{
+    int i;
+    int count = 0;
+
+    for (i = 0; i < sbcount(*queue); i++)
+    {
+        struct tgdb_command *item = (*queue)[i];
+
+        if (tgdb_command_is_stale(item, newer, generation))
+        {
+            clog_debug(CLOG_GDBIO, "dropped stale command %d", item->id);
+
+            tgdb_request_destroy(tgdb_pop_request_id(item->id));
+            tgdb_command_destroy(item);
+        }
+        else
+        {
+            (*queue)[count++] = item;
+        }
+    }
+
+    if (*queue)
+        sbsetcount(*queue, count);
+}
+
 /**
  * Process the commands that were created by the client
  *
@@ -312,6 +420,12 @@ int tgdb_last_request_requires_update()
 static void tgdb_process_client_commands(struct tgdb *tgdb)
 {
     int i;
+    int generation = tgdb->a2->stop_generation;
+
+    /* Drop what was queued for a stop the inferior has resumed from */
+    tgdb_drop_stale_commands(&tgdb->oob_input_queue, NULL, generation);
+    tgdb_drop_stale_commands(&tgdb->gdb_input_queue, NULL, generation);
+    tgdb_drop_stale_commands(&tgdb->mi_input_queue, NULL, generation);
 
     for (i = 0; i < sbcount(tgdb->a2->client_commands); i++)
     {
@@ -322,6 +436,36 @@ static void tgdb_process_client_commands(struct tgdb *tgdb)
 
     /* Clear the client command array */
     sbsetcount(tgdb->a2->client_commands, 0);
+
+    /* Send the GDB/MI commands together */
+    tgdb_mi_deliver_commands(tgdb);
+}
+
+/**
+ * Once gdb has answered all of the internal commands, log how many round
+ * trips they took since TGDB was last idle.
+ *
+ * \param tgdb
+ * The TGDB context
+ */
+static void tgdb_log_round_trips(struct tgdb *tgdb)
+{
+    if (!tgdb->round_trips)
+        return;
+
+    if (!tgdb_can_issue_command(tgdb) ||
+        sbcount(tgdb->oob_input_queue) > 0 ||
+        sbcount(tgdb->mi_input_queue) > 0 ||
+        sbcount(tgdb->a2->mi_commands) > 0)
+        return;
+
+    clog_debug(CLOG_GDBIO, "%d round trips for %d internal commands "
+        "after %d console commands", tgdb->round_trips,
+        tgdb->round_trip_commands, tgdb->round_trip_steps);
+
+    tgdb->round_trips = 0;
+    tgdb->round_trip_commands = 0;
+    tgdb->round_trip_steps = 0;
 }
 
 static struct tgdb *initialize_tgdb_context(void)
@@ -340,9 +484,14 @@ static struct tgdb *initialize_tgdb_context(void)
     tgdb->gdb_client_request_queue = NULL;
     tgdb->gdb_input_queue = NULL;
     tgdb->oob_input_queue = NULL;
+    tgdb->mi_input_queue = NULL;
 
     tgdb->is_gdb_ready_for_next_command = 1;
 
+    tgdb->round_trips = 0;
+    tgdb->round_trip_commands = 0;
+    tgdb->round_trip_steps = 0;
+
     tgdb->last_gui_command = NULL;
     tgdb->show_gui_commands = 0;
 
@@ -744,6 +893,12 @@ tgdb_send(struct tgdb *tgdb, const char *command,
     tc->command_choice = command_choice;
     tc->command = ANNOTATE_USER_COMMAND;
     tc->gdb_command = command_data;
+    tc->id = 0;
+    tc->mi = 0;
+    tc->key = NULL;
+    tc->generation = tgdb->a2->stop_generation;
+    tc->per_stop = 0;
+    tc->superseded = 0;
 
     tgdb_run_or_queue_command(tgdb, tc);
     tgdb_process_client_commands(tgdb);
@@ -766,7 +921,19 @@ tgdb_send(struct tgdb *tgdb, const char *command,
 static void
 tgdb_run_or_queue_command(struct tgdb *tgdb, struct tgdb_command *command)
 {
-    int can_issue = tgdb_can_issue_command(tgdb);
+    int can_issue;
+
+    /* Commands for the GDB/MI channel have a queue of their own. They are
+     * sent by tgdb_process_client_commands. */
+    if (command->mi)
+    {
+        tgdb_drop_stale_commands(&tgdb->mi_input_queue, command,
+            tgdb->a2->stop_generation);
+        sbpush(tgdb->mi_input_queue, command);
+        return;
+    }
+
+    can_issue = tgdb_can_issue_command(tgdb);
 
     if (can_issue)
     {
@@ -775,6 +942,15 @@ tgdb_run_or_queue_command(struct tgdb *tgdb, struct tgdb_command *command)
     }
     else
     {
+        /* A newer command supersedes queued ones that ask the same thing */
+        if (command->key)
+        {
+            tgdb_drop_stale_commands(&tgdb->oob_input_queue, command,
+                tgdb->a2->stop_generation);
+            tgdb_drop_stale_commands(&tgdb->gdb_input_queue, command,
+                tgdb->a2->stop_generation);
+        }
+
         /* Make sure to put the command into the correct queue. */
         switch (command->command_choice)
         {
@@ -830,7 +1006,16 @@ static void tgdb_deliver_command(struct tgdb *tgdb, struct tgdb_command *command
 
     /* Set USER_COMMAND data state for user commands */
     if (command->command == ANNOTATE_USER_COMMAND)
+    {
         data_set_state(tgdb->a2, USER_COMMAND);
+        tgdb->round_trip_steps++;
+    }
+    else
+    {
+        /* Internal commands on the console wait for the prompt */
+        tgdb->round_trips++;
+        tgdb->round_trip_commands++;
+    }
 
     /* Send command to gdb */
     io_writen(tgdb->debugger_stdin, command->gdb_command,
@@ -847,6 +1032,27 @@ static void tgdb_deliver_command(struct tgdb *tgdb, struct tgdb_command *command
     }
 }
 
+/**
+ * Determines if the front end has queued a command that runs the inferior,
+ * or changes its frame.
+ *
+ * \return
+ * 1 if such a command is waiting. Otherwise 0.
+ */
+static int tgdb_resume_is_queued(struct tgdb *tgdb)
+{
+    int i;
+
+    for (i = 0; i < sbcount(tgdb->gdb_client_request_queue); i++)
+    {
+        if (tgdb->gdb_client_request_queue[i]->header ==
+            TGDB_REQUEST_DEBUGGER_COMMAND)
+            return 1;
+    }
+
+    return 0;
+}
+
 /**
  * TGDB will search it's command queue's and determine what the next command
  * to deliever to GDB should be.
@@ -872,6 +1078,17 @@ tgdb_unqueue_and_deliver_command_tag:
         struct tgdb_command *item;
 
         item = sbpopfront(tgdb->oob_input_queue);
+
+        /* The front end is about to step or continue, so the answer would
+         * describe a stop that's already gone. The next stop asks again. */
+        if (item->per_stop && tgdb_resume_is_queued(tgdb))
+        {
+            clog_debug(CLOG_GDBIO, "dropped stale command %d", item->id);
+            tgdb_request_destroy(tgdb_pop_request_id(item->id));
+            tgdb_command_destroy(item);
+            goto tgdb_unqueue_and_deliver_command_tag;
+        }
+
         tgdb_deliver_command(tgdb, item);
         tgdb_command_destroy(item);
     }
@@ -899,6 +1116,80 @@ tgdb_unqueue_and_deliver_command_tag:
     }
 }
 
+/**
+ * Sends all of the commands in the GDB/MI channel queue in one write.
+ * They don't depend on each other, so they don't wait for the commands
+ * sent before them. gdb answers them in order, and each result record is
+ * matched back to its command by its token.
+ *
+ * \param tgdb
+ * The TGDB context to use.
+ */
+static void tgdb_mi_deliver_commands(struct tgdb *tgdb)
+{
+    int i;
+    char *batch = NULL;
+    int count = sbcount(tgdb->mi_input_queue);
+    int fd = a2_get_mi_fd(tgdb->a2);
+    int in_flight = sbcount(tgdb->a2->mi_commands);
+
+    if (count == 0)
+        return;
+
+    /* The channel was closed, the console answers these commands */
+    if (fd == -1)
+    {
+        clog_error(CLOG_CGDB, "no GDB/MI channel");
+
+        for (i = 0; i < count; i++)
+        {
+            commands_move_to_console(tgdb->mi_input_queue[i]);
+            tgdb_run_or_queue_command(tgdb, tgdb->mi_input_queue[i]);
+        }
+        sbsetcount(tgdb->mi_input_queue, 0);
+        return;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        int j;
+        struct tgdb_command *item = tgdb->mi_input_queue[i];
+        int length = strlen(item->gdb_command);
+
+        /* The answers to the commands this one repeats are out of date */
+        for (j = 0; j < sbcount(tgdb->a2->mi_commands); j++)
+        {
+            if (tgdb_command_is_stale(tgdb->a2->mi_commands[j], item,
+                    tgdb->a2->stop_generation))
+                tgdb->a2->mi_commands[j]->superseded = 1;
+        }
+
+        memcpy(sbadd(batch, length), item->gdb_command, length);
+
+        /* Keep the command until its result record is read */
+        sbpush(tgdb->a2->mi_commands, item);
+    }
+    sbsetcount(tgdb->mi_input_queue, 0);
+
+    /* Send what we're doing to log file */
+    if (clog_get_level(CLOG_GDBIO_ID) <= CLOG_DEBUG)
+    {
+        char *str = sys_quote_nonprintables(batch, sbcount(batch));
+
+        clog_debug(CLOG_GDBIO, "mi<%s>", str);
+        sbfree(str);
+    }
+
+    io_writen(fd, batch, sbcount(batch));
+    sbfree(batch);
+
+    /* A batch sent while others are being answered doesn't wait for them,
+     * so it only adds a round trip when nothing else is in flight. */
+    if (!in_flight)
+        tgdb->round_trips++;
+    tgdb->round_trip_commands += count;
+}
+
 /* These functions are used to communicate with the inferior */
 int tgdb_send_inferior_char(struct tgdb *tgdb, char c)
 {
@@ -1137,12 +1428,52 @@ size_t tgdb_process(struct tgdb *tgdb, char *buf, size_t n, int *is_finished)
     if (tgdb_has_command_to_run(tgdb))
         tgdb_unqueue_and_deliver_command(tgdb);
 
+    tgdb_log_round_trips(tgdb);
+
 tgdb_finish:
     *is_finished = tgdb_can_issue_command(tgdb);
 
     return buf_size;
 }
 
+int tgdb_get_mi_fd(struct tgdb *tgdb)
+{
+    return a2_get_mi_fd(tgdb->a2);
+}
+
+int tgdb_process_mi(struct tgdb *tgdb)
+{
+    char local_buf[4096];
+    ssize_t size;
+    int fd = a2_get_mi_fd(tgdb->a2);
+
+    /* make the queue empty */
+    a2_delete_responses(tgdb->a2);
+
+    if (fd == -1)
+        return 0;
+
+    if ((size = io_read(fd, local_buf, sizeof(local_buf))) <= 0)
+    {
+        /* Keep going with the console if gdb closed the channel */
+        clog_error(CLOG_CGDB, "could not read from GDB/MI channel");
+        a2_close_mi_channel(tgdb->a2);
+
+        /* The commands sent to the channel were put back on the client
+         * commands, and tgdb_mi_deliver_commands sends the queued ones to
+         * the console */
+        tgdb_process_client_commands(tgdb);
+        return -1;
+    }
+
+    commands_process_mi_output(tgdb->a2, local_buf, size);
+
+    tgdb_process_client_commands(tgdb);
+    tgdb_log_round_trips(tgdb);
+
+    return 0;
+}
+
 /* Getting Data out of TGDB {{{*/
 
 struct tgdb_response *tgdb_get_response(struct tgdb *tgdb, int i)
@@ -1190,22 +1521,12 @@ int tgdb_delete_response(struct tgdb_response *com)
     switch (com->header)
     {
     case TGDB_UPDATE_BREAKPOINTS:
-    {
-        int i;
-
-        for (i = 0; i < sbcount(com->choice.update_breakpoints.breakpoints); i++)
-        {
-
-            struct tgdb_breakpoint *tb = &com->choice.update_breakpoints.breakpoints[i];
-
-            free(tb->file);
-            free(tb->funcname);
-        }
-
-        sbfree(com->choice.update_breakpoints.breakpoints);
+        commands_free_breakpoints(com->choice.update_breakpoints.breakpoints);
         com->choice.update_breakpoints.breakpoints = NULL;
+
+        commands_free_breakpoints(com->choice.update_breakpoints.removed);
+        com->choice.update_breakpoints.removed = NULL;
         break;
-    }
     case TGDB_UPDATE_FILE_POSITION:
     {
         struct tgdb_file_position *tfp =
@@ -1473,10 +1794,14 @@ tgdb_request_ptr tgdb_request_frame(struct tgdb *tgdb)
 
 int tgdb_process_command(struct tgdb *tgdb, tgdb_request_ptr request)
 {
+    int uses_mi;
+
     if (!tgdb || !request)
         return -1;
 
-    if (!tgdb_can_issue_command(tgdb))
+    uses_mi = tgdb_request_uses_mi(tgdb, request);
+
+    if (!uses_mi && !tgdb_can_issue_command(tgdb))
         return -1;
 
     if (request->header == TGDB_REQUEST_CONSOLE_COMMAND)
@@ -1541,6 +1866,13 @@ int tgdb_process_command(struct tgdb *tgdb, tgdb_request_ptr request)
         }
 
         tgdb_process_client_commands(tgdb);
+
+        /* Requests answered on the GDB/MI channel don't touch the console */
+        if (uses_mi)
+        {
+            tgdb_track_request(request);
+            return 0;
+        }
     }
 
     tgdb_set_last_request(request);
@@ -144,6 +144,32 @@ int tgdb_process_command(struct tgdb *tgdb, tgdb_request_ptr request);
 size_t tgdb_process(struct tgdb *tgdb, char *buf, size_t n,
     int *is_finished);
 
+/**
+   * Get the descriptor of the GDB/MI channel TGDB sends its own commands
+   * to. It's only there when the debugger supports the new-ui command.
+   *
+   * \param tgdb
+   * An instance of the tgdb library to operate on.
+   *
+   * @return
+   * The descriptor to read the GDB/MI channel from, or -1 if there is none.
+   */
+int tgdb_get_mi_fd(struct tgdb *tgdb);
+
+/**
+   * Processes the output of the GDB/MI channel. The responses to requests
+   * answered on it are returned by tgdb_get_response, like the ones
+   * tgdb_process finds.
+   *
+   * \param tgdb
+   * An instance of the tgdb library to operate on.
+   *
+   * @return
+   * 0 on success or -1 if the channel could not be read. TGDB then goes
+   * back to running its commands through the console.
+   */
+int tgdb_process_mi(struct tgdb *tgdb);
+
 /**
    * This sends a byte of data to the program being debugged.
    *
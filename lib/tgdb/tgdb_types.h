@@ -80,6 +80,8 @@ struct tgdb_breakpoint
     uint64_t addr;
     /** 0 if it is not enabled or 1 if it is enabled. */
     int enabled;
+    /** The breakpoint number. Each location of a breakpoint has its number. */
+    int number;
 };
 
 /**
@@ -238,6 +240,14 @@ struct tgdb_response_breakpoints
     /* This list has elements of 'struct tgdb_breakpoint *'
      * representing each breakpoint. */
     struct tgdb_breakpoint *breakpoints;
+
+    /* If this is 0, breakpoints is every breakpoint that is set.
+     * Otherwise, only the breakpoints in removed and breakpoints changed:
+     * removed has what the front end was told about the breakpoints that
+     * were deleted or modified, and breakpoints has the breakpoints that
+     * were created or modified. */
+    int is_delta;
+    struct tgdb_breakpoint *removed;
 };
 
 /* header == TGDB_UPDATE_FILE_POSITION */
@@ -2586,3 +2586,20 @@ int ada_wrap ( void ) {
 	return 1;
 }
 
+
+/* Scan len bytes of buffer, which does not need to be nil terminated */
+YY_BUFFER_STATE ada_scan_buffer_len(const char *buffer, int len)
+{
+    return ada__scan_bytes(buffer, len);
+}
+
+/* Get and set the start condition, used to resume tokenizing mid file */
+int ada_get_start_state(void)
+{
+    return YY_START;
+}
+
+void ada_set_start_state(int state)
+{
+    BEGIN(state);
+}
@@ -2861,3 +2861,20 @@ int asm_wrap ( void ) {
     return 1;
 }
 
+
+/* Scan len bytes of buffer, which does not need to be nil terminated */
+YY_BUFFER_STATE asm_scan_buffer_len(const char *buffer, int len)
+{
+    return asm__scan_bytes(buffer, len);
+}
+
+/* Get and set the start condition, used to resume tokenizing mid file */
+int asm_get_start_state(void)
+{
+    return YY_START;
+}
+
+void asm_set_start_state(int state)
+{
+    BEGIN(state);
+}
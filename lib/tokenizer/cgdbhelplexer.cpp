@@ -2252,3 +2252,20 @@ int cgdbhelp_wrap ( void ) {
 	return 1;
 }
 
+
+/* Scan len bytes of buffer, which does not need to be nil terminated */
+YY_BUFFER_STATE cgdbhelp_scan_buffer_len(const char *buffer, int len)
+{
+    return cgdbhelp__scan_bytes(buffer, len);
+}
+
+/* Get and set the start condition, used to resume tokenizing mid file */
+int cgdbhelp_get_start_state(void)
+{
+    return YY_START;
+}
+
+void cgdbhelp_set_start_state(int state)
+{
+    BEGIN(state);
+}
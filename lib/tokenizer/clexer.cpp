@@ -2812,3 +2812,20 @@ int c_wrap ( void ) {
     return 1;
 }
 
+
+/* Scan len bytes of buffer, which does not need to be nil terminated */
+YY_BUFFER_STATE c_scan_buffer_len(const char *buffer, int len)
+{
+    return c__scan_bytes(buffer, len);
+}
+
+/* Get and set the start condition, used to resume tokenizing mid file */
+int c_get_start_state(void)
+{
+    return YY_START;
+}
+
+void c_set_start_state(int state)
+{
+    BEGIN(state);
+}
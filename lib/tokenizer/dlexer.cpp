@@ -3800,3 +3800,22 @@ int d_wrap ( void ) {
     return 1;
 }
 
+
+/* Scan len bytes of buffer, which does not need to be nil terminated */
+YY_BUFFER_STATE d_scan_buffer_len(const char *buffer, int len)
+{
+    return d__scan_bytes(buffer, len);
+}
+
+/* Get and set the start condition, used to resume tokenizing mid file.
+ * The comment nesting level is kept above the start condition bits. */
+int d_get_start_state(void)
+{
+    return YY_START | (nesting_level << 8);
+}
+
+void d_set_start_state(int state)
+{
+    nesting_level = state >> 8;
+    BEGIN(state & 0xff);
+}
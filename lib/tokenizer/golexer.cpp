@@ -2564,3 +2564,20 @@ int go_wrap ( void ) {
     return 1;
 }
 
+
+/* Scan len bytes of buffer, which does not need to be nil terminated */
+YY_BUFFER_STATE go_scan_buffer_len(const char *buffer, int len)
+{
+    return go__scan_bytes(buffer, len);
+}
+
+/* Get and set the start condition, used to resume tokenizing mid file */
+int go_get_start_state(void)
+{
+    return YY_START;
+}
+
+void go_set_start_state(int state)
+{
+    BEGIN(state);
+}
@@ -3054,3 +3054,20 @@ int rust_wrap ( void ) {
     return 1;
 }
 
+
+/* Scan len bytes of buffer, which does not need to be nil terminated */
+YY_BUFFER_STATE rust_scan_buffer_len(const char *buffer, int len)
+{
+    return rust__scan_bytes(buffer, len);
+}
+
+/* Get and set the start condition, used to resume tokenizing mid file */
+int rust_get_start_state(void)
+{
+    return YY_START;
+}
+
+void rust_set_start_state(int state)
+{
+    BEGIN(state);
+}
@@ -15,10 +15,13 @@ const char *asm_extensions[] = { ".s" };
 
 typedef struct yy_buffer_state *YY_BUFFER_STATE;
 
-#define DECLARE_LEX_FUNCTIONS(_LANG)                               \
-    extern int _LANG##_lex(void);                                  \
-    extern char *_LANG##_text;                                     \
-    extern YY_BUFFER_STATE _LANG##__scan_string(const char *base); \
+#define DECLARE_LEX_FUNCTIONS(_LANG)                                             \
+    extern int _LANG##_lex(void);                                                \
+    extern char *_LANG##_text;                                                   \
+    extern YY_BUFFER_STATE _LANG##__scan_string(const char *base);               \
+    extern YY_BUFFER_STATE _LANG##_scan_buffer_len(const char *buffer, int len); \
+    extern int _LANG##_get_start_state(void);                                    \
+    extern void _LANG##_set_start_state(int state);                              \
     void _LANG##__delete_buffer(YY_BUFFER_STATE b);
 
 DECLARE_LEX_FUNCTIONS(c);
@@ -38,6 +41,8 @@ struct tokenizer
     char **yy_tokenizer_text;
     int (*yy_lex_func)(void);
     void (*yy_delete_buffer_func)(YY_BUFFER_STATE b);
+    int (*yy_get_start_state_func)(void);
+    void (*yy_set_start_state_func)(int state);
 
     YY_BUFFER_STATE str_buffer;
 };
@@ -51,6 +56,8 @@ struct tokenizer *tokenizer_init(void)
 
     t->yy_lex_func = NULL;
     t->yy_delete_buffer_func = NULL;
+    t->yy_get_start_state_func = NULL;
+    t->yy_set_start_state_func = NULL;
 
     t->yy_tokenizer_text = NULL;
     t->str_buffer = NULL;
@@ -68,7 +75,8 @@ void tokenizer_destroy(struct tokenizer *t)
     }
 }
 
-int tokenizer_set_buffer(struct tokenizer *t, const char *buffer, enum tokenizer_language_support l)
+static int tokenizer_set_buffer_internal(struct tokenizer *t,
+    const char *buffer, int len, enum tokenizer_language_support l)
 {
     if (t->str_buffer)
     {
@@ -81,11 +89,13 @@ int tokenizer_set_buffer(struct tokenizer *t, const char *buffer, enum tokenizer
 
     t->lang = l;
 
-#define INIT_LEX(_LANG)                                \
-    t->yy_lex_func = _LANG##_lex;                      \
-    t->yy_delete_buffer_func = _LANG##__delete_buffer; \
-    t->yy_tokenizer_text = &(_LANG##_text);            \
-    t->str_buffer = _LANG##__scan_string(buffer);
+#define INIT_LEX(_LANG)                                    \
+    t->yy_lex_func = _LANG##_lex;                          \
+    t->yy_delete_buffer_func = _LANG##__delete_buffer;     \
+    t->yy_get_start_state_func = _LANG##_get_start_state;  \
+    t->yy_set_start_state_func = _LANG##_set_start_state;  \
+    t->yy_tokenizer_text = &(_LANG##_text);                \
+    t->str_buffer = (len < 0) ? _LANG##__scan_string(buffer) : _LANG##_scan_buffer_len(buffer, len);
 
     if (l == TOKENIZER_LANGUAGE_C)
     {
@@ -118,9 +128,37 @@ int tokenizer_set_buffer(struct tokenizer *t, const char *buffer, enum tokenizer
 
 #undef INIT_LEX
 
+    /* Lexer start conditions are global, so start each buffer fresh */
+    (*t->yy_set_start_state_func)(0);
+
     return 0;
 }
 
+int tokenizer_set_buffer(struct tokenizer *t, const char *buffer, enum tokenizer_language_support l)
+{
+    return tokenizer_set_buffer_internal(t, buffer, -1, l);
+}
+
+int tokenizer_set_buffer_len(struct tokenizer *t, const char *buffer, int len,
+    enum tokenizer_language_support l)
+{
+    return tokenizer_set_buffer_internal(t, buffer, len, l);
+}
+
+int tokenizer_get_start_state(struct tokenizer *t)
+{
+    if (!t || !t->yy_get_start_state_func)
+        return 0;
+
+    return (*t->yy_get_start_state_func)();
+}
+
+void tokenizer_set_start_state(struct tokenizer *t, int state)
+{
+    if (t && t->yy_set_start_state_func)
+        (*t->yy_set_start_state_func)(state);
+}
+
 int tokenizer_get_token(struct tokenizer *t, struct token_data *token_data)
 {
     if (!t || !t->yy_lex_func)
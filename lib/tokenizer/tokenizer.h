@@ -75,6 +75,42 @@ void tokenizer_destroy(struct tokenizer *t);
 int tokenizer_set_buffer(struct tokenizer *t, const char *buffer,
     enum tokenizer_language_support l);
 
+/* tokenizer_set_buffer_len
+ * ------------------------
+ *
+ *  Same as tokenizer_set_buffer, but the buffer does not need to be nil
+ *  terminated. Only the first len bytes of buffer are tokenized.
+ *
+ *  t:      The tokenizer object to work on
+ *
+ *  Return: -1 on error. 0 on success
+ */
+int tokenizer_set_buffer_len(struct tokenizer *t, const char *buffer, int len,
+    enum tokenizer_language_support l);
+
+/* tokenizer_get_start_state
+ * -------------------------
+ *
+ *  Get the lexer state to resume tokenizing with. Only meaningful
+ *  right after a TOKENIZER_NEWLINE token has been returned.
+ *
+ *  t:      The tokenizer object to work on
+ *
+ *  Return: The lexer state.
+ */
+int tokenizer_get_start_state(struct tokenizer *t);
+
+/* tokenizer_set_start_state
+ * -------------------------
+ *
+ *  Set the lexer state, usually to a value returned from
+ *  tokenizer_get_start_state. Call after tokenizer_set_buffer.
+ *
+ *  t:      The tokenizer object to work on
+ *  state:  The lexer state.
+ */
+void tokenizer_set_start_state(struct tokenizer *t, int state);
+
 /* tokenizer_get_token
  * -------------------
  *
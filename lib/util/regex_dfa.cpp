@@ -0,0 +1,1234 @@
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#if HAVE_STDLIB_H
+#include <stdlib.h>
+#endif /* HAVE_STDLIB_H */
+
+#if HAVE_STRING_H
+#include <string.h>
+#endif /* HAVE_STRING_H */
+
+#if HAVE_CTYPE_H
+#include <ctype.h>
+#endif /* HAVE_CTYPE_H */
+
+#if HAVE_LANGINFO_H
+#include <langinfo.h>
+#endif /* HAVE_LANGINFO_H */
+
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#include "sys_util.h"
+#include "regex_dfa.h"
+
+/* Most NFA states a pattern can turn into */
+#define RD_MAX_NFA_STATES 4096
+
+/* Most times a {m,n} interval can repeat something */
+#define RD_MAX_REPEAT 255
+
+/* Most states a DFA builds before they are all thrown away */
+#define RD_MAX_DFA_STATES 2048
+
+/* Search results other than offsets */
+#define RD_NONE -1 /* No match */
+#define RD_BAIL -2 /* The text has to be searched with regexec */
+
+/* DFA state flags */
+#define RD_ACCEPT 1 /* A match ends here */
+#define RD_DEAD 2   /* No match can end here or after */
+
+enum rd_node_kind
+{
+    RD_NODE_SET,   /* One byte from a set */
+    RD_NODE_EMPTY, /* The empty string */
+    RD_NODE_CAT,   /* left then right */
+    RD_NODE_ALT,   /* left or right */
+    RD_NODE_STAR,  /* left zero or more times */
+    RD_NODE_PLUS,  /* left one or more times */
+    RD_NODE_QUEST  /* left zero or one time */
+};
+
+struct rd_node
+{
+    enum rd_node_kind kind;
+    int set;   /* RD_NODE_SET: index into sets */
+    int left;  /* Index into nodes */
+    int right; /* Index into nodes */
+};
+
+/* A set of bytes, indexed by folded byte */
+struct rd_set
+{
+    uint32_t bits[8];
+};
+
+enum rd_nfa_kind
+{
+    RD_NFA_SET,   /* Go to out on a byte in set */
+    RD_NFA_SPLIT, /* Go to out and out1 without reading anything */
+    RD_NFA_MATCH  /* A match ends here */
+};
+
+struct rd_nfa_state
+{
+    enum rd_nfa_kind kind;
+    int set;
+    int out;
+    int out1; /* -1 if unused */
+};
+
+/* A DFA built lazily from the NFA. Each state is a sorted set of NFA
+ * states, the ones that read a byte or match. */
+struct rd_dfa
+{
+    int unanchored;       /* 1 if a match can start at any byte */
+    int start;            /* Start state */
+    int *nfa_states;      /* Stretch buffer of the NFA states of each DFA state */
+    int *offsets;         /* Stretch buffer, state i has nfa_states[offsets[i]..offsets[i + 1]] */
+    unsigned char *flags; /* Stretch buffer of RD_ACCEPT and RD_DEAD for each state */
+    int *trans;           /* Stretch buffer of class_count next states per state, -1 if not built */
+    int *table;           /* Hash table of states, -1 if empty */
+    int table_size;       /* Size of table, a power of 2 */
+};
+
+struct regex_dfa
+{
+    int icase;
+    int anchored_start;           /* Pattern started with ^ */
+    int anchored_end;             /* Pattern ended with $ */
+    int needs_ascii;              /* Bytes >= 0x80 in the text need regexec */
+    unsigned char fold[256];      /* Byte to the byte it matches as */
+    unsigned char classes[256];   /* Byte to its class, bytes in a class match the same */
+    unsigned char class_rep[256]; /* A byte in each class */
+    int class_count;
+    unsigned char starts[256];    /* Bytes a match can start with */
+
+    char *literal;   /* Whole pattern if it's a plain string, else NULL */
+    int literal_len;
+    char *prefix;    /* String every match starts with, or NULL */
+    int prefix_len;
+
+    struct rd_set *sets;            /* Stretch buffer of byte sets */
+    struct rd_nfa_state *nfa;       /* Stretch buffer of NFA states */
+    int nfa_start;
+    int nfa_match;
+
+    struct rd_dfa search_dfa; /* Finds where the first match ends */
+    struct rd_dfa match_dfa;  /* Finds the matches starting at a byte */
+
+    int *closure;  /* Stretch buffer used to build DFA states */
+    int *stack;    /* Stretch buffer used to build DFA states */
+    int *marks;    /* Generation each NFA state was last added to a closure */
+    int mark_gen;
+    int flush;     /* 1 if a DFA filled up and has to be rebuilt */
+};
+
+struct rd_parser
+{
+    struct regex_dfa *re;
+    const char *p;    /* Next pattern character */
+    const char *end;  /* End of pattern */
+    int depth;        /* Parenthesis depth */
+    int error;        /* 1 if the pattern can't be handled */
+    int multibyte;    /* 1 if the locale has multibyte characters */
+    int top_alt;      /* 1 if the pattern has a top level | */
+    int wide;         /* 1 if something can match a multibyte character */
+    int high;         /* 1 if the pattern has bytes >= 0x80 outside brackets */
+    struct rd_node *nodes;
+};
+
+/* --------------- */
+/* Pattern parsing */
+/* --------------- */
+
+static int rd_set_has(const struct rd_set *set, unsigned char c)
+{
+    return (set->bits[c >> 5] >> (c & 31)) & 1;
+}
+
+static void rd_set_add(struct regex_dfa *re, struct rd_set *set, unsigned char c)
+{
+    c = re->fold[c];
+    set->bits[c >> 5] |= 1u << (c & 31);
+}
+
+static int rd_new_node(struct rd_parser *ps, enum rd_node_kind kind, int left, int right)
+{
+    struct rd_node node;
+
+    node.kind = kind;
+    node.set = -1;
+    node.left = left;
+    node.right = right;
+    sbpush(ps->nodes, node);
+
+    return sbcount(ps->nodes) - 1;
+}
+
+static int rd_new_set_node(struct rd_parser *ps, const struct rd_set *set)
+{
+    int node = rd_new_node(ps, RD_NODE_SET, -1, -1);
+
+    sbpush(ps->re->sets, *set);
+    ps->nodes[node].set = sbcount(ps->re->sets) - 1;
+
+    return node;
+}
+
+static int rd_fail(struct rd_parser *ps)
+{
+    ps->error = 1;
+    return -1;
+}
+
+/* Add a [:name:] class to set. Returns -1 for unknown classes. */
+static int rd_add_class(struct rd_parser *ps, struct rd_set *set,
+    const char *name, int len)
+{
+    static const char *names[] = {
+        "alpha", "digit", "alnum", "upper", "lower", "space",
+        "blank", "punct", "print", "graph", "cntrl", "xdigit"
+    };
+    int i, c;
+    int kind = -1;
+
+    for (i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++)
+    {
+        if ((int)strlen(names[i]) == len && !strncmp(names[i], name, len))
+            kind = i;
+    }
+
+    if (kind == -1)
+        return -1;
+
+    for (c = 0; c < 256; c++)
+    {
+        int in = 0;
+
+        switch (kind)
+        {
+        case 0: in = isalpha(c); break;
+        case 1: in = isdigit(c); break;
+        case 2: in = isalnum(c); break;
+        case 3: in = isupper(c); break;
+        case 4: in = islower(c); break;
+        case 5: in = isspace(c); break;
+        case 6: in = (c == ' ' || c == '\t'); break;
+        case 7: in = ispunct(c); break;
+        case 8: in = isprint(c); break;
+        case 9: in = isgraph(c); break;
+        case 10: in = iscntrl(c); break;
+        case 11: in = isxdigit(c); break;
+        }
+
+        if (in)
+            rd_set_add(ps->re, set, c);
+    }
+
+    return 0;
+}
+
+/* Parse a bracket expression, p is just past the [ */
+static int rd_parse_bracket(struct rd_parser *ps)
+{
+    struct rd_set set;
+    int negate = 0;
+    int first = 1;
+    int i;
+
+    memset(&set, 0, sizeof(set));
+
+    if (ps->p < ps->end && *ps->p == '^')
+    {
+        negate = 1;
+        ps->p++;
+    }
+
+    for (;;)
+    {
+        unsigned char lo, hi;
+
+        if (ps->p >= ps->end)
+            return rd_fail(ps);
+
+        if (*ps->p == ']' && !first)
+        {
+            ps->p++;
+            break;
+        }
+
+        first = 0;
+
+        if (ps->p[0] == '[' && ps->p + 1 < ps->end &&
+            (ps->p[1] == '.' || ps->p[1] == '='))
+            return rd_fail(ps);
+
+        if (ps->p[0] == '[' && ps->p + 1 < ps->end && ps->p[1] == ':')
+        {
+            const char *name = ps->p + 2;
+            const char *name_end = name;
+
+            while (name_end + 1 < ps->end && !(name_end[0] == ':' && name_end[1] == ']'))
+                name_end++;
+
+            if (name_end + 1 >= ps->end ||
+                rd_add_class(ps, &set, name, name_end - name) == -1)
+                return rd_fail(ps);
+
+            ps->wide = 1;
+            ps->p = name_end + 2;
+            continue;
+        }
+
+        lo = hi = *ps->p++;
+
+        /* A range, unless the - is last */
+        if (ps->p + 1 < ps->end && ps->p[0] == '-' && ps->p[1] != ']')
+        {
+            if (ps->p[1] == '[')
+                return rd_fail(ps);
+
+            hi = ps->p[1];
+            ps->p += 2;
+
+            if (hi < lo)
+                return rd_fail(ps);
+        }
+
+        /* A multibyte character is one item in a bracket */
+        if (ps->multibyte && (lo >= 0x80 || hi >= 0x80))
+            return rd_fail(ps);
+
+        /* The C library folds ranges mixing letters with other characters
+         * its own way */
+        if (ps->re->icase && lo != hi)
+        {
+            int letters = 0;
+
+            for (i = lo; i <= hi; i++)
+                letters |= isalpha(i);
+
+            if (letters && !((islower(lo) && islower(hi)) || (isupper(lo) && isupper(hi))))
+                return rd_fail(ps);
+        }
+
+        for (i = lo; i <= hi; i++)
+            rd_set_add(ps->re, &set, i);
+    }
+
+    if (negate)
+    {
+        for (i = 0; i < 8; i++)
+            set.bits[i] = ~set.bits[i];
+
+        ps->wide = 1;
+    }
+
+    return rd_new_set_node(ps, &set);
+}
+
+static int rd_parse_alt(struct rd_parser *ps);
+
+static int rd_parse_atom(struct rd_parser *ps)
+{
+    struct rd_set set;
+    unsigned char c;
+    int node;
+
+    memset(&set, 0, sizeof(set));
+
+    if (ps->p >= ps->end)
+        return rd_fail(ps);
+
+    c = *ps->p++;
+
+    switch (c)
+    {
+    case '(':
+        if (ps->p < ps->end && *ps->p == ')')
+            return rd_fail(ps);
+
+        ps->depth++;
+        node = rd_parse_alt(ps);
+        ps->depth--;
+
+        if (ps->error || ps->p >= ps->end || *ps->p != ')')
+            return rd_fail(ps);
+
+        ps->p++;
+        return node;
+    case '[':
+        return rd_parse_bracket(ps);
+    case '.':
+        memset(&set, 0xff, sizeof(set));
+        ps->wide = 1;
+        return rd_new_set_node(ps, &set);
+    case '\\':
+        /* Escaped punctuation is itself, except for the GNU word and
+         * buffer anchors */
+        if (ps->p >= ps->end || !ispunct((unsigned char)*ps->p) ||
+            strchr("<>`'", *ps->p))
+            return rd_fail(ps);
+
+        c = *ps->p++;
+        break;
+    case ')':
+    case '*':
+    case '+':
+    case '?':
+    case '{':
+    case '|':
+    case '^':
+    case '$':
+        return rd_fail(ps);
+    }
+
+    /* Multibyte characters are only handled in plain strings */
+    if (c >= 0x80)
+        ps->high = 1;
+
+    rd_set_add(ps->re, &set, c);
+    return rd_new_set_node(ps, &set);
+}
+
+/* Parse the number in a {m,n} interval */
+static int rd_parse_count(struct rd_parser *ps)
+{
+    int count = 0;
+
+    if (ps->p >= ps->end || !isdigit((unsigned char)*ps->p))
+        return -1;
+
+    while (ps->p < ps->end && isdigit((unsigned char)*ps->p))
+    {
+        count = count * 10 + (*ps->p++ - '0');
+        if (count > RD_MAX_REPEAT)
+            return -1;
+    }
+
+    return count;
+}
+
+static int rd_parse_repeat(struct rd_parser *ps)
+{
+    int node = rd_parse_atom(ps);
+
+    while (!ps->error && ps->p < ps->end)
+    {
+        char c = *ps->p;
+
+        if (c == '*')
+            node = rd_new_node(ps, RD_NODE_STAR, node, -1);
+        else if (c == '+')
+            node = rd_new_node(ps, RD_NODE_PLUS, node, -1);
+        else if (c == '?')
+            node = rd_new_node(ps, RD_NODE_QUEST, node, -1);
+        else if (c == '{')
+        {
+            int i, min, max;
+            int repeat = -1;
+
+            ps->p++;
+            min = rd_parse_count(ps);
+            max = min;
+
+            if (min >= 0 && ps->p < ps->end && *ps->p == ',')
+            {
+                ps->p++;
+                max = (ps->p < ps->end && *ps->p == '}') ? -1 : rd_parse_count(ps);
+                if (max == -1 && (ps->p >= ps->end || *ps->p != '}'))
+                    return rd_fail(ps);
+            }
+
+            if (min < 0 || (max >= 0 && max < min) ||
+                ps->p >= ps->end || *ps->p != '}')
+                return rd_fail(ps);
+
+            /* Spell out the repeats, sharing the repeated node */
+            for (i = 0; i < min; i++)
+                repeat = (repeat == -1) ? node : rd_new_node(ps, RD_NODE_CAT, repeat, node);
+
+            if (max == -1)
+            {
+                int star = rd_new_node(ps, RD_NODE_STAR, node, -1);
+
+                repeat = (repeat == -1) ? star : rd_new_node(ps, RD_NODE_CAT, repeat, star);
+            }
+            else
+            {
+                for (i = min; i < max; i++)
+                {
+                    int quest = rd_new_node(ps, RD_NODE_QUEST, node, -1);
+
+                    repeat = (repeat == -1) ? quest : rd_new_node(ps, RD_NODE_CAT, repeat, quest);
+                }
+            }
+
+            node = (repeat == -1) ? rd_new_node(ps, RD_NODE_EMPTY, -1, -1) : repeat;
+        }
+        else
+            break;
+
+        ps->p++;
+    }
+
+    return node;
+}
+
+static int rd_parse_cat(struct rd_parser *ps)
+{
+    int node = -1;
+
+    while (!ps->error && ps->p < ps->end && *ps->p != '|' && *ps->p != ')')
+    {
+        int next = rd_parse_repeat(ps);
+
+        node = (node == -1) ? next : rd_new_node(ps, RD_NODE_CAT, node, next);
+    }
+
+    /* Empty alternatives */
+    if (node == -1)
+        return rd_fail(ps);
+
+    return node;
+}
+
+static int rd_parse_alt(struct rd_parser *ps)
+{
+    int node = rd_parse_cat(ps);
+
+    while (!ps->error && ps->p < ps->end && *ps->p == '|')
+    {
+        if (ps->depth == 0)
+            ps->top_alt = 1;
+
+        ps->p++;
+        node = rd_new_node(ps, RD_NODE_ALT, node, rd_parse_cat(ps));
+    }
+
+    return node;
+}
+
+/* Returns the byte a set matches if it matches exactly one, else -1 */
+static int rd_set_single(const struct rd_set *set)
+{
+    int i;
+    int c = -1;
+
+    for (i = 0; i < 256; i++)
+    {
+        if (rd_set_has(set, i))
+        {
+            if (c != -1)
+                return -1;
+            c = i;
+        }
+    }
+
+    return c;
+}
+
+/* Append the nodes a chain of RD_NODE_CATs concatenates to seq */
+static void rd_flatten_cat(struct rd_parser *ps, int node, int **seq)
+{
+    if (ps->nodes[node].kind == RD_NODE_CAT)
+    {
+        rd_flatten_cat(ps, ps->nodes[node].left, seq);
+        rd_flatten_cat(ps, ps->nodes[node].right, seq);
+    }
+    else
+        sbpush(*seq, node);
+}
+
+/* ------------------------------ */
+/* NFA construction (Thompson's)  */
+/* ------------------------------ */
+
+static int rd_new_state(struct regex_dfa *re, enum rd_nfa_kind kind, int set,
+    int out, int out1)
+{
+    struct rd_nfa_state state;
+
+    state.kind = kind;
+    state.set = set;
+    state.out = out;
+    state.out1 = out1;
+    sbpush(re->nfa, state);
+
+    return sbcount(re->nfa) - 1;
+}
+
+/**
+ * Build the NFA fragment for a node. A fragment has one start state and
+ * one end state, a split whose out is patched to what follows.
+ *
+ * \return
+ * 0 on success, -1 if the NFA got too big.
+ */
+static int rd_build(struct rd_parser *ps, int node, int *start, int *end)
+{
+    struct regex_dfa *re = ps->re;
+    int s1, e1, s2, e2;
+
+    if (sbcount(re->nfa) > RD_MAX_NFA_STATES)
+        return -1;
+
+    switch (ps->nodes[node].kind)
+    {
+    case RD_NODE_SET:
+        *end = rd_new_state(re, RD_NFA_SPLIT, -1, -1, -1);
+        *start = rd_new_state(re, RD_NFA_SET, ps->nodes[node].set, *end, -1);
+        return 0;
+    case RD_NODE_EMPTY:
+        *start = *end = rd_new_state(re, RD_NFA_SPLIT, -1, -1, -1);
+        return 0;
+    case RD_NODE_CAT:
+        if (rd_build(ps, ps->nodes[node].left, &s1, &e1) ||
+            rd_build(ps, ps->nodes[node].right, &s2, &e2))
+            return -1;
+        re->nfa[e1].out = s2;
+        *start = s1;
+        *end = e2;
+        return 0;
+    case RD_NODE_ALT:
+        if (rd_build(ps, ps->nodes[node].left, &s1, &e1) ||
+            rd_build(ps, ps->nodes[node].right, &s2, &e2))
+            return -1;
+        *end = rd_new_state(re, RD_NFA_SPLIT, -1, -1, -1);
+        *start = rd_new_state(re, RD_NFA_SPLIT, -1, s1, s2);
+        re->nfa[e1].out = *end;
+        re->nfa[e2].out = *end;
+        return 0;
+    case RD_NODE_STAR:
+    case RD_NODE_PLUS:
+    case RD_NODE_QUEST:
+        if (rd_build(ps, ps->nodes[node].left, &s1, &e1))
+            return -1;
+        *end = rd_new_state(re, RD_NFA_SPLIT, -1, -1, -1);
+        s2 = rd_new_state(re, RD_NFA_SPLIT, -1, s1, *end);
+        /* Loop back for * and + */
+        re->nfa[e1].out = (ps->nodes[node].kind == RD_NODE_QUEST) ? *end : s2;
+        *start = (ps->nodes[node].kind == RD_NODE_PLUS) ? s1 : s2;
+        return 0;
+    }
+
+    return -1;
+}
+
+/* ------------ */
+/* Lazy DFA     */
+/* ------------ */
+
+/* Add the NFA states reachable from state without reading to closure */
+static void rd_add_closure(struct regex_dfa *re, int state)
+{
+    if (re->stack)
+        sbsetcount(re->stack, 0);
+    sbpush(re->stack, state);
+
+    while (sbcount(re->stack))
+    {
+        int s = re->stack[sbcount(re->stack) - 1];
+
+        sbsetcount(re->stack, sbcount(re->stack) - 1);
+
+        if (s < 0 || re->marks[s] == re->mark_gen)
+            continue;
+
+        re->marks[s] = re->mark_gen;
+
+        if (re->nfa[s].kind == RD_NFA_SPLIT)
+        {
+            sbpush(re->stack, re->nfa[s].out1);
+            sbpush(re->stack, re->nfa[s].out);
+        }
+        else
+            sbpush(re->closure, s);
+    }
+}
+
+static void rd_begin_closure(struct regex_dfa *re)
+{
+    if (re->closure)
+        sbsetcount(re->closure, 0);
+
+    re->mark_gen++;
+}
+
+static int rd_int_compare(const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+static uint32_t rd_closure_hash(const int *states, int count)
+{
+    int i;
+    uint32_t hash = 2166136261u;
+
+    for (i = 0; i < count; i++)
+        hash = (hash ^ (uint32_t)states[i]) * 16777619;
+
+    return hash;
+}
+
+static void rd_dfa_insert(struct rd_dfa *dfa, int state, uint32_t hash)
+{
+    int i = hash & (dfa->table_size - 1);
+
+    while (dfa->table[i] != -1)
+        i = (i + 1) & (dfa->table_size - 1);
+
+    dfa->table[i] = state;
+}
+
+/* Find or add the DFA state for the NFA states in closure */
+static int rd_dfa_state(struct regex_dfa *re, struct rd_dfa *dfa)
+{
+    int i, state;
+    int count = sbcount(re->closure);
+    uint32_t hash;
+
+    qsort(re->closure, count, sizeof(int), rd_int_compare);
+    hash = rd_closure_hash(re->closure, count);
+
+    for (i = hash & (dfa->table_size - 1); dfa->table[i] != -1;
+         i = (i + 1) & (dfa->table_size - 1))
+    {
+        int s = dfa->table[i];
+
+        if (dfa->offsets[s + 1] - dfa->offsets[s] == count &&
+            !memcmp(dfa->nfa_states + dfa->offsets[s], re->closure, count * sizeof(int)))
+            return s;
+    }
+
+    state = sbcount(dfa->flags);
+
+    memcpy(sbadd(dfa->nfa_states, count), re->closure, count * sizeof(int));
+    sbpush(dfa->offsets, sbcount(dfa->nfa_states));
+    sbpush(dfa->flags, 0);
+    memset(sbadd(dfa->trans, re->class_count), 0xff, re->class_count * sizeof(int));
+
+    for (i = 0; i < count; i++)
+    {
+        if (re->closure[i] == re->nfa_match)
+            dfa->flags[state] |= RD_ACCEPT;
+    }
+
+    if (!count)
+        dfa->flags[state] |= RD_DEAD;
+
+    /* Keep the hash table at most half full */
+    if (sbcount(dfa->flags) * 2 > dfa->table_size)
+    {
+        int s;
+
+        dfa->table_size *= 2;
+        sbsetcount(dfa->table, dfa->table_size);
+        memset(dfa->table, 0xff, dfa->table_size * sizeof(int));
+
+        for (s = 0; s < sbcount(dfa->flags); s++)
+        {
+            rd_dfa_insert(dfa, s, rd_closure_hash(dfa->nfa_states + dfa->offsets[s],
+                dfa->offsets[s + 1] - dfa->offsets[s]));
+        }
+    }
+    else
+        rd_dfa_insert(dfa, state, hash);
+
+    return state;
+}
+
+static void rd_dfa_reset(struct regex_dfa *re, struct rd_dfa *dfa)
+{
+    sbfree(dfa->nfa_states);
+    sbfree(dfa->offsets);
+    sbfree(dfa->flags);
+    sbfree(dfa->trans);
+    dfa->nfa_states = NULL;
+    dfa->offsets = NULL;
+    dfa->flags = NULL;
+    dfa->trans = NULL;
+
+    dfa->table_size = 64;
+    if (dfa->table)
+        sbsetcount(dfa->table, 0);
+    memset(sbadd(dfa->table, dfa->table_size), 0xff, dfa->table_size * sizeof(int));
+
+    sbpush(dfa->offsets, 0);
+
+    rd_begin_closure(re);
+    rd_add_closure(re, re->nfa_start);
+    dfa->start = rd_dfa_state(re, dfa);
+}
+
+static void rd_dfa_free(struct rd_dfa *dfa)
+{
+    sbfree(dfa->nfa_states);
+    sbfree(dfa->offsets);
+    sbfree(dfa->flags);
+    sbfree(dfa->trans);
+    sbfree(dfa->table);
+}
+
+/**
+ * Build the transition out of a DFA state on a byte class.
+ *
+ * \return
+ * The next state, or RD_BAIL if the text has to be searched with regexec.
+ */
+static int rd_dfa_next(struct regex_dfa *re, struct rd_dfa *dfa, int state, int cls)
+{
+    int i, next;
+    unsigned char c = re->class_rep[cls];
+
+    if (re->needs_ascii && c >= 0x80)
+        return RD_BAIL;
+
+    if (sbcount(dfa->flags) >= RD_MAX_DFA_STATES)
+    {
+        re->flush = 1;
+        return RD_BAIL;
+    }
+
+    rd_begin_closure(re);
+
+    for (i = dfa->offsets[state]; i < dfa->offsets[state + 1]; i++)
+    {
+        struct rd_nfa_state *s = &re->nfa[dfa->nfa_states[i]];
+
+        if (s->kind == RD_NFA_SET && rd_set_has(&re->sets[s->set], re->fold[c]))
+            rd_add_closure(re, s->out);
+    }
+
+    /* A new match can start at every byte */
+    if (dfa->unanchored)
+        rd_add_closure(re, re->nfa_start);
+
+    next = rd_dfa_state(re, dfa);
+    dfa->trans[state * re->class_count + cls] = next;
+
+    return next;
+}
+
+/**
+ * Run a DFA over text.
+ *
+ * \param first
+ * Stop at the first match end instead of the last
+ *
+ * \return
+ * The offset the first or last match ends at, RD_NONE if no match ends in
+ * the text, or RD_BAIL.
+ */
+static int rd_dfa_run(struct regex_dfa *re, struct rd_dfa *dfa,
+    const char *text, int from, int len, int first)
+{
+    int i;
+    int state = dfa->start;
+    int last = RD_NONE;
+    int class_count = re->class_count;
+    const unsigned char *classes = re->classes;
+    const unsigned char *flags = dfa->flags;
+    const int *trans = dfa->trans;
+
+    for (i = from;; i++)
+    {
+        int next;
+
+        /* Bytes no match starts with leave the start state as it is */
+        if (dfa->unanchored && state == dfa->start)
+        {
+            while (i < len && !re->starts[(unsigned char)text[i]])
+                i++;
+        }
+
+        if ((flags[state] & RD_ACCEPT) && (!re->anchored_end || i == len))
+        {
+            last = i;
+            if (first)
+                break;
+        }
+
+        if (i == len || (flags[state] & RD_DEAD))
+            break;
+
+        next = trans[state * class_count + classes[(unsigned char)text[i]]];
+        if (next < 0)
+        {
+            next = rd_dfa_next(re, dfa, state, classes[(unsigned char)text[i]]);
+            if (next < 0)
+                return next;
+
+            /* Adding the state may have moved them */
+            flags = dfa->flags;
+            trans = dfa->trans;
+        }
+
+        state = next;
+    }
+
+    return last;
+}
+
+/* ------------------ */
+/* Literal search     */
+/* ------------------ */
+
+/* Find str (already folded) in text at or after from. Returns the offset or -1. */
+static int rd_find(struct regex_dfa *re, const char *text, int from, int len,
+    const char *str, int str_len)
+{
+    const char *p = text + from;
+    const char *last = text + len - str_len + 1;
+    const char *lower, *upper;
+    unsigned char c1, c2;
+    int i;
+
+    if (last <= p)
+        return -1;
+
+#if HAVE_MEMMEM
+    if (!re->icase)
+    {
+        const char *found = (const char *)memmem(p, len - from, str, str_len);
+
+        return found ? found - text : -1;
+    }
+#endif
+
+    /* Look for the first byte in either case, then compare the rest */
+    c1 = str[0];
+    c2 = toupper(c1);
+    if (re->fold[c2] != c1)
+        c2 = c1;
+
+    lower = (const char *)memchr(p, c1, last - p);
+    upper = (c2 != c1) ? (const char *)memchr(p, c2, last - p) : NULL;
+
+    while (lower || upper)
+    {
+        const char *q = (!upper || (lower && lower < upper)) ? lower : upper;
+
+        for (i = 1; i < str_len; i++)
+        {
+            if (re->fold[(unsigned char)q[i]] != (unsigned char)str[i])
+                break;
+        }
+
+        if (i == str_len)
+            return q - text;
+
+        if (q == lower)
+            lower = (const char *)memchr(q + 1, c1, last - q - 1);
+        else
+            upper = (const char *)memchr(q + 1, c2, last - q - 1);
+    }
+
+    return -1;
+}
+
+/* ----------------- */
+/* Exposed Functions */
+/* ----------------- */
+
+/* Descriptive comments found in header file: regex_dfa.h */
+
+struct regex_dfa *regex_dfa_compile(const char *regex, int icase)
+{
+    struct rd_parser ps;
+    struct regex_dfa *re;
+    const char *end = regex + strlen(regex);
+    int *seq = NULL;
+    int node, start, i;
+
+    re = (struct regex_dfa *)cgdb_calloc(1, sizeof(struct regex_dfa));
+    re->icase = icase;
+
+    for (i = 0; i < 256; i++)
+        re->fold[i] = icase ? tolower(i) : i;
+
+    memset(&ps, 0, sizeof(ps));
+    ps.re = re;
+
+    ps.multibyte = MB_CUR_MAX > 1;
+#if HAVE_LANGINFO_H
+    /* Byte matching is only right for UTF-8 */
+    if (ps.multibyte && strcmp(nl_langinfo(CODESET), "UTF-8"))
+    {
+        regex_dfa_free(re);
+        return NULL;
+    }
+#endif
+
+    /* Anchors are only handled at the ends of the pattern */
+    if (*regex == '^')
+    {
+        re->anchored_start = 1;
+        regex++;
+    }
+
+    if (end > regex && end[-1] == '$')
+    {
+        const char *p = end - 1;
+
+        while (p > regex && p[-1] == '\\')
+            p--;
+
+        if ((end - 1 - p) % 2 == 0)
+        {
+            re->anchored_end = 1;
+            end--;
+        }
+    }
+
+    ps.p = regex;
+    ps.end = end;
+    node = rd_parse_alt(&ps);
+
+    if (ps.error || ps.p != ps.end ||
+        (ps.top_alt && (re->anchored_start || re->anchored_end)))
+    {
+        sbfree(ps.nodes);
+        regex_dfa_free(re);
+        return NULL;
+    }
+
+    /* Case folding and classes work on whole characters in multibyte
+     * locales, so text with them is left to regexec */
+    re->needs_ascii = ps.multibyte && (ps.wide || icase);
+
+    /* Plain strings and strings every match starts with */
+    rd_flatten_cat(&ps, node, &seq);
+
+    for (i = 0; i < sbcount(seq); i++)
+    {
+        int c;
+
+        if (ps.nodes[seq[i]].kind != RD_NODE_SET)
+            break;
+
+        c = rd_set_single(&re->sets[ps.nodes[seq[i]].set]);
+        if (c == -1)
+            break;
+
+        sbpush(re->prefix, c);
+    }
+
+    re->prefix_len = sbcount(re->prefix);
+
+    if (i == sbcount(seq) && !re->anchored_start && !re->anchored_end &&
+        !(icase && ps.multibyte))
+    {
+        re->literal = re->prefix;
+        re->literal_len = re->prefix_len;
+        re->prefix = NULL;
+        re->prefix_len = 0;
+
+        sbfree(seq);
+        sbfree(ps.nodes);
+        return re;
+    }
+
+    sbfree(seq);
+
+    if ((ps.multibyte && ps.high) ||
+        rd_build(&ps, node, &start, &re->nfa_match) == -1 ||
+        sbcount(re->nfa) > RD_MAX_NFA_STATES)
+    {
+        sbfree(ps.nodes);
+        regex_dfa_free(re);
+        return NULL;
+    }
+
+    sbfree(ps.nodes);
+
+    re->nfa_start = start;
+    re->nfa[re->nfa_match].kind = RD_NFA_MATCH;
+
+    /* Split the bytes into classes that every set treats the same */
+    memset(re->classes, 0, sizeof(re->classes));
+    re->class_count = 1;
+
+    for (i = 0; i < sbcount(re->sets); i++)
+    {
+        int split[256];
+        int c;
+
+        /* The class the bytes of each old class in the set move to */
+        for (c = 0; c < 256; c++)
+            split[c] = -1;
+
+        for (c = 0; c < 256; c++)
+        {
+            int in = rd_set_has(&re->sets[i], re->fold[c]);
+            int old = re->classes[c];
+
+            if (!in)
+                continue;
+
+            if (split[old] == -1)
+            {
+                int k;
+
+                /* Only split when some byte in the old class is out */
+                for (k = 0; k < 256; k++)
+                {
+                    if (re->classes[k] == old && !rd_set_has(&re->sets[i], re->fold[k]))
+                        break;
+                }
+
+                split[old] = (k == 256) ? old : re->class_count++;
+            }
+
+            re->classes[c] = split[old];
+        }
+    }
+
+    /* Leave room for the class below */
+    if (re->class_count > 255)
+    {
+        regex_dfa_free(re);
+        return NULL;
+    }
+
+    /* Bytes the text has to be searched with regexec for get a class of
+     * their own */
+    if (re->needs_ascii)
+    {
+        for (i = 0x80; i < 256; i++)
+            re->classes[i] = re->class_count;
+
+        re->class_count++;
+    }
+
+    for (i = 255; i >= 0; i--)
+        re->class_rep[re->classes[i]] = i;
+
+    re->marks = (int *)cgdb_calloc(sbcount(re->nfa), sizeof(int));
+
+    /* Every byte can start an empty match, and bytes the text has to be
+     * searched with regexec for can't be skipped */
+    for (i = 0x80; re->needs_ascii && i < 256; i++)
+        re->starts[i] = 1;
+
+    rd_begin_closure(re);
+    rd_add_closure(re, re->nfa_start);
+
+    for (i = 0; i < sbcount(re->closure); i++)
+    {
+        struct rd_nfa_state *state = &re->nfa[re->closure[i]];
+        int c;
+
+        for (c = 0; c < 256; c++)
+        {
+            if (state->kind == RD_NFA_MATCH ||
+                rd_set_has(&re->sets[state->set], re->fold[c]))
+                re->starts[c] = 1;
+        }
+    }
+
+    re->search_dfa.unanchored = 1;
+    rd_dfa_reset(re, &re->search_dfa);
+    rd_dfa_reset(re, &re->match_dfa);
+
+    return re;
+}
+
+void regex_dfa_free(struct regex_dfa *dfa)
+{
+    if (!dfa)
+        return;
+
+    sbfree(dfa->literal);
+    sbfree(dfa->prefix);
+    sbfree(dfa->sets);
+    sbfree(dfa->nfa);
+    sbfree(dfa->closure);
+    sbfree(dfa->stack);
+    free(dfa->marks);
+    rd_dfa_free(&dfa->search_dfa);
+    rd_dfa_free(&dfa->match_dfa);
+    free(dfa);
+}
+
+int regex_dfa_search(struct regex_dfa *dfa, const char *text, int len,
+    int *start, int *end)
+{
+    int s, e, from = 0;
+
+    if (dfa->literal)
+    {
+        s = rd_find(dfa, text, 0, len, dfa->literal, dfa->literal_len);
+        if (s == -1)
+            return 0;
+
+        *start = s;
+        *end = s + dfa->literal_len;
+        return 1;
+    }
+
+    /* Start over if the DFAs filled up last time */
+    if (dfa->flush)
+    {
+        rd_dfa_reset(dfa, &dfa->search_dfa);
+        rd_dfa_reset(dfa, &dfa->match_dfa);
+        dfa->flush = 0;
+    }
+
+    if (dfa->prefix)
+    {
+        from = rd_find(dfa, text, 0, len, dfa->prefix, dfa->prefix_len);
+        if (from == -1 || (dfa->anchored_start && from != 0))
+            return 0;
+    }
+
+    if (dfa->anchored_start)
+        s = 0;
+    else
+    {
+        /* Where the first match to end ends. The leftmost match starts at
+         * or before it. */
+        e = rd_dfa_run(dfa, &dfa->search_dfa, text, from, len, 1);
+        if (e < 0)
+            return (e == RD_BAIL) ? -1 : 0;
+
+        for (s = from; s <= e; s++)
+        {
+            int found;
+
+            if (dfa->prefix)
+            {
+                s = rd_find(dfa, text, s, len, dfa->prefix, dfa->prefix_len);
+                if (s == -1 || s > e)
+                    return 0;
+            }
+            else if (s < len && !dfa->starts[(unsigned char)text[s]])
+                continue;
+
+            found = rd_dfa_run(dfa, &dfa->match_dfa, text, s, len, 1);
+            if (found == RD_BAIL)
+                return -1;
+            if (found >= 0)
+                break;
+        }
+
+        if (s > e)
+            return 0;
+    }
+
+    /* The longest match starting there */
+    e = rd_dfa_run(dfa, &dfa->match_dfa, text, s, len, 0);
+    if (e == RD_BAIL)
+        return -1;
+    if (e <= s)
+        return 0;
+
+    *start = s;
+    *end = e;
+    return 1;
+}
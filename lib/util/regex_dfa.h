@@ -0,0 +1,61 @@
+#ifndef __REGEX_DFA_H__
+#define __REGEX_DFA_H__
+
+/*******************************************************************************
+ *
+ * This is a matcher for the common subset of POSIX extended regular
+ * expressions, meant to sit in front of regcomp/regexec and give the same
+ * leftmost longest matches. Patterns that are plain strings are found with
+ * memmem (or memchr when ignoring case). Other patterns are turned into an
+ * NFA, and the states of a DFA are built from it as the text needs them. A
+ * literal prefix of the pattern is used to skip to where a match can start.
+ *
+ * Anything the matcher can't match exactly like the C library returns an
+ * error, either when compiling (back references, anchors in the middle of
+ * a pattern, [= =] and [. .] bracket items, ...) or when searching (text
+ * the pattern could match multibyte characters in). The caller then uses
+ * regexec.
+ ******************************************************************************/
+
+struct regex_dfa;
+
+/* regex_dfa_compile:
+ * ------------------
+ *
+ *  Compile an extended regular expression. It should already have been
+ *  compiled with regcomp, this doesn't report syntax errors.
+ *
+ *  regex - The regular expression.
+ *  icase - Non-zero to ignore case, like REG_ICASE.
+ *
+ *  Returns the matcher, or NULL if the pattern has to be matched with regexec.
+ */
+struct regex_dfa *regex_dfa_compile(const char *regex, int icase);
+
+/* regex_dfa_free:
+ * ---------------
+ *
+ *  Free a matcher returned by regex_dfa_compile.
+ */
+void regex_dfa_free(struct regex_dfa *dfa);
+
+/* regex_dfa_search:
+ * -----------------
+ *
+ *  Find the leftmost longest match in a block of text. The start of text
+ *  is where ^ matches and len is where $ matches.
+ *
+ *  dfa   - The matcher.
+ *  text  - The text to search, does not need to be nil terminated.
+ *  len   - The number of bytes in text.
+ *  start - Set to the offset of the match.
+ *  end   - Set to one past the end of the match.
+ *
+ *  Returns 1 if a non-empty match was found, 0 if there is no match or the
+ *  leftmost longest match is empty, and -1 if the text has to be searched
+ *  with regexec.
+ */
+int regex_dfa_search(struct regex_dfa *dfa, const char *text, int len,
+    int *start, int *end);
+
+#endif /* __REGEX_DFA_H__ */
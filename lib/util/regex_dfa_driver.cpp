@@ -0,0 +1,337 @@
+/* regex_dfa_driver:
+ * -----------------
+ *
+ * Checks regex_dfa finds the same matches as regexec and measures how
+ * fast both are, searching each line the way the source window does.
+ *
+ * Usage: regex_dfa_driver [file]
+ *
+ * Without a file, about 16MB of C like source is generated.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#if HAVE_STDIO_H
+#include <stdio.h>
+#endif /* HAVE_STDIO_H */
+
+#if HAVE_STDLIB_H
+#include <stdlib.h>
+#endif /* HAVE_STDLIB_H */
+
+#if HAVE_STRING_H
+#include <string.h>
+#endif /* HAVE_STRING_H */
+
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+
+#include <locale.h>
+
+#if HAVE_REGEX_H
+#include <regex.h>
+#endif /* HAVE_REGEX_H */
+
+#include "sys_util.h"
+#include "text_util.h"
+#include "regex_dfa.h"
+
+/* Times each benchmark is run, the best run is reported */
+#define RUNS 3
+
+struct pattern
+{
+    const char *regex;
+    int icase;
+};
+
+/* Patterns that are timed on the whole text */
+static const struct pattern patterns[] = {
+    { "compute", 0 },
+    { "COMPUTE", 1 },
+    { "values\\[i\\]", 0 },
+    { "arg->[a-z]+", 0 },
+    { "[0-9]+", 0 },
+    { "i(nt|f) ", 0 },
+    { "count;$", 0 },
+    { "^static", 0 },
+    { "struct [a-z_]+ \\*", 1 },
+    { "[A-Z_]{4,}", 0 },
+    { "(for|while) \\(", 0 },
+    { "not_in_the_text", 0 },
+};
+
+/* Patterns and text that are only checked */
+static const char *edge_patterns[] = {
+    "a*", "a+", "(a|ab)(c|bcd)(d*)", "x?y", "a{2}", "a{1,3}b", "(ab){0,}c",
+    "[]a]", "[^a-c]+", "[-x]+", "[[:digit:]][[:alpha:]]", ".*b", "^a*$",
+    "a|b|", "\\.", "((a)|b)+", "a.c", "[[:space:]]+$", "b$", "^$",
+    "(a*)*", "(a|b)*c", "\\w", "(", "a{300}", "[[.a.]]", "a\\1", "\\]",
+    "a\\-b", "\\<a", "a\\|b", "[a-c]{2,3}", "(a|b|cd)+$", "a{,2}",
+    "a.b", "[^a]", "\xc3\xa9", "\xc3\xa9" "b", "[[:alpha:]]+",
+};
+
+static const char *edge_text[] = {
+    "", "a", "aa", "abcd", "xabcdx", "aaab", "ababc", "]a]", "dzz-x",
+    "1a", "cbb", "aaaa", "a|b", "x.y", "aab", "abc  ", "ab", "ccc",
+    "a-b", "acdb", "ABcd", "AaB", "cdcdab", "a\xc3\xa9" "b", "\xc3\x89" "a",
+};
+
+static double get_time(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static char *generate_source(long size)
+{
+    static const char *lines[] = {
+        "/* A comment describing the next function */\n",
+        "static int function_name(struct some_type *arg, int count)\n",
+        "{\n",
+        "    int i;\n",
+        "    for (i = 0; i < count; i++)\n",
+        "        arg->values[i] = compute(arg, i); /* trailing */\n",
+        "    while (MAX_VALUE > 42) count--;\n",
+        "    return count;\n",
+        "}\n",
+        "\n",
+    };
+    char *data = NULL;
+    int i = 0;
+
+    while (sbcount(data) < size)
+    {
+        const char *line = lines[i++ % (sizeof(lines) / sizeof(lines[0]))];
+        int len = strlen(line);
+
+        memcpy(sbadd(data, len), line, len);
+    }
+
+    return data;
+}
+
+static char *read_source(const char *filename)
+{
+    char *data = NULL;
+    char buf[65536];
+    int len;
+    FILE *file = fopen(filename, "rb");
+
+    if (!file)
+        return NULL;
+
+    while ((len = (int)fread(buf, 1, sizeof(buf), file)) > 0)
+        memcpy(sbadd(data, len), buf, len);
+
+    fclose(file);
+    return data;
+}
+
+/* Length of a line without its line feed */
+static int line_length(const char *data, const long *offsets, int line)
+{
+    long end = offsets[line + 1];
+
+    if (end > offsets[line] && data[end - 1] == '\n')
+        end--;
+
+    return end - offsets[line];
+}
+
+/* Search a line with regexec, like hl_regex_search */
+static int search_regexec(regex_t *t, const char *line, int len,
+    int *start, int *end)
+{
+    regmatch_t pmatch;
+
+    pmatch.rm_so = 0;
+    pmatch.rm_eo = len;
+
+    if (regexec(t, line, 1, &pmatch, REG_STARTEND) == 0 &&
+        pmatch.rm_eo > pmatch.rm_so)
+    {
+        *start = pmatch.rm_so;
+        *end = pmatch.rm_eo;
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Search a line with the matcher, falling back to regexec */
+static int search_dfa(struct regex_dfa *dfa, regex_t *t, const char *line,
+    int len, int *start, int *end, long *fallbacks)
+{
+    int result = dfa ? regex_dfa_search(dfa, line, len, start, end) : -1;
+
+    if (result >= 0)
+        return result;
+
+    (*fallbacks)++;
+    return search_regexec(t, line, len, start, end);
+}
+
+/**
+ * Compare the matches regexec and the matcher find in some text, starting
+ * again after each match like hl_regex_find_all.
+ *
+ * \return
+ * 0 if they agree, -1 otherwise.
+ */
+static int check_text(const char *regex, struct regex_dfa *dfa, regex_t *t,
+    const char *line, int len)
+{
+    int pos = 0;
+    long fallbacks = 0;
+
+    for (;;)
+    {
+        int start1 = -1, end1 = -1, start2 = -1, end2 = -1;
+        int found1 = search_regexec(t, line + pos, len - pos, &start1, &end1);
+        int found2 = search_dfa(dfa, t, line + pos, len - pos, &start2, &end2,
+            &fallbacks);
+
+        if (found1 != found2 || (found1 && (start1 != start2 || end1 != end2)))
+        {
+            printf("FAIL: /%s/ on \"%.*s\": regexec %d %d-%d, dfa %d %d-%d\n",
+                regex, len - pos, line + pos, found1, start1, end1,
+                found2, start2, end2);
+            return -1;
+        }
+
+        if (!found1)
+            return 0;
+
+        pos += end1;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    char *data;
+    long size;
+    long *offsets = NULL;
+    int failed = 0;
+    int i, j, run, line_count;
+
+    /* Match in the locale cgdb would */
+    setlocale(LC_CTYPE, "");
+
+    data = (argc > 1) ? read_source(argv[1]) : generate_source(16 * 1024 * 1024);
+    if (!data)
+    {
+        fprintf(stderr, "%s: could not read %s\n", argv[0], argv[1]);
+        return 1;
+    }
+
+    size = sbcount(data);
+    text_util_index_lines(data, size, &offsets);
+    line_count = sbcount(offsets) - 1;
+
+    printf("%ld bytes, %d lines\n", size, line_count);
+
+    /* Edge cases, patterns the matcher doesn't take just use regexec */
+    for (i = 0; i < (int)(sizeof(edge_patterns) / sizeof(edge_patterns[0])); i++)
+    {
+        int icase;
+
+        for (icase = 0; icase < 2; icase++)
+        {
+            regex_t t;
+            struct regex_dfa *dfa;
+
+            if (regcomp(&t, edge_patterns[i], REG_EXTENDED | (icase ? REG_ICASE : 0)))
+                continue;
+
+            dfa = regex_dfa_compile(edge_patterns[i], icase);
+
+            for (j = 0; j < (int)(sizeof(edge_text) / sizeof(edge_text[0])); j++)
+            {
+                if (check_text(edge_patterns[i], dfa, &t, edge_text[j],
+                        strlen(edge_text[j])))
+                    failed = 1;
+            }
+
+            regex_dfa_free(dfa);
+            regfree(&t);
+        }
+    }
+
+    for (i = 0; i < (int)(sizeof(patterns) / sizeof(patterns[0])); i++)
+    {
+        regex_t t;
+        struct regex_dfa *dfa;
+        double best_regexec = 1e9, best_dfa = 1e9, start;
+        long matches1 = 0, matches2 = 0, fallbacks = 0;
+        int s, e;
+
+        if (regcomp(&t, patterns[i].regex, REG_EXTENDED |
+                (patterns[i].icase ? REG_ICASE : 0)))
+        {
+            printf("FAIL: /%s/ does not compile\n", patterns[i].regex);
+            failed = 1;
+            continue;
+        }
+
+        dfa = regex_dfa_compile(patterns[i].regex, patterns[i].icase);
+
+        for (run = 0; run < RUNS; run++)
+        {
+            matches1 = 0;
+            start = get_time();
+            for (j = 0; j < line_count; j++)
+            {
+                matches1 += search_regexec(&t, data + offsets[j],
+                    line_length(data, offsets, j), &s, &e);
+            }
+            best_regexec = MIN(best_regexec, get_time() - start);
+
+            matches2 = 0;
+            fallbacks = 0;
+            start = get_time();
+            for (j = 0; j < line_count; j++)
+            {
+                matches2 += search_dfa(dfa, &t, data + offsets[j],
+                    line_length(data, offsets, j), &s, &e, &fallbacks);
+            }
+            best_dfa = MIN(best_dfa, get_time() - start);
+        }
+
+        printf("%-24s%s regexec %8.1f MB/s, dfa %8.1f MB/s%s\n",
+            patterns[i].regex, patterns[i].icase ? " (icase)" : "        ",
+            size / best_regexec / (1024.0 * 1024.0),
+            size / best_dfa / (1024.0 * 1024.0),
+            !dfa ? " (not handled)" : fallbacks ? " (fell back)" : "");
+
+        if (matches1 != matches2)
+        {
+            printf("FAIL: /%s/ matched %ld lines with regexec, %ld with dfa\n",
+                patterns[i].regex, matches1, matches2);
+            failed = 1;
+        }
+
+        for (j = 0; j < line_count; j++)
+        {
+            if (check_text(patterns[i].regex, dfa, &t, data + offsets[j],
+                    line_length(data, offsets, j)))
+            {
+                failed = 1;
+                break;
+            }
+        }
+
+        regex_dfa_free(dfa);
+        regfree(&t);
+    }
+
+    sbfree(offsets);
+    sbfree(data);
+
+    return failed;
+}
@@ -91,6 +91,26 @@ int swin_scrl(int n)
     return scrl(n);
 }
 
+int swin_wscrl(SWINDOW *win, int n)
+{
+    return wscrl((WINDOW *)win, n);
+}
+
+int swin_scrollok(SWINDOW *win, int bf)
+{
+    return scrollok((WINDOW *)win, bf);
+}
+
+int swin_idlok(SWINDOW *win, int bf)
+{
+    return idlok((WINDOW *)win, bf);
+}
+
+int swin_touchwin(SWINDOW *win)
+{
+    return touchwin((WINDOW *)win);
+}
+
 int swin_keypad(SWINDOW *win, int bf)
 {
     return keypad((WINDOW *)win, bf);
@@ -52,6 +52,18 @@ int swin_delwin(SWINDOW *win);
 
 /* Scroll window up n lines */
 int swin_scrl(int n);   
+int swin_wscrl(SWINDOW *win, int n);
+
+/* Allow the window to be scrolled. With it off, writing past the bottom
+   right corner leaves the cursor there instead of scrolling. */
+int swin_scrollok(SWINDOW *win, int bf);
+
+/* Let curses use the terminal's insert and delete line features, and its
+   scroll regions, when updating the screen. */
+int swin_idlok(SWINDOW *win, int bf);
+
+/* Mark the whole window as changed, so the next refresh copies all of it */
+int swin_touchwin(SWINDOW *win);
 
 /* The keypad option enables the keypad of the user's terminal. If enabled 
    the user can press a function key (such as an arrow key) and wgetch returns
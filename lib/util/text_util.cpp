@@ -0,0 +1,159 @@
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#if HAVE_STRING_H
+#include <string.h>
+#endif /* HAVE_STRING_H */
+
+#include "sys_util.h"
+#include "text_util.h"
+
+/* Pick the widest vector instructions the compiler is targeting. Nothing
+ * is detected at runtime, SSE2 is always there on x86-64. */
+#if defined(__GNUC__) && defined(__AVX2__)
+#include <immintrin.h>
+#define TEXT_UTIL_BLOCK 32
+typedef __m256i text_util_vec;
+#define text_util_splat(c) _mm256_set1_epi8(c)
+#define text_util_load(p) _mm256_loadu_si256((const __m256i *)(p))
+#define text_util_mask(v, c) \
+    ((unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8((v), (c))))
+#elif defined(__GNUC__) && defined(__SSE2__)
+#include <emmintrin.h>
+#define TEXT_UTIL_BLOCK 16
+typedef __m128i text_util_vec;
+#define text_util_splat(c) _mm_set1_epi8(c)
+#define text_util_load(p) _mm_loadu_si128((const __m128i *)(p))
+#define text_util_mask(v, c) \
+    ((unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8((v), (c))))
+#endif
+
+/* Find the first tab, line feed or carriage return in p to end */
+static const char *find_special(const char *p, const char *end)
+{
+#ifdef TEXT_UTIL_BLOCK
+    const text_util_vec tab = text_util_splat('\t');
+    const text_util_vec lf = text_util_splat('\n');
+    const text_util_vec cr = text_util_splat('\r');
+
+    while (end - p >= TEXT_UTIL_BLOCK)
+    {
+        text_util_vec v = text_util_load(p);
+        unsigned int mask = text_util_mask(v, tab) | text_util_mask(v, lf) |
+            text_util_mask(v, cr);
+
+        if (mask)
+            return p + __builtin_ctz(mask);
+
+        p += TEXT_UTIL_BLOCK;
+    }
+#endif
+
+    for (; p < end; p++)
+    {
+        if (*p == '\t' || *p == '\n' || *p == '\r')
+            break;
+    }
+
+    return p;
+}
+
+long text_util_index_lines(const char *data, long size, long **offsets)
+{
+    /* memchr is already vectorized, and on real sources where lines are
+     * short it beats walking the line feeds of a compare mask */
+    long max_len = 0;
+    const char *line_start = data;
+    const char *data_end = data + size;
+
+    while (line_start < data_end)
+    {
+        const char *line_feed = (const char *)memchr(line_start, '\n', data_end - line_start);
+        const char *line_end = line_feed ? line_feed + 1 : data_end;
+
+        sbpush(*offsets, line_start - data);
+
+        if (line_end - line_start > max_len)
+            max_len = line_end - line_start;
+
+        line_start = line_end;
+    }
+
+    sbpush(*offsets, size);
+    return max_len;
+}
+
+long text_util_detab_width(const char *text, long len, int tabstop)
+{
+    long width = 0;
+    long col = 0;
+    const char *p = text;
+    const char *end = text + len;
+
+    while (p < end)
+    {
+        const char *s = find_special(p, end);
+
+        col += s - p;
+        width += s - p;
+
+        if (s == end)
+            break;
+
+        if (*s == '\t')
+        {
+            int spaces = tabstop - col % tabstop;
+
+            col += spaces;
+            width += spaces;
+        }
+        else
+        {
+            col = 0;
+            width++;
+        }
+
+        p = s + 1;
+    }
+
+    return width;
+}
+
+long text_util_detab(const char *text, long len, int tabstop, char *dst)
+{
+    long col = 0;
+    char *d = dst;
+    const char *p = text;
+    const char *end = text + len;
+
+    while (p < end)
+    {
+        const char *s = find_special(p, end);
+
+        memcpy(d, p, s - p);
+        d += s - p;
+        col += s - p;
+
+        if (s == end)
+            break;
+
+        if (*s == '\t')
+        {
+            int spaces = tabstop - col % tabstop;
+
+            memset(d, ' ', spaces);
+            d += spaces;
+            col += spaces;
+        }
+        else
+        {
+            *d++ = *s;
+            col = 0;
+        }
+
+        p = s + 1;
+    }
+
+    return d - dst;
+}
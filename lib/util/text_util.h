@@ -0,0 +1,58 @@
+#ifndef __TEXT_UTIL_H__
+#define __TEXT_UTIL_H__
+
+/*******************************************************************************
+ *
+ * This is the text scanning unit. It has the kernels used to split source
+ * files into lines and expand their tabs. When the compiler targets SSE2 or
+ * AVX2, tab expansion looks for tabs, line feeds and carriage returns 16 or
+ * 32 bytes at a time. Otherwise a scalar version is used.
+ ******************************************************************************/
+
+/* text_util_index_lines:
+ * ----------------------
+ *
+ *  Find the start of every line in a block of text. Lines are split on
+ *  line feeds, which stay part of the line they end.
+ *
+ *  data    - The text to index, does not need to be nil terminated.
+ *  size    - The number of bytes in data.
+ *  offsets - Stretchy buffer the offset of each line is appended to,
+ *            followed by size as a sentinel. So line i spans
+ *            offsets[i] to offsets[i + 1].
+ *
+ *  Returns the length in bytes of the longest line.
+ */
+long text_util_index_lines(const char *data, long size, long **offsets);
+
+/* text_util_detab_width:
+ * ----------------------
+ *
+ *  Get the number of bytes text takes up once its tabs are expanded. The
+ *  column tabs are expanded from starts over after each line feed or
+ *  carriage return.
+ *
+ *  text    - The text, does not need to be nil terminated.
+ *  len     - The number of bytes in text.
+ *  tabstop - The tabstop to expand tabs to.
+ *
+ *  Returns the size of the expanded text.
+ */
+long text_util_detab_width(const char *text, long len, int tabstop);
+
+/* text_util_detab:
+ * ----------------
+ *
+ *  Expand the tabs in text to spaces.
+ *
+ *  text    - The text, does not need to be nil terminated.
+ *  len     - The number of bytes in text.
+ *  tabstop - The tabstop to expand tabs to.
+ *  dst     - Where to write the expanded text. It must have room for
+ *            text_util_detab_width bytes. It isn't nil terminated.
+ *
+ *  Returns the number of bytes written to dst.
+ */
+long text_util_detab(const char *text, long len, int tabstop, char *dst);
+
+#endif /* __TEXT_UTIL_H__ */
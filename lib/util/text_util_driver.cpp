@@ -0,0 +1,283 @@
+/* text_util_driver:
+ * -----------------
+ *
+ * Checks the text_util kernels against simple versions of them and
+ * measures how fast they are.
+ *
+ * Usage: text_util_driver [file]
+ *
+ * Without a file, about 64MB of C like source with tabs is generated.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#if HAVE_STDIO_H
+#include <stdio.h>
+#endif /* HAVE_STDIO_H */
+
+#if HAVE_STDLIB_H
+#include <stdlib.h>
+#endif /* HAVE_STDLIB_H */
+
+#if HAVE_STRING_H
+#include <string.h>
+#endif /* HAVE_STRING_H */
+
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+
+#include "sys_util.h"
+#include "text_util.h"
+
+#define TABSTOP 8
+
+/* Times each benchmark is run, the best run is reported */
+#define RUNS 5
+
+static double get_time(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static char *generate_source(long size)
+{
+    static const char *lines[] = {
+        "/* A comment describing the next function */\n",
+        "static int function_name(struct some_type *arg, int count)\n",
+        "{\n",
+        "\tint i;\n",
+        "\tfor (i = 0; i < count; i++)\n",
+        "\t\targ->values[i] = compute(arg, i);\t/* trailing */\n",
+        "    return count;\r\n",
+        "}\n",
+        "\n",
+    };
+    char *data = NULL;
+    int i = 0;
+
+    while (sbcount(data) < size)
+    {
+        const char *line = lines[i++ % (sizeof(lines) / sizeof(lines[0]))];
+        int len = strlen(line);
+
+        memcpy(sbadd(data, len), line, len);
+    }
+
+    return data;
+}
+
+static char *read_source(const char *filename)
+{
+    char *data = NULL;
+    char buf[65536];
+    int len;
+    FILE *file = fopen(filename, "rb");
+
+    if (!file)
+        return NULL;
+
+    while ((len = (int)fread(buf, 1, sizeof(buf), file)) > 0)
+        memcpy(sbadd(data, len), buf, len);
+
+    fclose(file);
+    return data;
+}
+
+/* The line splitting the source loader used to do: strchr for each line
+ * feed, then trim the cr-lfs backwards. */
+static long index_lines_strchr(char *data, long **offsets)
+{
+    long max_len = 0;
+    char *line_start = data;
+    char *line_feed = strchr(line_start, '\n');
+
+    while (line_feed)
+    {
+        char *line_end = line_feed;
+
+        while (line_end >= line_start && (*line_end == '\n' || *line_end == '\r'))
+            line_end--;
+
+        if (line_end - line_start + 1 > max_len)
+            max_len = line_end - line_start + 1;
+
+        sbpush(*offsets, line_start - data);
+
+        line_start = line_feed + 1;
+        line_feed = strchr(line_start, '\n');
+    }
+
+    if (*line_start)
+        sbpush(*offsets, line_start - data);
+
+    return max_len;
+}
+
+/* text_util_index_lines a byte at a time, to check it against */
+static long index_lines_bytes(const char *data, long size, long **offsets)
+{
+    long i;
+    long max_len = 0;
+    long line_start = 0;
+
+    for (i = 0; i < size; i++)
+    {
+        if (data[i] == '\n' || i + 1 == size)
+        {
+            sbpush(*offsets, line_start);
+            max_len = MAX(max_len, i + 1 - line_start);
+            line_start = i + 1;
+        }
+    }
+
+    sbpush(*offsets, size);
+    return max_len;
+}
+
+/* The tab expansion the source loader used to do: one sbpush per byte */
+static char *detab_sbpush(const char *buffer, long size, int tabstop)
+{
+    long i;
+    int dst = 0;
+    char *newbuf = NULL;
+
+    for (i = 0; i < size; i++)
+    {
+        if (buffer[i] == '\t')
+        {
+            int spaces = tabstop - dst % tabstop;
+
+            while (spaces--)
+            {
+                sbpush(newbuf, ' ');
+                dst++;
+            }
+        }
+        else
+        {
+            sbpush(newbuf, buffer[i]);
+            dst++;
+        }
+
+        if (buffer[i] == '\n' || buffer[i] == '\r')
+            dst = 0;
+    }
+
+    return newbuf;
+}
+
+static void report(const char *name, long size, double secs)
+{
+    printf("%-28s %8.1f MB/s\n", name, size / secs / (1024.0 * 1024.0));
+}
+
+int main(int argc, char **argv)
+{
+    char *data;
+    long size;
+    int run;
+    int failed = 0;
+    double best, start;
+    long *offsets = NULL;
+    long *offsets_bytes = NULL;
+    long max_len = 0;
+    char *detab_old = NULL;
+    char *detab_new = NULL;
+    long width;
+
+    data = (argc > 1) ? read_source(argv[1]) : generate_source(64 * 1024 * 1024);
+    if (!data)
+    {
+        fprintf(stderr, "%s: could not read %s\n", argv[0], argv[1]);
+        return 1;
+    }
+
+    size = sbcount(data);
+
+    /* Nil terminate for the strchr version, without counting the nil */
+    sbpush(data, 0);
+    sbsetcount(data, size);
+
+    printf("%ld bytes\n", size);
+
+    /* Line splitting */
+    best = 1e9;
+    for (run = 0; run < RUNS; run++)
+    {
+        long *strchr_offsets = NULL;
+
+        start = get_time();
+        index_lines_strchr(data, &strchr_offsets);
+        best = MIN(best, get_time() - start);
+
+        sbfree(strchr_offsets);
+    }
+    report("index lines (strchr)", size, best);
+
+    best = 1e9;
+    for (run = 0; run < RUNS; run++)
+    {
+        sbfree(offsets);
+        offsets = NULL;
+
+        start = get_time();
+        max_len = text_util_index_lines(data, size, &offsets);
+        best = MIN(best, get_time() - start);
+    }
+    report("index lines", size, best);
+
+    if (index_lines_bytes(data, size, &offsets_bytes) != max_len ||
+        sbcount(offsets) != sbcount(offsets_bytes) ||
+        memcmp(offsets, offsets_bytes, sbcount(offsets) * sizeof(offsets[0])))
+    {
+        printf("FAIL: line offsets differ\n");
+        failed = 1;
+    }
+
+    /* Tab expansion */
+    best = 1e9;
+    for (run = 0; run < RUNS; run++)
+    {
+        sbfree(detab_old);
+
+        start = get_time();
+        detab_old = detab_sbpush(data, size, TABSTOP);
+        best = MIN(best, get_time() - start);
+    }
+    report("detab (sbpush per byte)", size, best);
+
+    best = 1e9;
+    for (run = 0; run < RUNS; run++)
+    {
+        sbfree(detab_new);
+        detab_new = NULL;
+
+        start = get_time();
+        width = text_util_detab_width(data, size, TABSTOP);
+        sbsetcount(detab_new, width);
+        text_util_detab(data, size, TABSTOP, detab_new);
+        best = MIN(best, get_time() - start);
+    }
+    report("detab (count and expand)", size, best);
+
+    if (sbcount(detab_old) != sbcount(detab_new) ||
+        memcmp(detab_old, detab_new, sbcount(detab_new)))
+    {
+        printf("FAIL: expanded text differs\n");
+        failed = 1;
+    }
+
+    sbfree(offsets);
+    sbfree(offsets_bytes);
+    sbfree(detab_old);
+    sbfree(detab_new);
+    sbfree(data);
+
+    return failed;
+}